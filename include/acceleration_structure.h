@@ -0,0 +1,278 @@
+#pragma once
+
+#include "linear_bvh.h"
+#include "wide_bvh.h"
+#include "uniform_grid.h"
+#include "level_of_detail.h"
+#include "scene_file.h"
+#include "bvh_optimizer.h"
+
+class ResidencyGL;
+
+// the members follow the std430 layout of InstanceInfo in scene.glsl.
+struct Instance
+{
+   std::array<glm::vec4, 3> WorldToObject; // the rows of the affine transform
+   int Root;
+   int MaterialIndex; // replaces the materials of the geometry unless it is negative
+   int WideRoot; // the bottom level is traversed with the binary nodes from Root if it is negative
+   int Grid; // the bottom level is the grid of this index instead of a BVH unless it is negative
+
+   Instance() : WorldToObject(), Root( 0 ), MaterialIndex( -1 ), WideRoot( -1 ), Grid( -1 ) {}
+};
+
+// every unique geometry is stored once with a bottom-level BVH in its own object space, and the instances place it
+// in the world with a transform. a top-level BVH over the world bounds of the instances leads the rays to them,
+// so moving an instance only rebuilds the top level, and the memory follows the unique geometry, not the instances.
+// the node buffer holds the top level first, followed by the bottom levels.
+// when the spheres of a geometry move, its bottom level is refitted on the GPU, keeping the tree and updating the boxes.
+// the boxes loosen as the spheres drift away from where the tree was built, so once the cost by the surface area
+// heuristic has grown too far, the tree is rebuilt on another thread and swapped in when it is ready.
+// a geometry with the linear builder is instead rebuilt on the GPU whenever it moves, which suits many moving primitives.
+// the bottom levels which have not moved since they were built on the CPU are also compressed into wide BVHs, and
+// the instances traverse them instead of the binary nodes, which are kept for the refit of the geometry that moves.
+// a geometry can also be put in a uniform grid built on the GPU, or left as a single leaf which a ray tests as a list.
+// a scene saved with its buffers is loaded from the mapped file as it is, and it stays static until it is cleared.
+// a scene saved without them is built once, and its buffers are cached next to it, keyed by a hash of the scene.
+// with a memory budget, the large geometries of spheres are split into spatial chunks when the scene is built, and
+// a static scene larger than the budget pages its bottom levels in and out of the buffers as the rays reach them.
+// a static scene loaded from its cache can be optimized for the rays of a profiled render, which restructures and
+// reorders its bottom levels in their places in the buffers, and the cache is written again with them.
+// the nodes of the bottom levels can also carry proxies of their subtrees, which the bounces take instead of
+// the distant clusters of small primitives. they are built again whenever the bottom levels change.
+class AccelerationStructureGL final
+{
+public:
+   enum class BUILDER { SAH, LINEAR, GRID, LIST };
+   enum class NODE_FORMAT { BINARY, WIDE };
+
+   struct Geometry
+   {
+      int SphereOffset;
+      int SphereNum;
+      int TriangleOffset;
+      int TriangleNum;
+      int VertexOffset;
+      int VertexNum;
+      int PrimitiveOffset;
+      int NodeOffset; // from the first bottom-level node
+      int WideNodeOffset;
+      int LeafOffset;
+      int LeafNum;
+      int GridIndex;
+      BUILDER Builder;
+      bool Moved;
+      bool Refitted; // the boxes on the GPU are newer than the ones of the hierarchy
+      bool CostRequested;
+      float BuildCost;
+      BoundingBox Bounds;
+      BVH Hierarchy; // empty with the linear builder and the grid, whose structures exist only on the GPU
+      WideBVH WideHierarchy; // compressed from Hierarchy
+      std::future<BVH> Rebuild;
+   };
+
+   AccelerationStructureGL();
+   ~AccelerationStructureGL();
+
+   // the primitives of a loaded static scene are read from the pages of its file.
+   [[nodiscard]] ArrayView<Sphere> getSpheres() const { return File != nullptr ? MappedSpheres : ArrayView<Sphere>(Spheres); }
+   [[nodiscard]] ArrayView<Vertex> getVertices() const { return File != nullptr ? MappedVertices : ArrayView<Vertex>(Vertices); }
+   [[nodiscard]] ArrayView<Triangle> getTriangles() const
+   {
+      return File != nullptr ? MappedTriangles : ArrayView<Triangle>(Triangles);
+   }
+   [[nodiscard]] int getGeometryNum() const { return static_cast<int>(Geometries.size()); }
+   [[nodiscard]] const Geometry& getGeometry(int geometry_index) const { return Geometries[geometry_index]; }
+   [[nodiscard]] bool isStatic() const { return File != nullptr; }
+   [[nodiscard]] bool isPaged() const { return Residency != nullptr; }
+   [[nodiscard]] bool hasProxies() const { return ProxyMaterials != nullptr; }
+   [[nodiscard]] int getWideProxyOffset() const { return LevelOfDetail->getWideProxyOffset(); }
+   [[nodiscard]] const ResidencyGL* getResidency() const { return Residency.get(); }
+   [[nodiscard]] int getInstanceNum() const { return static_cast<int>(InstanceTransforms.size()); }
+   [[nodiscard]] int getInstanceGeometry(int instance_index) const { return InstanceGeometries[instance_index]; }
+   [[nodiscard]] int getInstanceMaterial(int instance_index) const { return InstanceMaterials[instance_index]; }
+   [[nodiscard]] const glm::mat4& getInstanceTransform(int instance_index) const { return InstanceTransforms[instance_index]; }
+   // the tiles of the megakernel cull the sphere buffer as it is, which is right only when it is already in the world.
+   [[nodiscard]] bool hasOnlyWorldSpheres() const;
+   // the root box of the top level, or the world bounds of the instances of a scene which was loaded with its nodes.
+   [[nodiscard]] BoundingBox getSceneBounds() const;
+   [[nodiscard]] GLsizeiptr getGeometrySize() const;
+   [[nodiscard]] GLsizeiptr getInstanceSize() const;
+   [[nodiscard]] int getTopLevelNodeNum() const { return static_cast<int>(TopLevel.getNodes().size()); }
+   [[nodiscard]] int getRefitNum() const { return RefitNum; }
+   [[nodiscard]] int getRebuildNum() const { return RebuildNum; }
+   // changes whenever the buffers may have been written, so that a copy of them is taken again only then.
+   [[nodiscard]] uint64_t getVersion() const { return Version; }
+   [[nodiscard]] NODE_FORMAT getNodeFormat() const { return NodeFormat; }
+   [[nodiscard]] GLsizeiptr getBottomLevelNodeSize(NODE_FORMAT format) const;
+   // the buffers as the shaders see them, so that the CPU can trace the same data.
+   [[nodiscard]] const BufferGL& getSphereBuffer() const { return SphereBuffer; }
+   [[nodiscard]] const BufferGL& getVertexBuffer() const { return VertexBuffer; }
+   [[nodiscard]] const BufferGL& getTriangleBuffer() const { return TriangleBuffer; }
+   [[nodiscard]] const BufferGL& getNodeBuffer() const { return NodeBuffer; }
+   [[nodiscard]] const BufferGL& getPrimitiveBuffer() const { return PrimitiveBuffer; }
+   [[nodiscard]] const BufferGL& getInstanceBuffer() const { return InstanceBuffer; }
+   [[nodiscard]] const BufferGL& getWideNodeBuffer() const { return WideNodeBuffer; }
+   [[nodiscard]] const BufferGL& getGridCellBuffer() const { return GridBuilder->getCellBuffer(); }
+   // estimates the cost of a ray through the bounds of the primitives by the surface area heuristic for the list,
+   // the grid, and the binned BVH, and returns the builder of the cheapest one.
+   [[nodiscard]] static BUILDER chooseBuilder(
+      const std::vector<Sphere>& spheres,
+      const std::vector<Vertex>& vertices,
+      const std::vector<Triangle>& triangles
+   );
+   // reads the name of a builder such as "sah" or "linear", and returns false if it is unknown.
+   static bool getBuilder(BUILDER& builder, const std::string& name);
+   void setShaders(const std::string& shader_directory_path);
+   // the triangles index the given vertices, and the bottom-level BVH is built right away.
+   int addGeometry(
+      const std::vector<Sphere>& spheres,
+      const std::vector<Vertex>& vertices,
+      const std::vector<Triangle>& triangles,
+      BUILDER builder = BUILDER::SAH
+   );
+   void setBuilder(int geometry_index, BUILDER builder);
+   void setNodeFormat(NODE_FORMAT format);
+   // the bytes of the GPU memory which the buffers of a loaded scene may take, or 0 to upload the scene as a whole.
+   void setMemoryBudget(GLsizeiptr budget) { MemoryBudget = budget; }
+   // builds the proxies of the nodes with the albedos of the given materials, or drops them if it is null.
+   // the nodes of a paged scene move as its chunks are loaded, so it has no proxies.
+   void setProxies(const BufferGL* material_buffer);
+   int addInstance(int geometry_index, const glm::mat4& to_world, int material_index = -1);
+   void setInstanceTransform(int instance_index, const glm::mat4& to_world);
+   // the spheres keep their number and order, and the bottom level is refitted on the next update.
+   void moveSpheres(int geometry_index, const std::vector<Sphere>& spheres);
+   void clear();
+   // writes the primitives and the buffers as the shaders see them, so the scene has to be updated first.
+   bool save(const std::string& file_path, const std::vector<Material>& materials) const;
+   // a file with the buffers of a saved scene only creates them from its pages, and the scene is static.
+   // a file without them is built like a scene of added geometries, unless the cache file holds the buffers built
+   // for the same scene, which are then taken in the same way. otherwise the cache is written after the build.
+   // false if the file does not hold a scene.
+   bool load(std::shared_ptr<const SceneFile> file, const std::string& cache_file_path = std::string());
+   // the content hash of the primitives of a scene file and the build parameters, which keys its cache.
+   [[nodiscard]] uint64_t getCacheKey(const SceneFile& file) const;
+   // false if the scene is not static or does not have a cache, or if the profile is not of its nodes.
+   bool optimize(BVHOptimizer::Statistics& statistics, const TraversalProfile& profile);
+   // swaps in the finished rebuilds, refits the moved geometry, rebuilds the top level,
+   // and uploads what has changed since the last update. a paged scene streams its chunks instead.
+   void update();
+   void bindBuffers() const;
+
+   // a refitted tree is rebuilt when its cost has grown by this factor since it was built.
+   inline static constexpr float MaxCostGrowth = 1.5f;
+   // a step of the 3D-DDA costs about as much as the box test of a node.
+   inline static constexpr float GridStepCost = 1.0f;
+   // the leaf size which the cost estimate of the binned BVH assumes.
+   inline static constexpr int ExpectedLeafSize = 4;
+   // the spheres of a chunk which a geometry is split into with a memory budget.
+   inline static constexpr int ChunkSphereNum = 1 << 16;
+
+private:
+   bool GeometryChanged;
+   bool InstancesChanged;
+   NODE_FORMAT NodeFormat;
+   int RefitNum;
+   int RebuildNum;
+   uint64_t Version;
+   GLsizeiptr MemoryBudget;
+   std::vector<Sphere> Spheres;
+   std::vector<Vertex> Vertices;
+   std::vector<Triangle> Triangles;
+   std::vector<Geometry> Geometries;
+   std::vector<int> InstanceGeometries;
+   std::vector<int> InstanceMaterials;
+   std::vector<glm::mat4> InstanceTransforms;
+   BVH TopLevel;
+   const BufferGL* ProxyMaterials; // the materials which the proxies are built with, or null without the proxies
+   std::shared_ptr<const SceneFile> File;
+   std::shared_ptr<const SceneFile> StructureFile; // the file itself or its cache
+   std::string CacheFilePath; // empty unless the structure is from the cache
+   ArrayView<Sphere> MappedSpheres;
+   ArrayView<Vertex> MappedVertices;
+   ArrayView<Triangle> MappedTriangles;
+   std::unique_ptr<ShaderGL> RefitShader;
+   std::unique_ptr<ShaderGL> CostShader;
+   std::unique_ptr<LinearBVHGL> LinearBuilder;
+   std::unique_ptr<UniformGridGL> GridBuilder;
+   std::unique_ptr<LevelOfDetailGL> LevelOfDetail;
+   std::unique_ptr<ResidencyGL> Residency;
+   BufferGL SphereBuffer;
+   BufferGL VertexBuffer;
+   BufferGL TriangleBuffer;
+   BufferGL NodeBuffer;
+   BufferGL PrimitiveBuffer;
+   BufferGL InstanceBuffer;
+   BufferGL WideNodeBuffer;
+   BufferGL ParentBuffer;
+   BufferGL LeafBuffer;
+   BufferGL VisitBuffer;
+   BufferGL CostBuffer;
+   BufferGL FeedbackBuffer;
+
+   inline static constexpr int RefitGroupSize = 256; // REFIT_GROUP_SIZE in bvh_refit.comp
+
+   template<typename T>
+   static void createBuffer(BufferGL& buffer, ArrayView<T> data, GLbitfield flags = GL_DYNAMIC_STORAGE_BIT)
+   {
+      // a buffer cannot be empty, so an unused element stands in for the missing ones.
+      if (data.empty()) buffer.create( sizeof( T ), nullptr, flags );
+      else buffer.create( static_cast<GLsizeiptr>(sizeof( T ) * data.size()), data.data(), flags );
+   }
+   template<typename T>
+   static void createBuffer(BufferGL& buffer, const std::vector<T>& data) { createBuffer( buffer, ArrayView<T>(data) ); }
+   template<typename T>
+   static void readBuffer(std::vector<T>& data, const BufferGL& buffer)
+   {
+      data.resize( static_cast<size_t>(buffer.getSize()) / sizeof( T ) );
+      if (!data.empty()) buffer.read( data );
+   }
+   [[nodiscard]] static BoundingBox getWorldBounds(const BoundingBox& bounds, const glm::mat4& to_world);
+   [[nodiscard]] static int getNodeNum(const Geometry& geometry);
+   [[nodiscard]] static int getPrimitiveNum(const Geometry& geometry);
+   [[nodiscard]] BoundingBox getGeometryBounds(const Geometry& geometry) const;
+   void copyPrimitives(
+      std::vector<Sphere>& spheres,
+      std::vector<Vertex>& vertices,
+      std::vector<Triangle>& triangles,
+      const Geometry& geometry
+   ) const;
+   // without the materials, the buffers of the acceleration structure are written as the cache of the given key,
+   // along with the primitives if the geometries were split into chunks, which reorders them.
+   bool write(
+      const std::string& file_path,
+      const std::vector<Material>* materials,
+      uint64_t key,
+      bool with_primitives
+   ) const;
+   // false if a record of a file reaches out of the arrays which it indexes, or names no builder.
+   [[nodiscard]] static bool hasValidRecords(
+      ArrayView<Sphere> spheres,
+      ArrayView<Vertex> vertices,
+      ArrayView<Triangle> triangles,
+      ArrayView<SceneFile::GeometryRecord> geometries,
+      ArrayView<SceneFile::InstanceRecord> instances
+   );
+   // splits the spheres at the median of the longest axis of their centers until every part fits in a chunk.
+   [[nodiscard]] static std::vector<std::vector<Sphere>> getSphereChunks(std::vector<Sphere> spheres);
+   void placeGeometries();
+   void swapRebuiltGeometries();
+   void requestRebuilds();
+   void uploadAll();
+   void bindRefitBuffers() const;
+   void fitBoxes(const Geometry& geometry, int leaf_num) const;
+   void refit(int geometry_index);
+   void build(int geometry_index);
+   void buildGrids();
+   void buildProxies();
+   static void buildHierarchy(
+      Geometry& geometry,
+      const std::vector<Sphere>& spheres,
+      const std::vector<Vertex>& vertices,
+      const std::vector<Triangle>& triangles
+   );
+   [[nodiscard]] std::vector<Instance> getInstances() const;
+   [[nodiscard]] std::vector<BVHNode> getBottomLevelNodes() const;
+   [[nodiscard]] std::vector<WideBVHNode> getWideNodes() const;
+   [[nodiscard]] std::vector<uint> getBottomLevelPrimitives() const;
+};
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <common.hpp>
 #include <gtc/type_ptr.hpp>
 #include <gtc/matrix_transform.hpp>
+#include <gtc/matrix_access.hpp>
 #include <gtc/quaternion.hpp>
 
 #define GLM_ENABLE_EXPERIMENTAL
@@ -13,8 +14,11 @@
 
 #include <FreeImage.h>
 #include <iostream>
+#include <algorithm>
 #include <iomanip>
 #include <vector>
+#include <array>
+#include <limits>
 #include <string>
 #include <memory>
 #include <map>
@@ -22,6 +26,16 @@
 #include <sstream>
 #include <fstream>
 #include <chrono>
+#include <future>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <queue>
+#include <cstring>
+#include <functional>
+#include <numeric>
 
 #include "project_constants.h"
 
@@ -30,4 +44,33 @@ using uint = unsigned int;
 
 constexpr uint OPENGL_COLOR_BUFFER_BIT = 0x00004000u;
 constexpr uint OPENGL_DEPTH_BUFFER_BIT = 0x00000100u;
-constexpr uint OPENGL_STENCIL_BUFFER_BIT = 0x00000400u;
\ No newline at end of file
+constexpr uint OPENGL_STENCIL_BUFFER_BIT = 0x00000400u;
+
+// GL_KHR_shader_subgroup is not in the loader
+constexpr GLenum OPENGL_SUBGROUP_SIZE = 0x9532u;
+constexpr GLenum OPENGL_SUBGROUP_SUPPORTED_STAGES = 0x9533u;
+constexpr GLenum OPENGL_SUBGROUP_SUPPORTED_FEATURES = 0x9534u;
+constexpr uint OPENGL_SUBGROUP_FEATURE_BASIC_BIT = 0x00000001u;
+constexpr uint OPENGL_SUBGROUP_FEATURE_VOTE_BIT = 0x00000002u;
+constexpr uint OPENGL_SUBGROUP_FEATURE_BALLOT_BIT = 0x00000008u;
+
+// a read-only view of an array which lives elsewhere, like in a vector or in the pages of a mapped file.
+template<typename T>
+class ArrayView final
+{
+public:
+   ArrayView() : Data( nullptr ), Size( 0 ) {}
+   ArrayView(const T* data, size_t size) : Data( data ), Size( size ) {}
+   ArrayView(const std::vector<T>& data) : Data( data.data() ), Size( data.size() ) {}
+
+   [[nodiscard]] const T* data() const { return Data; }
+   [[nodiscard]] size_t size() const { return Size; }
+   [[nodiscard]] bool empty() const { return Size == 0; }
+   [[nodiscard]] const T* begin() const { return Data; }
+   [[nodiscard]] const T* end() const { return Data + Size; }
+   [[nodiscard]] const T& operator[](size_t index) const { return Data[index]; }
+
+private:
+   const T* Data;
+   size_t Size;
+};
\ No newline at end of file
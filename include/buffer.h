@@ -0,0 +1,49 @@
+#pragma once
+
+#include "base.h"
+
+class BufferGL final
+{
+public:
+   BufferGL() : BufferID( 0 ), Size( 0 ) {}
+   ~BufferGL() { if (BufferID != 0) glDeleteBuffers( 1, &BufferID ); }
+
+   [[nodiscard]] GLuint getBufferID() const { return BufferID; }
+   [[nodiscard]] GLsizeiptr getSize() const { return Size; }
+   void create(GLsizeiptr size, const void* data = nullptr, GLbitfield flags = GL_DYNAMIC_STORAGE_BIT)
+   {
+      deleteBuffer();
+      glCreateBuffers( 1, &BufferID );
+      glNamedBufferStorage( BufferID, size, data, flags );
+      Size = size;
+   }
+   template<typename T>
+   void create(const std::vector<T>& data, GLbitfield flags = GL_DYNAMIC_STORAGE_BIT)
+   {
+      create( static_cast<GLsizeiptr>(sizeof( T ) * data.size()), data.data(), flags );
+   }
+   void deleteBuffer()
+   {
+      if (BufferID != 0) {
+         glDeleteBuffers( 1, &BufferID );
+         BufferID = 0;
+         Size = 0;
+      }
+   }
+   void bindBase(GLenum target, GLuint binding_index) const { glBindBufferBase( target, binding_index, BufferID ); }
+   void clear() const { glClearNamedBufferData( BufferID, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr ); }
+   template<typename T>
+   void update(const std::vector<T>& data, GLintptr offset = 0) const
+   {
+      glNamedBufferSubData( BufferID, offset, static_cast<GLsizeiptr>(sizeof( T ) * data.size()), data.data() );
+   }
+   template<typename T>
+   void read(std::vector<T>& data, GLintptr offset = 0) const
+   {
+      glGetNamedBufferSubData( BufferID, offset, static_cast<GLsizeiptr>(sizeof( T ) * data.size()), data.data() );
+   }
+
+private:
+   GLuint BufferID;
+   GLsizeiptr Size;
+};
\ No newline at end of file
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "shader.h"
+
+// the members follow the std430 layout of BVHNode in scene.glsl.
+// a leaf holds Count primitives from Offset on, and an inner node has the children Offset and -Count.
+struct BVHNode
+{
+   glm::vec3 Min;
+   int Offset;
+   glm::vec3 Max;
+   int Count;
+
+   BVHNode() : Min(), Offset( 0 ), Max(), Count( 0 ) {}
+   [[nodiscard]] bool isLeaf() const { return Count >= 0; }
+};
+
+struct BoundingBox
+{
+   glm::vec3 Min;
+   glm::vec3 Max;
+
+   BoundingBox() : Min( std::numeric_limits<float>::max() ), Max( std::numeric_limits<float>::lowest() ) {}
+   BoundingBox(const glm::vec3& min, const glm::vec3& max) : Min( min ), Max( max ) {}
+};
+
+// a bounding volume hierarchy over the spheres and the triangles, so that both are found by the same traversal,
+// or over boxes such as the world bounds of instances. it is built on the CPU by binning the centroids
+// and choosing the split with the lowest surface area heuristic.
+// the build is shared by the threads of the task pool: the large nodes near the root are bounded, binned, and
+// partitioned in blocks of references at once, and the subtrees below them are forked as tasks. the blocks have a fixed
+// size and their bins are merged exactly, so the tree is the same for any number of threads.
+class BVH final
+{
+public:
+   BVH() = default;
+   ~BVH() = default;
+
+   [[nodiscard]] const std::vector<BVHNode>& getNodes() const { return Nodes; }
+   // a primitive is a triangle index, or a sphere index marked with SpherePrimitive.
+   [[nodiscard]] const std::vector<uint>& getPrimitives() const { return Primitives; }
+   [[nodiscard]] int getDepth() const { return Depth; }
+   [[nodiscard]] BoundingBox getBounds() const { return Nodes.empty() ? BoundingBox() : BoundingBox(Nodes[0].Min, Nodes[0].Max); }
+   // the expected cost of a ray by the surface area heuristic, which grows as refitting loosens the boxes.
+   [[nodiscard]] float getCost() const;
+   [[nodiscard]] static float getSurfaceArea(const glm::vec3& min, const glm::vec3& max)
+   {
+      const glm::vec3 extent = glm::max( max - min, glm::vec3(0.0f) );
+      return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+   }
+   void build(const std::vector<Sphere>& spheres, const std::vector<Vertex>& vertices, const std::vector<Triangle>& triangles);
+   // a single leaf holds all the primitives, so a ray tests them one after another, which is the cheapest for a few of them.
+   void buildLeaf(const std::vector<Sphere>& spheres, const std::vector<Vertex>& vertices, const std::vector<Triangle>& triangles);
+   // the primitives are the indices of the boxes, and a leaf holds as few of them as the depth limit allows.
+   void build(const std::vector<BoundingBox>& boxes);
+
+   struct Reference
+   {
+      glm::vec3 Min;
+      glm::vec3 Max;
+      glm::vec3 Centroid;
+      uint Primitive;
+   };
+
+   // finds the binned split of the references in the node with the lowest surface area heuristic, and returns false
+   // if a leaf is cheaper. a leaf of more than leaf_size references is always split.
+   [[nodiscard]] static bool findSplit(
+      int& axis,
+      float& position,
+      const Reference* references,
+      int count,
+      const BVHNode& node,
+      int leaf_size
+   );
+
+   // SpherePrimitive matches SPHERE_PRIMITIVE in scene.glsl. each level pushes at most one node to the traversal stack,
+   // so the top and the bottom level together fit in BVH_STACK_SIZE, which is twice the maximum depth.
+   inline static constexpr uint SpherePrimitive = 0x80000000u;
+   inline static constexpr int MaxDepth = 32;
+   // bvh_cost.comp evaluates the cost of a refitted hierarchy with the same constants.
+   inline static constexpr float TraversalCost = 1.0f;
+   inline static constexpr float IntersectionCost = 1.0f;
+   inline static constexpr int BinNum = 16;
+   inline static constexpr int MaxLeafSize = 8;
+   // the nodes of at least this many references are processed in blocks by all the threads.
+   inline static constexpr int ParallelReferenceNum = 1 << 16;
+   inline static constexpr int BlockReferenceNum = 1 << 14;
+   // the subtrees of at least this many references are forked as tasks. a smaller hierarchy, or any hierarchy when
+   // the pool has no other thread, is built by the serial recursion, which places the nodes without the arena.
+   inline static constexpr int TaskReferenceNum = 1 << 12;
+
+private:
+   struct Bin
+   {
+      glm::vec3 Min;
+      glm::vec3 Max;
+      int Count;
+
+      Bin() : Min( std::numeric_limits<float>::max() ), Max( std::numeric_limits<float>::lowest() ), Count( 0 ) {}
+   };
+   using Bins = std::array<std::array<Bin, BinNum>, 3>;
+
+   int Depth = 0;
+   int LeafSize = MaxLeafSize;
+   bool Parallel = false; // whether the current build shares its nodes with the threads of the pool
+   std::vector<BVHNode> Nodes;
+   std::vector<uint> Primitives;
+   std::vector<Reference> References;
+   std::vector<Reference> Scratch; // where the blocks of references are partitioned to
+   // the subtree of n references at an index takes at most the 2n - 1 nodes from it on, so no subtree shares them.
+   std::vector<BVHNode> Arena;
+
+   void setReferences(const std::vector<Sphere>& spheres, const std::vector<Vertex>& vertices, const std::vector<Triangle>& triangles);
+   void build(int leaf_size);
+   static void getCentroidBounds(glm::vec3& centroid_min, glm::vec3& centroid_max, const Reference* references, int count);
+   static void addToBins(Bins& bins, const Reference* references, int count, const glm::vec3& centroid_min, const glm::vec3& scale);
+   [[nodiscard]] static glm::vec3 getBinScale(const glm::vec3& centroid_min, const glm::vec3& centroid_max);
+   [[nodiscard]] static bool chooseSplit(
+      int& axis,
+      float& position,
+      const Bins& bins,
+      const glm::vec3& centroid_min,
+      const glm::vec3& centroid_max,
+      int count,
+      const BVHNode& node,
+      int leaf_size
+   );
+   [[nodiscard]] static int getBlockNum(int count) { return (count + BlockReferenceNum - 1) / BlockReferenceNum; }
+   [[nodiscard]] BVHNode getReferenceBounds(int begin, int end) const;
+   [[nodiscard]] bool findSplitInParallel(int& axis, float& position, int begin, int end, const BVHNode& node) const;
+   int partition(int begin, int end, int axis, float position);
+   // returns the depth of the subtree.
+   int buildNode(int arena_index, int begin, int end, int depth);
+   void buildNodeSerially(int node_index, int begin, int end, int depth);
+   void layOut(int node_index, int arena_index);
+};
\ No newline at end of file
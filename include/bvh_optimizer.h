@@ -0,0 +1,80 @@
+#pragma once
+
+#include "bvh.h"
+
+// a ray which a render traced, from MinT up to its closest hit, or up to MaxT if it hit nothing.
+struct RaySegment
+{
+   glm::vec3 Origin;
+   float MinT;
+   glm::vec3 Direction;
+   float MaxT;
+};
+
+// what the rays of a render did in the binary nodes: how many of them entered each node, how many found a closer hit
+// in the primitives of each leaf, and a sample of the rays themselves, which the trees are optimized for.
+struct TraversalProfile
+{
+   uint64_t RayNum = 0;
+   uint64_t NodeVisitNum = 0;
+   uint64_t LeafVisitNum = 0; // of the bottom levels
+   uint64_t LeafHitNum = 0;
+   std::vector<uint> NodeVisits;
+   std::vector<uint> LeafHits;
+   std::vector<RaySegment> Rays;
+};
+
+// restructures a binary BVH for the rays which a render actually traced, rather than for the rays spread evenly
+// which the surface area heuristic assumes. a ray visits every node whose box it crosses before its closest hit,
+// so the visits are known for any shape of the tree: a node costs a traversal step per visit, and a leaf the tests
+// of its primitives. the rotations of Kensler swap a child of a node with a grandchild on the other side, which
+// changes the box of only the node in between, so a rotation is taken when fewer of the rays of the node cross
+// the new box than the old one. the leaves keep their primitives, and no leaf gets deeper than BVH::MaxDepth.
+class BVHOptimizer final
+{
+public:
+   struct Statistics
+   {
+      int TreeNum = 0;
+      int RayNum = 0;
+      int RotationNum = 0;
+      double CostBefore = 0.0;
+      double CostAfter = 0.0;
+   };
+
+   // the nodes of a single tree with its root first, whose leaves may refer to primitives anywhere.
+   explicit BVHOptimizer(std::vector<BVHNode> nodes);
+   ~BVHOptimizer() = default;
+
+   [[nodiscard]] const std::vector<BVHNode>& getNodes() const { return Nodes; }
+   [[nodiscard]] int getRayNum() const { return static_cast<int>(Rays.size()); }
+   // the expected work of the rays which were added, with the constants of BVH::getCost.
+   [[nodiscard]] double getCost();
+   // the ray is in the space of the tree, and it is kept only if it crosses the root.
+   void addRay(const RaySegment& ray);
+   // returns the number of rotations.
+   int rotate();
+   // the nodes are laid out depth first with the child which more rays visit right after its parent,
+   // so that the hot paths through the tree lie in consecutive nodes.
+   void reorder();
+
+   inline static constexpr int MaxPassNum = 8;
+
+private:
+   struct Ray
+   {
+      glm::vec3 Origin;
+      glm::vec3 InverseDirection;
+      float MinT;
+      float MaxT;
+   };
+
+   bool VisitsFound = false;
+   std::vector<BVHNode> Nodes;
+   std::vector<Ray> Rays;
+   std::vector<std::vector<int>> Visits; // the rays which cross each node
+
+   [[nodiscard]] static bool hitBox(const Ray& ray, const glm::vec3& min, const glm::vec3& max);
+   [[nodiscard]] int getVisitNum(int node_index, const glm::vec3& min, const glm::vec3& max) const;
+   void findVisits();
+};
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "acceleration_structure.h"
+
+// lays out the nodes which the CPU traces for its caches, while the buffers of the GPU keep their own order.
+// the two children of a binary node are always tested together, so they share a cache line of their own,
+// and a wide node fills a line by itself. the lines are then gathered into clusters of a page: a cluster grows from
+// its first line by taking the line below it whose box is the largest, which a ray is the most likely to enter,
+// and the lines which are left out start the next clusters, the largest first. so the hot paths of a tree run
+// through few pages, and the trees below a cluster follow it depth first as in the layout of van Emde Boas.
+class CacheLayout final
+{
+public:
+   inline static constexpr size_t LineSize = 64;
+   inline static constexpr int ClusterLineNum = 64; // of 4 KiB
+
+   // the storage starts at a cache line, so that no line of the layout straddles two.
+   template<typename T>
+   struct Allocator
+   {
+      using value_type = T;
+
+      Allocator() = default;
+      template<typename U>
+      Allocator(const Allocator<U>&) {}
+
+      [[nodiscard]] T* allocate(size_t n)
+      {
+         return static_cast<T*>(::operator new( n * sizeof( T ), std::align_val_t(LineSize) ));
+      }
+      void deallocate(T* p, size_t) { ::operator delete( p, std::align_val_t(LineSize) ); }
+      template<typename U>
+      bool operator==(const Allocator<U>&) const { return true; }
+      template<typename U>
+      bool operator!=(const Allocator<U>&) const { return false; }
+   };
+   using BVHNodes = std::vector<BVHNode, Allocator<BVHNode>>;
+   using WideBVHNodes = std::vector<WideBVHNode, Allocator<WideBVHNode>>;
+
+   // the top level stays at 0, and the roots of the instances are moved along with their trees. a root takes a line
+   // alone, which it shares with a padding node. the old index of every node is kept, or -1 for the padding.
+   static void layOut(
+      BVHNodes& laid_out,
+      std::vector<int>& old_indices,
+      std::vector<Instance>& instances,
+      const std::vector<BVHNode>& nodes
+   );
+   static void layOut(WideBVHNodes& laid_out, std::vector<Instance>& instances, const std::vector<WideBVHNode>& nodes);
+
+private:
+   struct Line
+   {
+      float Area; // of the box which a ray enters to reach the line
+      int Index;
+
+      Line(float area, int index) : Area( area ), Index( index ) {}
+      bool operator<(const Line& other) const { return Area < other.Area; }
+   };
+   using ChildLineGetter = std::function<void(std::vector<Line>& child_lines, int line)>;
+
+   // appends the lines of the tree below the first one in their new order.
+   static void cluster(std::vector<int>& order, int first_line, const ChildLineGetter& get_child_lines);
+};
\ No newline at end of file
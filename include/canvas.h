@@ -10,7 +10,13 @@ public:
 
    [[nodiscard]] GLuint getCanvasID() const { return CanvasID; }
    [[nodiscard]] GLuint getColor0TextureID() const { return COLOR0TextureID; }
+   [[nodiscard]] GLuint getColorTextureID(int index) const
+   {
+      return index == 0 ? COLOR0TextureID : ColorTextureIDs[index - 1];
+   }
+   [[nodiscard]] GLuint getDepthTextureID() const { return DepthTextureID; }
    void setCanvas(int width, int height, GLenum format, bool use_stencil = false);
+   void setMultipleRenderTargetCanvas(int width, int height, const std::vector<GLenum>& formats, bool use_depth = true);
    void setMultiSampledCanvas(int width, int height, int sample_num, GLenum format, bool use_stencil = false);
    void clearColor(int buffer_index = 0) const;
    void clearColor(const std::array<GLfloat, 4>& color, int buffer_index = 0) const;
@@ -25,6 +31,8 @@ private:
    GLuint CanvasID;
    GLuint COLOR0TextureID;
    GLuint StencilTextureID;
+   GLuint DepthTextureID;
+   std::vector<GLuint> ColorTextureIDs; // color attachments after COLOR0
 
    void deleteAllTextures();
 };
@@ -0,0 +1,271 @@
+#pragma once
+
+#include "cache_layout.h"
+#include "wide_bvh8.h"
+#include "bvh_optimizer.h"
+#include "lazy_bvh.h"
+
+// traces the frame on the CPU with the algorithm of raytracer.comp. the buffers are read back from the GPU as they are,
+// so the CPU walks the same binary and wide nodes and grids, including the boxes that were refitted or built on the GPU.
+// the rows are shared by the hardware threads, which take the next row when they finish one.
+// a lazy scene is traced without the buffers: the tracer builds its own two levels from the primitives of the scene,
+// and the nodes are split as the rays reach them, so that the first frame is not held up by a full build.
+// the nodes which are read back are laid out again for the caches of the CPU unless it is turned off, and the traversal
+// prefetches the children of a far child while it goes on with the near one.
+// where the CPU has AVX2, the bottom levels of the binary nodes are collapsed into 8-wide nodes, whose children are all
+// tested at once, unless the 8-wide nodes are turned off. the other bottom levels are traversed as on the GPU.
+// a render can also trace the paths in streams instead of one at a time: a thread takes a batch of pixels, and
+// follows a path of every pixel in it a bounce at a time. all the paths of a bounce are intersected before any of
+// them is shaded, the paths are shaded in the order of their materials, and the finished paths are taken out, so that
+// the passes keep running over full arrays however many of the paths are left. the rays of a stream go through the top
+// level one at a time, and then through each 8-wide bottom level together, breadth-first: a node is decoded once and
+// tested for all the rays which reach it, each against its own tmax, and the rays are handed down to the children they
+// enter. a node which only a few rays reach is left to those rays one at a time.
+// a render can also profile the binary nodes: it traces a sample per pixel through them without the wide nodes,
+// counts the visits of the nodes and the closer hits in the leaves, and keeps the rays of some of the pixels.
+class CPUTracer final
+{
+public:
+   CPUTracer();
+   ~CPUTracer() = default;
+
+   [[nodiscard]] int getThreadNum() const { return ThreadNum; }
+   // the pixels are RGBA8 from the bottom row up, as the texture of the final canvas stores them.
+   [[nodiscard]] const std::vector<glm::u8vec4>& getImage() const { return Image; }
+   [[nodiscard]] bool isLazy() const { return Lazy; }
+   [[nodiscard]] bool isSimdSupported() const { return SimdSupported; }
+   // the nodes which the lazy scene has split so far, and the nodes of its complete trees.
+   [[nodiscard]] int getBuiltNodeNum() const;
+   [[nodiscard]] int getMaxNodeNum() const;
+   void setScene(
+      const AccelerationStructureGL& scene,
+      const std::vector<Material>& materials,
+      bool cache_layout = true,
+      bool eight_wide = true
+   );
+   void setLazyScene(const AccelerationStructureGL& scene, const std::vector<Material>& materials);
+   void render(int width, int height, int frame_index, bool streams = false);
+   void render(TraversalProfile& profile, int width, int height, int frame_index);
+
+   // the pixels whose rays a profile keeps, which are spread evenly over the frame.
+   inline static constexpr int MaxProfilePixelNum = 1 << 16;
+
+private:
+   struct Hit
+   {
+      int Material;
+      glm::vec3 Position;
+      glm::vec3 Normal;
+
+      Hit() : Material( 0 ), Position(), Normal() {}
+   };
+
+   // a node of a stream traversal, and the range of the rays in the stream which enter it.
+   struct StreamEntry
+   {
+      int Node;
+      int Begin;
+      int End;
+   };
+
+   // the paths of a batch, whose members are in arrays of their own, so that a pass reads only what it needs.
+   // a pixel has one path in the stream at a time, and the path draws its numbers from the seed of the pixel.
+   struct Stream
+   {
+      std::vector<int> Pixels; // of the paths in the batch
+      std::vector<glm::vec3> Origins;
+      std::vector<glm::vec3> Directions;
+      std::vector<glm::vec3> Throughputs;
+      std::vector<float> Distances; // the tmax of the rays, which is the distance of the closest hit so far
+      std::vector<int> HitInstances; // -1 until a ray hits
+      std::vector<Hit> Hits; // whose material is -1 where the path missed
+      std::vector<int> Order; // of the paths by their materials
+      std::vector<int> MaterialOffsets;
+      std::vector<uint> Seeds; // of the pixels
+      std::vector<glm::vec3> Colors; // of the pixels
+
+      // the rays of an instance in its own space, while its 8-wide bottom level is traversed.
+      std::vector<glm::vec3> LocalOrigins;
+      std::vector<glm::vec3> LocalDirections;
+      std::vector<glm::vec3> LocalInverses;
+      std::vector<int> RayInstances; // of the 8-wide bottom levels which a ray enters
+      std::vector<std::pair<int, int>> InstanceRays; // the instances and the rays which enter them
+      std::vector<int> NodeRays; // the rays of the entries, one range after another
+      std::vector<float> NodeRayDistances; // at which the rays enter the node of their entry
+      std::vector<StreamEntry> Entries;
+      std::array<std::vector<int>, WideBVH8::ChildNum> ChildRays;
+      std::array<std::vector<float>, WideBVH8::ChildNum> ChildDistances;
+   };
+
+   struct Counters
+   {
+      std::atomic<uint64_t> RayNum;
+      std::atomic<uint64_t> LeafVisitNum;
+      std::vector<std::atomic<uint>> NodeVisits;
+      std::vector<std::atomic<uint>> LeafHits;
+
+      explicit Counters(size_t node_num) : RayNum( 0 ), LeafVisitNum( 0 ), NodeVisits(node_num), LeafHits(node_num) {}
+   };
+
+   struct LazyInstance
+   {
+      std::array<glm::vec4, 3> WorldToObject;
+      int Geometry;
+      int MaterialIndex;
+   };
+
+   bool Lazy;
+   bool SimdSupported;
+   int ThreadNum;
+   // the scene, the version of its buffers and the options which the copies below were taken with, so that
+   // a scene whose buffers have not changed since, such as a static one, is not read and converted every frame.
+   const AccelerationStructureGL* CopiedScene;
+   uint64_t CopiedVersion;
+   int CopiedOptions;
+   std::vector<glm::u8vec4> Image;
+   std::vector<Sphere> Spheres;
+   std::vector<Material> Materials;
+   std::vector<Vertex> Vertices;
+   std::vector<Triangle> Triangles;
+   CacheLayout::BVHNodes Nodes;
+   std::vector<int> BufferNodeIndices; // of the nodes in the buffer, so that a profile counts the nodes of the buffer
+   int BufferNodeNum;
+   std::vector<uint> Primitives;
+   std::vector<Instance> Instances;
+   CacheLayout::WideBVHNodes WideNodes;
+   std::vector<WideBVH8Node> Wide8Nodes;
+   std::vector<int> Wide8Roots; // of the instances, or -1 where the bottom level is traversed as on the GPU
+   std::vector<uint> GridCells; // the grids in front of their cells
+   LazyBVH LazyTopLevel; // over the instances
+   std::vector<LazyInstance> LazyInstances;
+   std::vector<std::unique_ptr<LazyBVH>> LazyGeometries;
+
+   // the same as BVH_STACK_SIZE and WIDE_BVH_STACK_SIZE in scene.glsl
+   inline static constexpr int StackSize = 64;
+   inline static constexpr int WideStackSize = 48;
+   // a node pushes all of its children but the nearest, and its tree is no deeper than the binary one.
+   inline static constexpr int Wide8StackSize = (WideBVH8::ChildNum - 1) * StackSize;
+   inline static constexpr int SampleNum = 30;
+   inline static constexpr int MaxDepth = 50;
+   inline static constexpr int StreamPixelNum = 1 << 12;
+   inline static constexpr int LazyCopy = -1; // the options of a copy for the lazy scene
+   // a node which fewer rays of a stream reach is traversed by the rays one at a time.
+   inline static constexpr int Wide8StreamMinRayNum = 4;
+   inline static constexpr float StreamMinDistance = 1e-3f;
+
+   template<typename T>
+   static void readBuffer(std::vector<T>& data, const BufferGL& buffer)
+   {
+      data.resize( static_cast<size_t>(buffer.getSize()) / sizeof( T ) );
+      if (!data.empty()) buffer.read( data );
+   }
+   [[nodiscard]] bool isCopied(const AccelerationStructureGL& scene, int options) const
+   {
+      return CopiedScene == &scene && CopiedVersion == scene.getVersion() && CopiedOptions == options;
+   }
+   [[nodiscard]] static float getRandomFloat(uint& seed);
+   [[nodiscard]] static glm::vec3 getRandomPointInUnitSphere(uint& seed);
+   [[nodiscard]] static uint getSeed(const glm::ivec2& pixel, int frame_index);
+   // the jitter of the sample is drawn from the seed.
+   [[nodiscard]] static glm::vec3 getPrimaryRayDirection(uint& seed, const glm::ivec2& pixel, const glm::ivec2& image_size);
+   [[nodiscard]] static glm::vec3 getBackgroundColor(const glm::vec3& ray_direction);
+   [[nodiscard]] static bool scatter(
+      glm::vec3& ray_origin,
+      glm::vec3& ray_direction,
+      uint& seed,
+      Material::TYPE type,
+      const Hit& hit
+   );
+   bool hitSphere(float& t, Hit& hit, const glm::vec3& ray_origin, const glm::vec3& ray_direction, float t_min, float t_max, int index) const;
+   bool hitTriangle(float& t, Hit& hit, const glm::vec3& ray_origin, const glm::vec3& ray_direction, float t_min, float t_max, int index) const;
+   bool hitPrimitive(float& t, Hit& hit, const glm::vec3& ray_origin, const glm::vec3& ray_direction, float t_min, float t_max, uint primitive) const;
+   static bool hitBox(
+      float& distance,
+      const glm::vec3& ray_origin,
+      const glm::vec3& inverse_direction,
+      float t_min,
+      float t_max,
+      const BoundingBox& box
+   );
+   bool hitBox(float& distance, const glm::vec3& ray_origin, const glm::vec3& inverse_direction, float t_min, float t_max, int index) const
+   {
+      return hitBox( distance, ray_origin, inverse_direction, t_min, t_max, { Nodes[index].Min, Nodes[index].Max } );
+   }
+   bool hitWideBVH(
+      float& closest_so_far,
+      Hit& hit,
+      const glm::vec3& ray_origin,
+      const glm::vec3& ray_direction,
+      const glm::vec3& inverse_direction,
+      float t_min,
+      int root
+   ) const;
+   bool hitWideBVH8(
+      float& closest_so_far,
+      Hit& hit,
+      const glm::vec3& ray_origin,
+      const glm::vec3& ray_direction,
+      const glm::vec3& inverse_direction,
+      float t_min,
+      int root
+   ) const;
+   // the rays of the stream from NodeRays on enter the bottom level of the instance together, and a node is tested
+   // for all the rays which reach it at once.
+   void hitWideBVH8Stream(Stream& stream, int instance, int root) const;
+   // the words of the grid are read as getGrid in scene.glsl reads them.
+   [[nodiscard]] GridInfo getGrid(int grid_index) const;
+   bool hitGrid(
+      float& closest_so_far,
+      Hit& hit,
+      const glm::vec3& ray_origin,
+      const glm::vec3& ray_direction,
+      const glm::vec3& inverse_direction,
+      float t_min,
+      int grid_index
+   ) const;
+   bool hitLazyBVH(
+      float& closest_so_far,
+      Hit& hit,
+      const glm::vec3& ray_origin,
+      const glm::vec3& ray_direction,
+      const glm::vec3& inverse_direction,
+      float t_min,
+      const LazyBVH& bvh
+   ) const;
+   bool traverseLazily(Hit& hit, const glm::vec3& ray_origin, const glm::vec3& ray_direction, float t_min, float t_max) const;
+   // the closest hit is left in the space of its instance, and the instances of the 8-wide bottom levels are only
+   // listed if the list is given.
+   bool hitScene(
+      float& closest_so_far,
+      int& hit_instance,
+      Hit& hit,
+      const glm::vec3& ray_origin,
+      const glm::vec3& ray_direction,
+      float t_min,
+      Counters* counters,
+      std::vector<int>* wide8_instances
+   ) const;
+   void setWorldHit(Hit& hit, const glm::vec3& ray_origin, const glm::vec3& ray_direction, float t, int instance) const;
+   bool traverse(
+      Hit& hit,
+      const glm::vec3& ray_origin,
+      const glm::vec3& ray_direction,
+      float t_min,
+      float t_max,
+      Counters* counters = nullptr
+   ) const;
+   // the rays are kept if the list is given.
+   [[nodiscard]] glm::vec3 tracePixel(
+      const glm::ivec2& pixel,
+      const glm::ivec2& image_size,
+      int frame_index,
+      Counters* counters = nullptr,
+      std::vector<RaySegment>* rays = nullptr
+   ) const;
+   // the hits of the first paths of the stream, whose material is -1 where a path missed.
+   void intersectStream(Stream& stream, int path_num) const;
+   // the colors of the pixels are left in the stream.
+   void traceStream(Stream& stream, int first_pixel, int pixel_num, const glm::ivec2& image_size, int frame_index) const;
+   void renderStreams(int width, int height, int frame_index);
+   void render(int width, int height, int frame_index, Counters* counters, std::vector<RaySegment>* rays, int ray_stride);
+};
\ No newline at end of file
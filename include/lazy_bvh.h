@@ -0,0 +1,54 @@
+#pragma once
+
+#include "bvh.h"
+
+// a BVH which is split only where the rays go. a node starts as the box of a range of references, and the first
+// traversal that reaches it splits it in place with the binned surface area heuristic of BVH, so a frame builds
+// only the nodes its rays visit, and the first pixels wait for little more than the bounds of the root.
+// the nodes of the children are taken from an array that is allocated for the whole tree, so they never move,
+// and the thread which wins a node by compare-and-swap splits it while the others wait for it.
+// the references of a node are reordered only by the thread splitting it, and no other node shares them.
+class LazyBVH final
+{
+public:
+   LazyBVH() = default;
+   ~LazyBVH() = default;
+   LazyBVH(const LazyBVH&) = delete;
+   LazyBVH& operator=(const LazyBVH&) = delete;
+
+   // the box of a node is final as soon as its parent is returned, and reading it does not split the node.
+   [[nodiscard]] BoundingBox getBounds(int index = 0) const { return { Nodes[index].Min, Nodes[index].Max }; }
+   [[nodiscard]] int getBuiltNodeNum() const { return NextNode.load( std::memory_order_relaxed ); }
+   [[nodiscard]] int getMaxNodeNum() const { return static_cast<int>(Nodes.size()); }
+   // the node is split if it has not been yet, so the node is final as it is returned.
+   // a leaf holds Count primitives from Offset on, and an inner node has the children Offset and -Count.
+   [[nodiscard]] const BVHNode& getNode(int index) const
+   {
+      if (States[index].load( std::memory_order_acquire ) != BUILT) split( index );
+      return Nodes[index];
+   }
+   // only a built node is read for its children, so that the prefetch neither splits a node nor races with its split.
+   void prefetchChildren(int index) const
+   {
+      if (States[index].load( std::memory_order_acquire ) != BUILT || Nodes[index].isLeaf()) return;
+      __builtin_prefetch( &Nodes[Nodes[index].Offset] );
+   }
+   // the primitives of a leaf stay where they are once the leaf is returned.
+   [[nodiscard]] uint getPrimitive(int index) const { return References[index].Primitive; }
+   // only the root is found here, and a leaf holds at most leaf_size references unless the depth limit is reached.
+   void reset(std::vector<BVH::Reference> references, int leaf_size);
+
+private:
+   enum STATE { UNSPLIT = 0, SPLITTING, BUILT };
+
+   int LeafSize = BVH::MaxLeafSize;
+   // the splits are logically const, since the tree which a traversal sees is the same either way.
+   mutable std::atomic<int> NextNode{ 0 };
+   mutable std::vector<BVHNode> Nodes; // an unsplit node holds its range of references like a leaf
+   mutable std::vector<std::atomic<int>> States;
+   mutable std::vector<int> Depths;
+   mutable std::vector<BVH::Reference> References;
+
+   [[nodiscard]] static BVHNode getRange(const BVH::Reference* references, int begin, int end);
+   void split(int index) const;
+};
\ No newline at end of file
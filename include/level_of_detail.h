@@ -0,0 +1,39 @@
+#pragma once
+
+#include "bvh.h"
+#include "buffer.h"
+
+// the members follow the std430 layout of ProxyInfo in scene.glsl.
+struct ProxyInfo
+{
+   glm::vec3 Center;
+   float Radius;
+   glm::vec3 Albedo;
+   float Coverage;
+};
+
+// the proxies of the nodes of the bottom levels, which the bounces take instead of the clusters of primitives that are
+// smaller than their footprints, like the particles far away. the proxy of a node aggregates its whole subtree:
+// the sphere which bounds the primitives, their albedo weighted by their areas, and the chance of hitting any of them.
+// they are built on the GPU from the buffers of the scene, a node per invocation, for both the binary and the wide nodes.
+class LevelOfDetailGL final
+{
+public:
+   LevelOfDetailGL() = default;
+   ~LevelOfDetailGL() = default;
+
+   [[nodiscard]] const BufferGL& getProxyBuffer() const { return ProxyBuffer; }
+   [[nodiscard]] int getWideProxyOffset() const { return WideProxyOffset; }
+   void setShaders(const std::string& shader_directory_path);
+   // the proxies of the binary nodes are indexed like the nodes and the wide ones follow them, so the top level
+   // before the first bottom-level node keeps unused proxies. the scene buffers and the materials have to be bound already.
+   void build(int first_node, int node_num, int wide_node_num);
+   void bindBuffers() const;
+
+   inline static constexpr int GroupSize = 256; // PROXY_GROUP_SIZE in bvh_proxy.comp
+
+private:
+   int WideProxyOffset = 0;
+   std::unique_ptr<ShaderGL> ProxyShader;
+   BufferGL ProxyBuffer;
+};
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "bvh.h"
+#include "radix_sort.h"
+
+// builds a bottom-level BVH on the GPU from scratch, which is fast enough to be repeated every frame for many moving
+// primitives. the centers are sorted along the Morton curve, the hierarchy is read from the common prefixes of
+// the sorted codes as Karras (2012) does, and bvh_refit.comp fits the boxes afterwards.
+// every leaf holds one primitive, and the tree is worse than the binned one by the surface area heuristic.
+class LinearBVHGL final
+{
+public:
+   LinearBVHGL() = default;
+   ~LinearBVHGL() = default;
+
+   [[nodiscard]] static int getNodeNum(int primitive_num) { return std::max( 2 * primitive_num - 1, 1 ); }
+   void setShaders(const std::string& shader_directory_path);
+   void setBuffers(int max_primitive_num);
+   // the scene buffers have to be bound already. the nodes and the primitives are written where the geometry is placed,
+   // and the parents and the leaves for the refit are written to the given buffers, while the boxes are left to it.
+   void build(
+      const BoundingBox& bounds,
+      int sphere_offset,
+      int sphere_num,
+      int triangle_offset,
+      int triangle_num,
+      int node_offset,
+      int primitive_offset,
+      int leaf_offset,
+      const BufferGL& parent_buffer,
+      const BufferGL& leaf_buffer
+   );
+
+   inline static constexpr int GroupSize = 256; // LBVH_GROUP_SIZE in lbvh_morton.comp and lbvh_hierarchy.comp
+   inline static constexpr int MortonBitNum = 30;
+
+private:
+   std::unique_ptr<ShaderGL> MortonShader;
+   std::unique_ptr<ShaderGL> HierarchyShader;
+   RadixSortGL Sorter;
+};
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "acceleration_structure.h"
+
+// imports the particles of a simulation as spheres from a binary little-endian PLY file, whose vertices have
+// the properties x, y, z, and optionally radius, or from raw arrays of floats, which are xyz with the extension
+// .xyz and xyzr with .xyzr. the file is mapped, and the particles are converted on all threads in batches of
+// a bounded size right into the mapped scene file, whose pages are released after every batch, so neither file
+// is ever resident as a whole. the scene is written without its acceleration structure, which is built on the GPU
+// with the linear builder by default when it is loaded.
+class ParticleImporter final
+{
+public:
+   struct Settings
+   {
+      float Radius; // of the particles without their own radius
+      int Builder; // one of AccelerationStructureGL::BUILDER
+      glm::vec3 Albedo;
+
+      Settings() : Radius( 0.01f ), Builder( static_cast<int>(AccelerationStructureGL::BUILDER::LINEAR) ), Albedo( 0.8f ) {}
+   };
+
+   ParticleImporter() = default;
+   ~ParticleImporter() { close(); }
+   ParticleImporter(const ParticleImporter&) = delete;
+   ParticleImporter& operator=(const ParticleImporter&) = delete;
+
+   [[nodiscard]] size_t getParticleNum() const { return ParticleNum; }
+   // reads arguments such as "radius=0.05" or "builder=sah", and returns false if one of them is unknown.
+   static bool parse(Settings& settings, const std::vector<std::string>& arguments);
+   // maps the file and reads the layout of its particles.
+   bool open(const std::string& file_path);
+   void close();
+   // converts the particles from begin to end into the spheres on all threads, and grows the bounds over them.
+   void convert(Sphere* spheres, size_t begin, size_t end, BoundingBox& bounds, const Settings& settings) const;
+   bool write(const std::string& scene_file_path, const Settings& settings) const;
+
+   inline static constexpr size_t BatchSize = 1 << 20; // particles, which keep the spheres of a batch to 32 MB
+
+private:
+   // a property is a float or a double at an offset in the record of a particle, and a missing one has no offset.
+   struct Property
+   {
+      int Offset;
+      bool Double;
+
+      Property() : Offset( -1 ), Double( false ) {}
+   };
+
+   const uchar* Data = nullptr;
+   size_t Size = 0;
+   size_t DataOffset = 0;
+   size_t Stride = 0;
+   size_t ParticleNum = 0;
+   std::array<Property, 4> Properties; // x, y, z, and radius
+
+   [[nodiscard]] static float getValue(const uchar* record, const Property& property)
+   {
+      if (property.Double) {
+         double value;
+         std::memcpy( &value, record + property.Offset, sizeof( double ) );
+         return static_cast<float>(value);
+      }
+      float value;
+      std::memcpy( &value, record + property.Offset, sizeof( float ) );
+      return value;
+   }
+   bool readPlyHeader();
+   // drops the pages of a range which is done with, and the next access reads them again.
+   static void release(const uchar* data, size_t begin, size_t end);
+};
\ No newline at end of file
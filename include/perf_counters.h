@@ -0,0 +1,34 @@
+#pragma once
+
+#include "base.h"
+
+// counts the cache misses of this process with the hardware counters of the kernel through perf_event_open.
+// the threads which the process starts after the counters are opened are counted as well, and their counts are
+// added when they end. a reset does not clear the counts which the ended threads have added, so a count is taken as
+// the difference of the reads at start and stop. the counters are missing on some machines, such as most virtual ones, and then nothing is
+// counted. the L2 misses have no event common to all the processors, so the misses of L1D are counted instead,
+// which are the loads that go to L2.
+class PerfCounters final
+{
+public:
+   enum class EVENT { L1D_MISSES = 0, LLC_MISSES, COUNT };
+
+   PerfCounters();
+   ~PerfCounters();
+   PerfCounters(const PerfCounters&) = delete;
+   PerfCounters& operator=(const PerfCounters&) = delete;
+
+   [[nodiscard]] bool isAvailable(EVENT event) const { return Descriptors[static_cast<int>(event)] >= 0; }
+   // the count between the last start and stop.
+   [[nodiscard]] uint64_t get(EVENT event) const { return Counts[static_cast<int>(event)]; }
+   [[nodiscard]] static const char* getName(EVENT event);
+   void start();
+   void stop();
+
+private:
+   std::array<int, static_cast<int>(EVENT::COUNT)> Descriptors;
+   std::array<uint64_t, static_cast<int>(EVENT::COUNT)> StartCounts;
+   std::array<uint64_t, static_cast<int>(EVENT::COUNT)> Counts;
+
+   [[nodiscard]] uint64_t read(int index) const;
+};
\ No newline at end of file
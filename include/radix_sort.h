@@ -0,0 +1,41 @@
+#pragma once
+
+#include "shader.h"
+#include "buffer.h"
+
+// sorts 32-bit keys with 32-bit values on the GPU. each pass is a stable counting sort of 8 bits,
+// starting from the least significant digit, so the number of passes follows the bits the keys actually use.
+class RadixSortGL final
+{
+public:
+   RadixSortGL();
+   ~RadixSortGL() = default;
+
+   // the info buffer holds the indirect dispatch arguments followed by the element number: { uvec3, uint }.
+   // it can be filled on the GPU so that the number of elements does not have to be read back.
+   [[nodiscard]] const BufferGL& getInfoBuffer() const { return InfoBuffer; }
+   [[nodiscard]] const BufferGL& getKeyBuffer() const { return KeyBuffers[0]; }
+   [[nodiscard]] const BufferGL& getValueBuffer() const { return ValueBuffers[0]; }
+   [[nodiscard]] const BufferGL& getSortedKeyBuffer() const { return KeyBuffers[ResultIndex]; }
+   [[nodiscard]] const BufferGL& getSortedValueBuffer() const { return ValueBuffers[ResultIndex]; }
+   [[nodiscard]] static GLuint getBlockNum(int element_num)
+   {
+      return static_cast<GLuint>((element_num + BlockSize - 1) / BlockSize);
+   }
+   void setShaders(const std::string& shader_directory_path);
+   void setBuffers(int max_element_num);
+   void setElementNum(int element_num) const;
+   void sort(int key_bit_num);
+
+   inline static constexpr int BlockSize = 256;
+
+private:
+   int ResultIndex;
+   std::unique_ptr<ShaderGL> HistogramShader;
+   std::unique_ptr<ShaderGL> ScanShader;
+   std::unique_ptr<ShaderGL> ScatterShader;
+   BufferGL InfoBuffer;
+   BufferGL HistogramBuffer;
+   std::array<BufferGL, 2> KeyBuffers;
+   std::array<BufferGL, 2> ValueBuffers;
+};
\ No newline at end of file
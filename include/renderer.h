@@ -9,7 +9,10 @@
 
 #pragma once
 
-#include "canvas.h"
+#include "wavefront.h"
+#include "cpu_tracer.h"
+#include "perf_counters.h"
+#include "residency.h"
 #include "object.h"
 
 class RendererGL
@@ -24,7 +27,10 @@ public:
    RendererGL();
    ~RendererGL() = default;
 
-   void play();
+   // the scene is loaded from the file if it is given, or the default scene is set otherwise.
+   void play(const std::string& scene_file_path = std::string());
+   // a loaded scene larger than the budget in bytes is paged, and 0 uploads it as a whole.
+   void setMemoryBudget(GLsizeiptr budget) { MemoryBudget = budget; }
 
 private:
    inline static RendererGL* Renderer = nullptr;
@@ -32,18 +38,51 @@ private:
    int FrameWidth;
    int FrameHeight;
    int FrameIndex;
+   int AnimatedGeometry;
+   int AnimationStep;
+   int LevelOfDetail; // the index of the bias in LevelOfDetailBiases
+   bool UseRasterizedPrimary;
+   bool UseTileCulling;
+   bool SubgroupSupported;
+   bool UseSubgroupTraversal;
+   bool CollectStatistics;
+   bool UseWavefront;
+   bool UseCPUTracer;
+   bool UseLazyBuild; // the CPU tracer builds its own nodes as the rays reach them
+   bool UseCacheLayout; // the CPU tracer lays the nodes it reads back out for its caches
+   bool UseEightWideNodes; // the CPU tracer collapses the bottom levels into 8-wide nodes where it has AVX2
+   bool UseRayStreams; // the CPU tracer follows the paths of a batch of pixels a bounce at a time
+   bool Animate;
+   GLuint DispatchTimer;
+   GLsizeiptr MemoryBudget;
    glm::ivec2 ClickedPoint;
-   std::vector<Sphere> Spheres;
+   std::vector<Material> Materials;
+   std::vector<Sphere> AnimatedSpheres; // where the animated spheres rest
    std::unique_ptr<CameraGL> MainCamera;
    std::unique_ptr<ShaderGL> Shader;
    std::unique_ptr<ShaderGL> ScreenShader;
+   std::unique_ptr<ShaderGL> ImpostorShader;
+   std::unique_ptr<ShaderGL> MeshShader;
    std::unique_ptr<ObjectGL> ScreenObject;
+   std::unique_ptr<ObjectGL> ImpostorObject;
+   std::unique_ptr<ObjectGL> MeshObject;
    std::unique_ptr<CanvasGL> FinalCanvas;
+   std::unique_ptr<CanvasGL> PrimaryCanvas; // G-buffer of primary hits: position, normal, material
+   std::unique_ptr<BufferGL> MaterialBuffer;
+   std::unique_ptr<AccelerationStructureGL> Scene;
+   std::unique_ptr<BufferGL> StatisticsBuffer;
+   std::unique_ptr<WavefrontGL> Wavefront;
+   std::unique_ptr<CPUTracer> Tracer;
+   std::unique_ptr<PerfCounters> TracerCounters;
 
    void registerCallbacks() const;
    void initialize();
 
    static void printOpenGLInformation();
+   [[nodiscard]] static bool hasExtension(const std::string& name);
+   [[nodiscard]] static bool isSubgroupTraversalSupported();
+   // the votes of the subgroup traversal can also be taken with the older ARB extensions, whose ballots are 64-bit.
+   [[nodiscard]] static bool isArbSubgroupTraversalSupported();
 
    static void cleanup(GLFWwindow* window);
    static void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods);
@@ -55,12 +94,48 @@ private:
    }
    static void reshapeWrapper(GLFWwindow* window, int width, int height) { Renderer->reshape( window, width, height ); }
 
-   void setSpheres();
+   [[nodiscard]] int addMesh(
+      const std::vector<glm::vec3>& vertices,
+      const std::vector<glm::vec3>& normals,
+      const std::vector<uint>& indices,
+      int material_index
+   ) const;
+   void setScene();
+   bool loadScene(const std::string& scene_file_path);
+   void setImpostorObject();
+   void setMeshObject();
+   static void getCubeMesh(std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, std::vector<uint>& indices);
+   void drawPrimaryVisibility() const;
    void drawScene() const;
+   void benchmarkLevelOfDetail();
+   void optimizeScene();
+   void drawSceneOnCPU() const;
+   void printStatistics(int group_num) const;
+   void printWavefrontStatistics() const;
    void drawScreen() const;
    void render() const;
    void update();
    static void writeTexture(GLuint texture_id, int width, int height, const std::string& name = {});
+   [[nodiscard]] static const char* getBuilderName(AccelerationStructureGL::BUILDER builder)
+   {
+      switch (builder) {
+         case AccelerationStructureGL::BUILDER::SAH: return "Binned SAH with Refit";
+         case AccelerationStructureGL::BUILDER::LINEAR: return "Linear on the GPU";
+         case AccelerationStructureGL::BUILDER::GRID: return "Uniform Grid on the GPU";
+         case AccelerationStructureGL::BUILDER::LIST: return "List";
+         default: return "";
+      }
+   }
+   [[nodiscard]] static const char* getAccumulationFormatName(WavefrontGL::ACCUMULATION format)
+   {
+      switch (format) {
+         case WavefrontGL::ACCUMULATION::RGBA32F: return "RGBA32F";
+         case WavefrontGL::ACCUMULATION::RGBA16F: return "RGBA16F";
+         case WavefrontGL::ACCUMULATION::R11F_G11F_B10F: return "R11F_G11F_B10F";
+         case WavefrontGL::ACCUMULATION::RGB9_E5: return "RGB9_E5";
+         default: return "";
+      }
+   }
 
    // 16 and 32 do well, anything in between or below is bad.
    // 32 seems to do well on laptop/desktop Windows Intel and on NVidia/AMD as well.
@@ -70,4 +145,9 @@ private:
    {
       return (size + ThreadGroupSize - 1) / ThreadGroupSize;
    }
+
+   // the biases of the level of detail which the key steps through, where 0 traverses every node.
+   // a larger bias takes the proxies of larger nodes, which is faster and blurrier.
+   inline static constexpr std::array<float, 4> LevelOfDetailBiases = { 0.0f, 0.25f, 1.0f, 4.0f };
+   inline static constexpr int BenchmarkFrameNum = 4;
 };
\ No newline at end of file
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "acceleration_structure.h"
+
+// pages the bottom levels of a static scene which do not fit in the memory budget of the GPU. every bottom level
+// is a chunk, which is a spatial part of the scene, and the buffers hold only the chunks which are resident in pools
+// sized to the budget, relocated to wherever their ranges were allocated. an instance of a chunk which is not resident
+// has no root but a node with its box at WideRoot, and raytracer.comp marks it in the feedback buffer when a ray reaches it, deferring the pixel if it was
+// a primary ray. every update reads the feedback, uploads the chunks which were loaded on other threads since the last
+// one, and starts loading the requested chunks, evicting those used least recently to make room for them.
+class ResidencyGL final
+{
+public:
+   enum class POOL { SPHERES = 0, VERTICES, TRIANGLES, NODES, PRIMITIVES, WIDE_NODES, COUNT };
+
+   // the buffers of the scene, which the residency creates and fills.
+   struct Buffers
+   {
+      std::array<BufferGL*, static_cast<int>(POOL::COUNT)> Pools;
+      BufferGL* Instances;
+      BufferGL* Feedback;
+   };
+
+   // the mapped buffers of the scene as they were saved.
+   struct Source
+   {
+      ArrayView<Sphere> Spheres;
+      ArrayView<Vertex> Vertices;
+      ArrayView<Triangle> Triangles;
+      ArrayView<BVHNode> Nodes;
+      ArrayView<uint> Primitives;
+      ArrayView<Instance> Instances;
+      ArrayView<WideBVHNode> WideNodes;
+   };
+
+   explicit ResidencyGL(const Buffers& buffers);
+   ~ResidencyGL() = default;
+
+   [[nodiscard]] int getChunkNum() const { return static_cast<int>(Chunks.size()); }
+   [[nodiscard]] int getResidentNum() const;
+   [[nodiscard]] int getLoadNum() const { return LoadNum; }
+   [[nodiscard]] int getEvictionNum() const { return EvictionNum; }
+   [[nodiscard]] GLsizeiptr getPoolSize() const;
+   // splits the scene into chunks and creates the pools, and returns false if the scene fits in the budget as it is,
+   // or if its grids could not be relocated. the chunks are made resident in their order until the pools are full.
+   bool initialize(const Source& source, GLsizeiptr budget);
+   void update();
+
+   // the values of the feedback in scene.glsl, which keeps the highest one that any ray of the frame wrote.
+   // the chunks which the primary rays need are loaded first, and they are never evicted for the bounces.
+   inline static constexpr uint FeedbackBounceUsed = 1u;
+   inline static constexpr uint FeedbackPrimaryUsed = 2u;
+   inline static constexpr uint FeedbackBounceMissed = 3u;
+   inline static constexpr uint FeedbackPrimaryMissed = 4u;
+   // the chunks started loading in one update, which bounds the memory of the loads in flight.
+   inline static constexpr int MaxLoadNum = 8;
+
+private:
+   struct Range
+   {
+      int Offset;
+      int Num;
+
+      Range() : Offset( 0 ), Num( 0 ) {}
+   };
+
+   // the buffers of a chunk relocated to its ranges in the pools
+   struct ChunkData
+   {
+      std::vector<Sphere> Spheres;
+      std::vector<Vertex> Vertices;
+      std::vector<Triangle> Triangles;
+      std::vector<BVHNode> Nodes;
+      std::vector<uint> Primitives;
+      std::vector<WideBVHNode> WideNodes;
+   };
+
+   struct Chunk
+   {
+      std::array<Range, static_cast<int>(POOL::COUNT)> Source;
+      std::array<int, static_cast<int>(POOL::COUNT)> Target; // in the pools while the chunk is resident or loading
+      int Root;
+      int WideRoot;
+      int LastUsed;
+      int LoadedAt;
+      int RequestedAt; // since the chunk was requested while it is not resident, or -1
+      uint Feedback; // the highest feedback of its instances in the last update
+      bool Resident;
+      std::future<ChunkData> Load;
+   };
+
+   // the free ranges of a pool by their offsets, which are merged with their neighbors when they are freed.
+   struct Allocator
+   {
+      std::map<int, int> Free;
+
+      void reset(int size);
+      [[nodiscard]] int allocate(int num);
+      void free(int offset, int num);
+   };
+
+   inline static constexpr std::array<size_t, static_cast<int>(POOL::COUNT)> ElementSizes = {
+      sizeof( Sphere ), sizeof( Vertex ), sizeof( Triangle ), sizeof( BVHNode ), sizeof( uint ), sizeof( WideBVHNode )
+   };
+
+   int UpdateIndex;
+   int TopLevelNodeNum;
+   int NodeBase; // the top level and a node with the box of each chunk precede the pool of the nodes
+   int LoadNum;
+   int EvictionNum;
+   Buffers Targets;
+   Source Scene;
+   std::vector<Chunk> Chunks;
+   std::vector<int> InstanceChunks;
+   std::array<Allocator, static_cast<int>(POOL::COUNT)> Allocators;
+
+   [[nodiscard]] int getTopLevelNodeNum() const;
+   [[nodiscard]] Chunk getChunk(int root, int wide_root) const;
+   [[nodiscard]] ChunkData relocate(const Chunk& chunk) const;
+   bool allocate(Chunk& chunk);
+   void free(Chunk& chunk);
+   // evicts a chunk to make room for one of the given feedback, and cycles the chunks which the primary rays use
+   // only if nothing else is loading.
+   bool evict(uint feedback, bool cycle);
+   void upload(Chunk& chunk, const ChunkData& data) const;
+   void uploadInstances() const;
+};
\ No newline at end of file
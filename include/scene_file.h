@@ -0,0 +1,140 @@
+#pragma once
+
+#include "bvh.h"
+
+// a versioned binary scene whose sections hold arrays in the std430 layout of the GPU buffers, so that the file is
+// mapped into memory and the buffers are created right from its pages, without parsing or copying them first.
+// every section starts at a page boundary. the sections of the acceleration structure are the buffers of a built scene,
+// and they are optional: a scene without them is built again when it is loaded.
+// a file is written to a temporary file first and renamed over the old one, so that another process which maps it
+// sees either the old file or the new one, and never a partial one.
+class SceneFile final
+{
+public:
+   enum class SECTION
+   {
+      MATERIALS = 0, SPHERES, VERTICES, TRIANGLES, GEOMETRIES, INSTANCES,
+      NODES, PRIMITIVES, GPU_INSTANCES, WIDE_NODES, GRID_CELLS, COUNT
+   };
+
+   // the primitives of a geometry in the arrays of the scene, whose triangles index the vertices of the whole scene.
+   struct GeometryRecord
+   {
+      BoundingBox Bounds;
+      int SphereOffset;
+      int SphereNum;
+      int TriangleOffset;
+      int TriangleNum;
+      int VertexOffset;
+      int VertexNum;
+      int Builder;
+      int Padding;
+   };
+
+   struct InstanceRecord
+   {
+      glm::mat4 ToWorld;
+      int Geometry;
+      int MaterialIndex;
+      std::array<int, 2> Padding;
+   };
+
+   // what a section is written from. the stride is the size of an element, which the loader checks against its type.
+   // a section without data is reserved, and it is filled in place in the mapped file.
+   struct SectionData
+   {
+      const void* Data;
+      size_t Size;
+      size_t Stride;
+
+      SectionData() : Data( nullptr ), Size( 0 ), Stride( 1 ) {}
+      template<typename T>
+      SectionData(ArrayView<T> data) : Data( data.data() ), Size( sizeof( T ) * data.size() ), Stride( sizeof( T ) ) {}
+      template<typename T>
+      [[nodiscard]] static SectionData getReserved(size_t num)
+      {
+         SectionData section;
+         section.Size = sizeof( T ) * num;
+         section.Stride = sizeof( T );
+         return section;
+      }
+   };
+   // fills a reserved section, and returns false to give up the file.
+   using SectionFiller = std::function<bool(SECTION section, uchar* data)>;
+
+   SceneFile() = default;
+   ~SceneFile() { close(); }
+   SceneFile(const SceneFile&) = delete;
+   SceneFile& operator=(const SceneFile&) = delete;
+
+   [[nodiscard]] size_t getSize() const { return Size; }
+   // the key of the scene which the acceleration structure was built for, or 0 if the file holds its own primitives.
+   [[nodiscard]] uint64_t getKey() const { return Header->Key; }
+   [[nodiscard]] uint64_t getSectionHash(SECTION section, uint64_t seed) const
+   {
+      const Section& s = Header->Sections[static_cast<int>(section)];
+      return getHash( Data + s.Offset, static_cast<size_t>(s.Size), seed );
+   }
+   // FNV-1a over 8 bytes at a time, which keeps up with the disk for the sections of millions of primitives.
+   [[nodiscard]] static uint64_t getHash(const void* data, size_t size, uint64_t seed);
+   [[nodiscard]] bool hasAccelerationStructure() const
+   {
+      return Header != nullptr && Header->Sections[static_cast<int>(SECTION::NODES)].Size > 0;
+   }
+   // false if the elements of the section are not of the given type.
+   template<typename T>
+   [[nodiscard]] bool get(ArrayView<T>& view, SECTION section) const
+   {
+      const Section& s = Header->Sections[static_cast<int>(section)];
+      if (s.Stride != sizeof( T )) return false;
+
+      view = ArrayView<T>(reinterpret_cast<const T*>(Data + s.Offset), static_cast<size_t>(s.Size / s.Stride));
+      return true;
+   }
+   // maps the file and checks the header. the views stay valid until the file is closed.
+   bool open(const std::string& file_path);
+   void close();
+   // the reserved sections are filled in their order through a writable mapping of the file before it is renamed.
+   static bool write(
+      const std::string& file_path,
+      const std::array<SectionData, static_cast<int>(SECTION::COUNT)>& sections,
+      uint64_t key = 0,
+      const SectionFiller& fill = nullptr
+   );
+
+   inline static constexpr uint Version = 2;
+   inline static constexpr size_t PageSize = 4096;
+
+private:
+   struct Section
+   {
+      uint64_t Offset;
+      uint64_t Size;
+      uint64_t Stride;
+   };
+
+   struct FileHeader
+   {
+      std::array<char, 4> Magic;
+      uint Version;
+      uint SectionNum;
+      uint Padding;
+      uint64_t Key;
+      std::array<Section, static_cast<int>(SECTION::COUNT)> Sections;
+   };
+
+   inline static constexpr std::array<char, 4> Magic = { 'R', 'T', 'S', 'C' };
+
+   const uchar* Data = nullptr;
+   size_t Size = 0;
+   const FileHeader* Header = nullptr;
+
+   [[nodiscard]] static size_t alignToPage(size_t offset) { return (offset + PageSize - 1) / PageSize * PageSize; }
+   static bool fillSections(
+      const std::string& file_path,
+      size_t size,
+      const std::array<SectionData, static_cast<int>(SECTION::COUNT)>& sections,
+      const FileHeader& header,
+      const SectionFiller& fill
+   );
+};
\ No newline at end of file
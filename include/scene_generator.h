@@ -0,0 +1,74 @@
+#pragma once
+
+#include "acceleration_structure.h"
+
+// generates reproducible scenes of many spheres for benchmarks. the cover scene of "Ray Tracing in One Weekend"
+// lays the spheres out on a jittered grid around three large ones on a ground sphere, and the other layouts fill
+// a cube uniformly or in clusters, whose side grows with the number of spheres to keep their density.
+// every sphere draws from its own random stream of the seed and its index, so the spheres are generated in parallel
+// and the scene is the same for the same settings on any number of threads.
+class SceneGenerator final
+{
+public:
+   enum class LAYOUT { COVER, UNIFORM, CLUSTERED };
+   enum class RADIUS { CONSTANT, UNIFORM, LOG_UNIFORM };
+
+   struct Settings
+   {
+      LAYOUT Layout;
+      RADIUS Radius;
+      int SphereNum;
+      int ClusterNum;
+      int MaterialNum; // the spheres pick from a palette of this many materials
+      int Builder; // one of AccelerationStructureGL::BUILDER, or chosen by the cost model if negative
+      float MinRadius; // the radius of the constant distribution
+      float MaxRadius;
+      float MetalFraction;
+      uint Seed;
+
+      Settings() :
+         Layout( LAYOUT::COVER ), Radius( RADIUS::CONSTANT ), SphereNum( 488 ), ClusterNum( 16 ), MaterialNum( 64 ),
+         Builder( -1 ), MinRadius( 0.2f ), MaxRadius( 0.2f ), MetalFraction( 0.2f ), Seed( 1 ) {}
+   };
+
+   // reads arguments such as "layout=clustered", "spheres=1000000", or "radius=log_uniform",
+   // and returns false if one of them is unknown or out of range.
+   static bool parse(Settings& settings, const std::vector<std::string>& arguments);
+   // the spheres are in the object space of the scene, which the transform places in front of the camera.
+   static void generate(
+      std::vector<Sphere>& spheres,
+      std::vector<Material>& materials,
+      glm::mat4& to_world,
+      const Settings& settings
+   );
+   // writes the scene as one geometry without its acceleration structure, which is built when the file is loaded.
+   static bool write(const std::string& file_path, const Settings& settings);
+
+   // the mean distance between the centers of the neighbouring spheres of the cube layouts
+   inline static constexpr float Spacing = 1.0f;
+
+private:
+   // splitmix64, which is seeded without a warm-up and costs a few instructions per number.
+   struct Random
+   {
+      uint64_t State;
+
+      Random(uint64_t seed, uint64_t stream) : State( seed * 0x9E3779B97F4A7C15ull ^ stream * 0xD1B54A32D192ED03ull ) {}
+      [[nodiscard]] float get()
+      {
+         uint64_t z = State += 0x9E3779B97F4A7C15ull;
+         z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+         z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+         z ^= z >> 31;
+         return static_cast<float>(z >> 40) * 0x1.0p-24f;
+      }
+      [[nodiscard]] glm::vec3 getVector() { return { get(), get(), get() }; }
+      [[nodiscard]] glm::vec3 getNormal();
+   };
+
+   // the stream of the palette and of the cluster centers, after the streams of the spheres
+   inline static constexpr uint64_t SceneStream = 0xFFFFFFFFull;
+
+   [[nodiscard]] static float getRadius(Random& random, const Settings& settings);
+   static void addMaterials(std::vector<Material>& materials, const Settings& settings);
+};
\ No newline at end of file
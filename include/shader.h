@@ -3,38 +3,60 @@
 #include "base.h"
 #include "camera.h"
 
-struct Sphere
+struct Material
 {
    enum class TYPE { METAL = 1, LAMBERTIAN };
 
+   glm::vec3 Albedo;
    TYPE Type;
-   float Radius;
+
+   Material() : Albedo(), Type( TYPE::METAL ) {}
+   Material(TYPE type, const glm::vec3& albedo) : Albedo( albedo ), Type( type ) {}
+};
+
+// the members follow the std430 layout of SphereInfo in scene.glsl, so the spheres are copied to the GPU as they are.
+struct Sphere
+{
    glm::vec3 Center;
-   glm::vec3 Albedo;
+   float Radius;
+   int MaterialIndex;
+   std::array<int, 3> Padding;
 
-   Sphere() : Type( TYPE::METAL ), Radius( 0.0f ), Center(), Albedo() {}
-   Sphere(TYPE type, float radius, const glm::vec3& center, const glm::vec3& albedo) :
-      Type( type ), Radius( radius ), Center( center ), Albedo( albedo ) {}
+   Sphere() : Center(), Radius( 0.0f ), MaterialIndex( 0 ), Padding() {}
+   Sphere(float radius, const glm::vec3& center, int material_index) :
+      Center( center ), Radius( radius ), MaterialIndex( material_index ), Padding() {}
 };
 
-class ShaderGL
+// the members follow the std430 layout of VertexInfo in scene.glsl.
+struct Vertex
 {
-public:
-   struct SphereLocationSet
-   {
-      GLint Type;
-      GLint Center;
-      GLint Radius;
-      GLint Albedo;
+   glm::vec3 Position;
+   float Padding0;
+   glm::vec3 Normal;
+   float Padding1;
 
-      SphereLocationSet() : Type( 0 ), Center( 0 ), Radius( 0 ), Albedo( 0 ) {}
-   };
+   Vertex() : Position(), Padding0( 0.0f ), Normal(), Padding1( 0.0f ) {}
+   Vertex(const glm::vec3& position, const glm::vec3& normal) :
+      Position( position ), Padding0( 0.0f ), Normal( normal ), Padding1( 0.0f ) {}
+};
+
+// a triangle indexes three vertices of the shared vertex buffer, and follows the std430 layout of TriangleInfo.
+struct Triangle
+{
+   std::array<uint, 3> Indices;
+   int MaterialIndex;
 
+   Triangle() : Indices(), MaterialIndex( 0 ) {}
+   Triangle(uint i0, uint i1, uint i2, int material_index) : Indices{ i0, i1, i2 }, MaterialIndex( material_index ) {}
+};
+
+class ShaderGL
+{
+public:
    struct LocationSet
    {
       GLint ModelViewProjection, SphereNum;
       std::map<GLint, GLint> Texture; // <binding point, texture id>
-      std::vector<SphereLocationSet> Spheres;
 
       LocationSet() : ModelViewProjection( 0 ), SphereNum( 0 ) {}
    };
@@ -49,19 +71,27 @@ public:
       const char* tessellation_control_shader_path = nullptr,
       const char* tessellation_evaluation_shader_path = nullptr
    );
-   void setComputeShader(const char* compute_shader_path);
+   // each definition is inserted as a #define right after the version directive.
+   void setComputeShader(const char* compute_shader_path, const std::vector<std::string>& definitions = {});
+   void setSphereUniformLocations();
    void setRayUniformLocations();
+   void setImpostorUniformLocations();
+   void setMeshUniformLocations();
    void setScreenUniformLocations();
    void addUniformLocation(const std::string& name)
    {
       CustomLocations[name] = glGetUniformLocation( ShaderProgram, name.c_str() );
    }
    void transferBasicTransformationUniforms(const glm::mat4& to_world, const CameraGL* camera, bool use_texture = false) const;
-   void transferSphereUniformsToShader(const std::vector<Sphere>& spheres);
+   void transferSphereUniformsToShader(ArrayView<Sphere> spheres);
    void uniform1i(const char* name, int value) const
    {
       glProgramUniform1i( ShaderProgram, CustomLocations.find( name )->second, value );
    }
+   void uniform1ui(const char* name, GLuint value) const
+   {
+      glProgramUniform1ui( ShaderProgram, CustomLocations.find( name )->second, value );
+   }
    void uniform1f(const char* name, float value) const
    {
       glProgramUniform1f( ShaderProgram, CustomLocations.find( name )->second, value );
@@ -70,6 +100,10 @@ public:
    {
       glProgramUniform1fv( ShaderProgram, CustomLocations.find( name )->second, count, value );
    }
+   void uniform2iv(const char* name, const glm::ivec2& value) const
+   {
+      glProgramUniform2iv( ShaderProgram, CustomLocations.find( name )->second, 1, &value[0] );
+   }
    void uniform2fv(const char* name, const glm::vec2& value) const
    {
       glProgramUniform2fv( ShaderProgram, CustomLocations.find( name )->second, 1, &value[0] );
@@ -105,5 +139,9 @@ protected:
    static void readShaderFile(std::string& shader_contents, const char* shader_path);
    [[nodiscard]] static std::string getShaderTypeString(GLenum shader_type);
    [[nodiscard]] static bool checkCompileError(GLenum shader_type, const GLuint& shader);
-   [[nodiscard]] static GLuint getCompiledShader(GLenum shader_type, const char* shader_path);
+   [[nodiscard]] static GLuint getCompiledShader(
+      GLenum shader_type,
+      const char* shader_path,
+      const std::vector<std::string>& definitions = {}
+   );
 };
\ No newline at end of file
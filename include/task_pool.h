@@ -0,0 +1,54 @@
+#pragma once
+
+#include "base.h"
+
+// a pool of worker threads which share recursive work by stealing. a thread forks a task onto the back of its own
+// queue and goes on with the rest of the work, and the idle threads steal the oldest tasks from the fronts of the
+// others, which are the biggest ones in a recursion. a thread waiting for its forks runs the queued tasks meanwhile,
+// so the tasks can fork and wait again without blocking the pool. the threads outside the pool fork onto a queue of
+// their own, and they help in the same way while they wait.
+class TaskPool final
+{
+public:
+   explicit TaskPool(int worker_num);
+   ~TaskPool();
+   TaskPool(const TaskPool&) = delete;
+   TaskPool& operator=(const TaskPool&) = delete;
+
+   // the workers along with the thread that waits.
+   [[nodiscard]] int getThreadNum() const { return static_cast<int>(Workers.size()) + 1; }
+   // the pool of a worker for every hardware thread but the one which waits.
+   [[nodiscard]] static TaskPool& get();
+   // the counter is incremented now and decremented when the task has run.
+   void fork(std::function<void()> task, std::atomic<int>& pending);
+   void wait(const std::atomic<int>& pending);
+   // runs the function for every index from 0 to num - 1, the first on the calling thread.
+   template<typename F>
+   void run(int num, const F& function)
+   {
+      std::atomic<int> pending( 0 );
+      for (int i = 1; i < num; ++i) fork( [&function, i]() { function( i ); }, pending );
+      if (num > 0) function( 0 );
+      wait( pending );
+   }
+
+private:
+   struct Queue
+   {
+      std::mutex Mutex;
+      std::deque<std::function<void()>> Tasks;
+   };
+
+   bool Stopping;
+   std::atomic<int> QueuedNum;
+   std::vector<std::unique_ptr<Queue>> Queues; // the workers', and then the one of the other threads
+   std::vector<std::thread> Workers;
+   std::mutex SleepMutex;
+   std::condition_variable Wake;
+
+   inline static thread_local int WorkerIndex = -1;
+
+   [[nodiscard]] int getQueueIndex() const { return WorkerIndex >= 0 ? WorkerIndex : static_cast<int>(Workers.size()); }
+   bool runQueuedTask();
+   void work(int worker_index);
+};
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "bvh.h"
+#include "buffer.h"
+
+// the members follow the std430 layout of GridInfo in scene.glsl, and they are GRID_INFO_SIZE words.
+struct GridInfo
+{
+   glm::vec3 Min;
+   int CellOffset; // the first cell of this grid in the cell buffer
+   glm::vec3 CellSize;
+   int Padding0;
+   glm::ivec3 Resolution;
+   int Padding1;
+
+   GridInfo() : Min(), CellOffset( 0 ), CellSize(), Padding0( 0 ), Resolution(), Padding1( 0 ) {}
+};
+
+// a uniform grid over the box of a geometry, which suits many primitives of a similar size spread evenly, like particles.
+// it is built on the GPU by a counting sort into the cells: every primitive counts the cells which its box overlaps,
+// an exclusive scan of the counts gives where the list of each cell starts, and the primitives are written to the lists.
+// the grids of all the geometries share the buffers and are built together. the cell buffer holds the grids, then
+// the starts of the lists of all the cells and one past the last, followed by the lists, so a cell lists from its start
+// to the next one. keeping the grids in the same buffer saves a storage block, of which a shader may have only 16.
+class UniformGridGL final
+{
+public:
+   UniformGridGL() = default;
+   ~UniformGridGL() = default;
+
+   [[nodiscard]] const BufferGL& getCellBuffer() const { return CellBuffer; }
+   [[nodiscard]] int getCellNum() const { return CellNum; }
+   [[nodiscard]] int getReferenceNum() const { return ReferenceNum; }
+   // about CellsPerPrimitive cells for each primitive, and the cells are as close to cubes as the bounds allow.
+   [[nodiscard]] static glm::ivec3 getResolution(const BoundingBox& bounds, int primitive_num);
+   void setShaders(const std::string& shader_directory_path);
+   void clear();
+   int addGrid(const BoundingBox& bounds, int sphere_offset, int sphere_num, int triangle_offset, int triangle_num);
+   // the scene buffers have to be bound already. the number of the listed primitives is read back after the scan
+   // to size the lists, which waits for the counting to finish.
+   void build();
+   // takes the cell buffer of grids which were built before, like the ones of a saved scene.
+   void setCells(ArrayView<uint> cells);
+   void bindBuffers() const;
+
+   inline static constexpr int GroupSize = 256; // GRID_GROUP_SIZE in grid.glsl
+   inline static constexpr int GridInfoSize = static_cast<int>(sizeof( GridInfo ) / sizeof( uint )); // GRID_INFO_SIZE in scene.glsl
+   inline static constexpr float CellsPerPrimitive = 2.0f;
+   inline static constexpr int MaxResolution = 256;
+
+private:
+   struct Source
+   {
+      int SphereOffset;
+      int SphereNum;
+      int TriangleOffset;
+      int TriangleNum;
+   };
+
+   int CellNum = 0;
+   int ReferenceNum = 0;
+   std::vector<GridInfo> Grids;
+   std::vector<Source> Sources;
+   std::unique_ptr<ShaderGL> CountShader;
+   std::unique_ptr<ShaderGL> ScanShader;
+   std::unique_ptr<ShaderGL> FillShader;
+   BufferGL GridBuffer;
+   BufferGL CellBuffer;
+   BufferGL CountBuffer;
+
+   void dispatch(const ShaderGL& shader, int grid_index) const;
+};
\ No newline at end of file
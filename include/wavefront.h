@@ -0,0 +1,81 @@
+#pragma once
+
+#include "canvas.h"
+#include "radix_sort.h"
+#include "bvh.h"
+
+// traces one sample per pixel at a time as a queue of rays, one bounce per dispatch, instead of a path per invocation.
+// between bounces, the queue can be sorted by the origin cell and direction of the rays to make them coherent.
+// the shading can also be split from the intersection so that the hits are shaded in the order of their materials.
+class WavefrontGL final
+{
+public:
+   enum class SORTING { OFF = 0, AUTO, ALWAYS };
+   // the values match the ACCUMULATION_* definitions in packing.glsl.
+   enum class ACCUMULATION { RGBA32F = 0, RGBA16F, R11F_G11F_B10F, RGB9_E5 };
+
+   WavefrontGL();
+   ~WavefrontGL() = default;
+
+   [[nodiscard]] SORTING getSorting() const { return Sorting; }
+   void setSorting(SORTING sorting) { Sorting = sorting; }
+   [[nodiscard]] bool getMaterialSorting() const { return SortByMaterial; }
+   void setMaterialSorting(bool sort_by_material) { SortByMaterial = sort_by_material; }
+   [[nodiscard]] ACCUMULATION getAccumulationFormat() const { return AccumulationFormat; }
+   void setAccumulationFormat(ACCUMULATION format);
+   [[nodiscard]] static int getRadianceSize(ACCUMULATION format)
+   {
+      switch (format) {
+         case ACCUMULATION::RGBA32F: return 16;
+         case ACCUMULATION::RGBA16F: return 8;
+         default: return 4;
+      }
+   }
+   [[nodiscard]] double getAccumulationTrafficPerFrame() const;
+   void setShaders(const std::string& shader_directory_path);
+   void setBuffers(int width, int height);
+   // the rays are sorted by their origins in the scene bounds.
+   void render(
+      ArrayView<Sphere> spheres,
+      const BoundingBox& scene_bounds,
+      int material_num,
+      int frame_index,
+      const CanvasGL* canvas
+   );
+
+   inline static constexpr int SampleNum = 30;
+   inline static constexpr int MaxDepth = 50;
+   inline static constexpr int GroupSize = 256;
+   inline static constexpr int RaySize = 32;
+   // sorting costs a few passes over the queue for every bounce,
+   // which pays off only when the scene data no longer fits in the caches.
+   inline static constexpr int MinSphereNumToSort = 1024;
+
+private:
+   int Width;
+   int Height;
+   int CurrentQueueIndex;
+   SORTING Sorting;
+   bool SortByMaterial;
+   ACCUMULATION AccumulationFormat;
+   std::unique_ptr<ShaderGL> GenerateShader;
+   std::unique_ptr<ShaderGL> ExtendShader;
+   std::unique_ptr<ShaderGL> IntersectShader;
+   std::unique_ptr<ShaderGL> ShadeShader;
+   std::unique_ptr<ShaderGL> SetupShader;
+   std::unique_ptr<ShaderGL> SortKeyShader;
+   std::unique_ptr<ShaderGL> ReorderShader;
+   std::unique_ptr<ShaderGL> ResolveShader;
+   BufferGL StateBuffer;
+   BufferGL AccumulationBuffer;
+   BufferGL HitBuffer;
+   std::array<BufferGL, 2> RayQueues;
+   RadixSortGL Sorter;
+
+   [[nodiscard]] bool needToSort(int sphere_num) const;
+   void setAccumulationBuffers();
+   void bindQueues() const;
+   void sortRays(const BoundingBox& scene_bounds);
+   void intersectAndShadeByMaterial(int depth, int material_num);
+   void extendRays(int depth, int material_num);
+};
\ No newline at end of file
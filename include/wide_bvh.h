@@ -0,0 +1,56 @@
+#pragma once
+
+#include "bvh.h"
+
+// the members follow the std430 layout of WideBVHNode in scene.glsl, and a node fills a 64-byte cache line.
+// the boxes of the children are quantized to 8 bits per plane within the box of the node, whose scale is a power of two
+// per axis, and each plane word holds that plane of all four children, one byte per child.
+// a child is an inner node at Child, or a leaf of Count primitives from Child on, as told by its byte of Counts.
+struct WideBVHNode
+{
+   glm::vec3 Origin;
+   uint Exponents; // the biased exponents of the scales in the lower three bytes
+   std::array<uint, 6> Planes; // min x, min y, min z, max x, max y, max z
+   std::array<int, 4> Child;
+   uint Counts;
+   uint Padding;
+
+   WideBVHNode() : Origin(), Exponents( 0 ), Planes(), Child(), Counts( 0 ), Padding( 0 ) {}
+};
+
+// a 4-wide BVH which is collapsed from the binary one, taking two of its levels at a time, so that a ray loads
+// a third of the node memory with half of the node visits. the leaves are kept as they are.
+class WideBVH final
+{
+public:
+   WideBVH() = default;
+   ~WideBVH() = default;
+
+   [[nodiscard]] const std::vector<WideBVHNode>& getNodes() const { return Nodes; }
+   // the child indices are local to this hierarchy, and the primitives are those of the binary one.
+   // no node is made when a leaf is too big for the format, and the binary hierarchy has to be used instead.
+   void convert(const BVH& binary);
+   // the nodes of a single tree with its root first.
+   void convert(const std::vector<BVHNode>& binary_nodes);
+   // the box of a child is never smaller than the one of the binary node it was quantized from.
+   [[nodiscard]] static BoundingBox getChildBounds(const WideBVHNode& node, int child);
+   [[nodiscard]] static float getScale(uint exponents, int axis)
+   {
+      return glm::uintBitsToFloat( ((exponents >> (8 * axis)) & 0xFFu) << 23 );
+   }
+   // the biased exponents of the smallest scales whose 255 steps from the minimum of the box still reach its maximum.
+   [[nodiscard]] static uint getExponents(const BVHNode& box);
+   // the steps from the origin to the planes of the box, which are rounded outward.
+   static void quantize(glm::uvec3& min, glm::uvec3& max, const glm::vec3& origin, uint exponents, const BVHNode& box);
+
+   // ChildNum matches WIDE_BVH_CHILD_NUM, and InnerChild and EmptyChild match the bytes of Counts in scene.glsl.
+   inline static constexpr int ChildNum = 4;
+   inline static constexpr uint InnerChild = 0xFFu;
+   inline static constexpr uint EmptyChild = 0u;
+
+private:
+   std::vector<WideBVHNode> Nodes;
+
+   void convertNode(int wide_index, const std::vector<BVHNode>& binary_nodes, int binary_index);
+   static void quantize(WideBVHNode& node, int child, const BVHNode& bounds);
+};
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "wide_bvh.h"
+
+// the members are in the order in which the SIMD test of the CPU loads them: a row of the planes holds a byte for each
+// of the 8 children, which widens to a vector of 8 floats. the planes are quantized as in WideBVHNode, and a byte
+// of Counts is the primitive count of a leaf, or WideBVH::InnerChild or WideBVH::EmptyChild as on the GPU.
+struct alignas(64) WideBVH8Node
+{
+   glm::vec3 Origin;
+   uint Exponents; // the biased exponents of the scales in the lower three bytes
+   std::array<std::array<uchar, 8>, 6> Planes; // min x, min y, min z, max x, max y, max z
+   std::array<int, 8> Child;
+   std::array<uchar, 8> Counts;
+
+   WideBVH8Node() : Origin(), Exponents( 0 ), Planes(), Child(), Counts() {}
+};
+
+// an 8-wide BVH for the CPU, which tests a ray against all the children of a node at once with AVX2.
+// a node is collapsed from the binary one by opening the inner child with the largest box until there are 8 children,
+// which are the ones a ray is the most likely to enter, and the inner children are converted in that order as well,
+// so that the hot children follow their parent in memory. the leaves are kept as they are.
+class WideBVH8 final
+{
+public:
+   WideBVH8() = default;
+   ~WideBVH8() = default;
+
+   [[nodiscard]] const std::vector<WideBVH8Node>& getNodes() const { return Nodes; }
+   // the child indices are local to this hierarchy with the root first, and the primitives are those of the binary one.
+   // no node is made when a leaf is too big for the format.
+   void convert(const std::vector<BVHNode>& binary_nodes, int binary_root);
+
+   inline static constexpr int ChildNum = 8;
+
+private:
+   std::vector<WideBVH8Node> Nodes;
+
+   [[nodiscard]] static bool isConvertible(const std::vector<BVHNode>& binary_nodes, int binary_index);
+   void convertNode(int wide_index, const std::vector<BVHNode>& binary_nodes, int binary_index);
+};
\ No newline at end of file
@@ -1,8 +1,42 @@
 #include "renderer.h"
+#include "scene_generator.h"
+#include "particle_importer.h"
 
-int main()
+int main(int argc, char* argv[])
 {
+   // ray_tracing [scene file] [budget=<MB>] to page a scene larger than the budget of GPU memory
+   // ray_tracing --generate <scene file> [key=value ...] to write a stress scene first
+   // ray_tracing --import <particle file> <scene file> [key=value ...] to write a scene of the particles first
+   std::string scene_file_path = argc > 1 ? argv[1] : std::string();
+   if (scene_file_path == "--generate") {
+      SceneGenerator::Settings settings;
+      scene_file_path = argc > 2 ? argv[2] : "../stress.rtsc";
+      if (!SceneGenerator::parse( settings, std::vector<std::string>(argv + std::min( argc, 3 ), argv + argc ) ) ||
+          !SceneGenerator::write( scene_file_path, settings )) return 1;
+   }
+   else if (scene_file_path == "--import") {
+      if (argc < 4) {
+         std::cerr << "Could not import without a particle file and a scene file\n";
+         return 1;
+      }
+
+      ParticleImporter::Settings settings;
+      ParticleImporter importer;
+      scene_file_path = argv[3];
+      if (!ParticleImporter::parse( settings, std::vector<std::string>(argv + 4, argv + argc) ) ||
+          !importer.open( argv[2] ) || !importer.write( scene_file_path, settings )) return 1;
+   }
+
    RendererGL renderer;
-   renderer.play();
+   if (argc == 3 && std::string(argv[2]).rfind( "budget=", 0 ) == 0) {
+      std::istringstream stream(std::string(argv[2]).substr( 7 ));
+      double megabytes = 0.0;
+      if (!(stream >> megabytes) || megabytes < 0.0) {
+         std::cerr << "Could not read the memory budget " << argv[2] << "\n";
+         return 1;
+      }
+      renderer.setMemoryBudget( static_cast<GLsizeiptr>(megabytes * 1024.0 * 1024.0) );
+   }
+   renderer.play( scene_file_path );
    return 0;
 }
\ No newline at end of file
@@ -0,0 +1,35 @@
+#define GRID_GROUP_SIZE 256
+
+layout (local_size_x = GRID_GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+// the grids are also read from here while they are built, before they are copied to the front of GridCell.
+layout (binding = 16, std430) readonly buffer Grids { GridInfo Grid[]; };
+// the number of primitives in each cell while counting, and the cursor of the list of each cell while filling
+layout (binding = 0, std430) buffer GridCounts { uint GridCount[]; };
+
+uniform int SphereOffset;
+uniform int TriangleOffset;
+uniform int PrimitiveNum;
+uniform int GridIndex;
+
+// the primitives of a geometry are its spheres followed by its triangles, as the BVH builders take them.
+uint getPrimitive(out vec3 box_min, out vec3 box_max, in int index)
+{
+   if (index < SphereNum) {
+      SphereInfo sphere = Sphere[SphereOffset + index];
+      box_min = sphere.Center - sphere.Radius;
+      box_max = sphere.Center + sphere.Radius;
+      return uint(SphereOffset + index) | SPHERE_PRIMITIVE;
+   }
+   int triangle = TriangleOffset + index - SphereNum;
+   uvec3 indices = Triangle[triangle].Indices;
+   box_min = min( Vertex[indices.x].Position, min( Vertex[indices.y].Position, Vertex[indices.z].Position ) );
+   box_max = max( Vertex[indices.x].Position, max( Vertex[indices.y].Position, Vertex[indices.z].Position ) );
+   return uint(triangle);
+}
+
+void getCellRange(out ivec3 cell_min, out ivec3 cell_max, in GridInfo grid, in vec3 box_min, in vec3 box_max)
+{
+   cell_min = clamp( ivec3(floor( (box_min - grid.Min) / grid.CellSize )), ivec3(0), grid.Resolution - 1 );
+   cell_max = clamp( ivec3(floor( (box_max - grid.Min) / grid.CellSize )), ivec3(0), grid.Resolution - 1 );
+}
\ No newline at end of file
@@ -0,0 +1,7 @@
+// include this right after the version directive, since extensions have to be enabled before any other code.
+// the path state is stored in half precision anyway, so it is also computed in half precision where it is supported.
+#extension GL_AMD_gpu_shader_half_float : enable
+#extension GL_NV_gpu_shader5 : enable
+#if defined(GL_AMD_gpu_shader_half_float) || defined(GL_NV_gpu_shader5)
+#define HALF_ARITHMETIC
+#endif
\ No newline at end of file
@@ -0,0 +1,24 @@
+#version 460
+
+#include "scene.glsl"
+
+in vec3 position;
+in vec3 normal;
+flat in int material;
+
+layout (location = 0) out vec4 position_output;
+layout (location = 1) out vec4 normal_output;
+layout (location = 2) out vec4 material_output; // index into the material table
+
+void main()
+{
+   // the normal is turned to the side of the face which the camera sees, as hitTriangle does for the traced rays.
+   vec3 shading_normal = normalize( normal );
+   vec3 face_normal = cross( dFdx( position ), dFdy( position ) );
+   if (dot( face_normal, position ) > zero) face_normal = -face_normal;
+   if (dot( shading_normal, face_normal ) < zero) shading_normal = -shading_normal;
+
+   position_output = vec4(position, one);
+   normal_output = vec4(shading_normal, zero);
+   material_output = vec4(float(material), zero, zero, zero);
+}
\ No newline at end of file
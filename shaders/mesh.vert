@@ -0,0 +1,24 @@
+#version 460
+
+#include "scene.glsl"
+
+uniform mat4 ProjectionMatrix;
+uniform mat4 WorldMatrix;
+uniform int MaterialIndex;
+
+layout (location = 0) in vec3 v_position;
+layout (location = 1) in vec3 v_normal;
+
+out vec3 position;
+out vec3 normal;
+flat out int material;
+
+void main()
+{
+   // the triangles are drawn unindexed in their order in the triangle buffer, so every three vertices share a material.
+   // the geometry of an instance is drawn from its first triangle, and gl_VertexID counts from the first vertex drawn.
+   material = MaterialIndex >= 0 ? MaterialIndex : Triangle[gl_VertexID / 3].MaterialIndex;
+   position = vec3(WorldMatrix * vec4(v_position, one));
+   normal = transpose( inverse( mat3(WorldMatrix) ) ) * v_normal;
+   gl_Position = ProjectionMatrix * vec4(position, one);
+}
\ No newline at end of file
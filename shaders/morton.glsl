@@ -0,0 +1,17 @@
+// spreads the lower 10 bits so that there are two zero bits between each of them.
+uint expandBits(in uint v)
+{
+   v = (v * 0x00010001u) & 0xFF0000FFu;
+   v = (v * 0x00000101u) & 0x0F00F00Fu;
+   v = (v * 0x00000011u) & 0xC30C30C3u;
+   v = (v * 0x00000005u) & 0x49249249u;
+   return v;
+}
+
+// interleaves the bits of a point quantized to 2^bit_num cells per axis, where bit_num <= 10.
+uint getMortonCode(in vec3 normalized_point, in uint bit_num)
+{
+   float cell_num = float(1u << bit_num);
+   uvec3 cell = uvec3(clamp( normalized_point * cell_num, vec3(0.0f), vec3(cell_num - 1.0f) ));
+   return (expandBits( cell.x ) << 2u) | (expandBits( cell.y ) << 1u) | expandBits( cell.z );
+}
\ No newline at end of file
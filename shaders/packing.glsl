@@ -0,0 +1,86 @@
+#define ACCUMULATION_RGBA32F 0
+#define ACCUMULATION_RGBA16F 1
+#define ACCUMULATION_R11F_G11F_B10F 2
+#define ACCUMULATION_RGB9_E5 3
+
+// the bit layouts are the same as the GL_R11F_G11F_B10F and GL_RGB9_E5 texture formats,
+// but they are packed by hand so that they can be read and written in storage buffers.
+uint packR11G11B10F(in vec3 color)
+{
+   // the 11 and 10-bit floats share the exponent bias of half floats, so their bits are the rounded upper bits of halves.
+   vec3 c = max( color, vec3(0.0f) );
+   uvec3 h = uvec3(packHalf2x16( vec2(c.x, 0.0f) ), packHalf2x16( vec2(c.y, 0.0f) ), packHalf2x16( vec2(c.z, 0.0f) ));
+   uvec3 f = min( (h + uvec3(8u, 8u, 16u)) >> uvec3(4u, 4u, 5u), uvec3(0x7BFu, 0x7BFu, 0x3DFu) );
+   return f.x | (f.y << 11u) | (f.z << 22u);
+}
+
+vec3 unpackR11G11B10F(in uint bits)
+{
+   return vec3(
+      unpackHalf2x16( (bits & 0x7FFu) << 4u ).x,
+      unpackHalf2x16( ((bits >> 11u) & 0x7FFu) << 4u ).x,
+      unpackHalf2x16( (bits >> 22u) << 5u ).x
+   );
+}
+
+uint packRGB9E5(in vec3 color)
+{
+   const float max_value = 65408.0f; // (2^9 - 1) / 2^9 * 2^(31 - 15)
+   vec3 c = clamp( color, vec3(0.0f), vec3(max_value) );
+   float max_channel = max( c.x, max( c.y, c.z ) );
+   int exponent = max( -16, int(floor( log2( max( max_channel, 1e-30f ) ) )) ) + 16;
+   if (uint(floor( max_channel / exp2( float(exponent - 24) ) + 0.5f )) == 512u) exponent++;
+   uvec3 mantissa = uvec3(floor( c / exp2( float(exponent - 24) ) + 0.5f ));
+   return mantissa.x | (mantissa.y << 9u) | (mantissa.z << 18u) | (uint(exponent) << 27u);
+}
+
+vec3 unpackRGB9E5(in uint bits)
+{
+   uvec3 mantissa = (uvec3(bits) >> uvec3(0u, 9u, 18u)) & 0x1FFu;
+   return vec3(mantissa) * exp2( float(int(bits >> 27u) - 24) );
+}
+
+uint getRadianceWordNum(in int format)
+{
+   switch (format) {
+      case ACCUMULATION_RGBA32F: return 4u;
+      case ACCUMULATION_RGBA16F: return 2u;
+      default: return 1u;
+   }
+}
+
+uvec4 encodeRadiance(in vec3 radiance, in int format)
+{
+   switch (format) {
+      case ACCUMULATION_RGBA32F: return uvec4(floatBitsToUint( radiance ), 0u);
+      case ACCUMULATION_RGBA16F: return uvec4(packHalf2x16( radiance.xy ), packHalf2x16( vec2(radiance.z, 0.0f) ), 0u, 0u);
+      case ACCUMULATION_R11F_G11F_B10F: return uvec4(packR11G11B10F( radiance ), 0u, 0u, 0u);
+      default: return uvec4(packRGB9E5( radiance ), 0u, 0u, 0u);
+   }
+}
+
+vec3 decodeRadiance(in uvec4 words, in int format)
+{
+   switch (format) {
+      case ACCUMULATION_RGBA32F: return uintBitsToFloat( words.xyz );
+      case ACCUMULATION_RGBA16F: return vec3(unpackHalf2x16( words.x ), unpackHalf2x16( words.y ).x);
+      case ACCUMULATION_R11F_G11F_B10F: return unpackR11G11B10F( words.x );
+      default: return unpackRGB9E5( words.x );
+   }
+}
+
+// octahedral mapping with 16 bits per axis, which keeps the error of a unit direction below 1e-4 radians.
+uint packDirection(in vec3 direction)
+{
+   vec3 d = direction / (abs( direction.x ) + abs( direction.y ) + abs( direction.z ));
+   vec2 uv = d.z >= 0.0f ? d.xy : (1.0f - abs( d.yx )) * vec2(d.x >= 0.0f ? 1.0f : -1.0f, d.y >= 0.0f ? 1.0f : -1.0f);
+   return packSnorm2x16( uv );
+}
+
+vec3 unpackDirection(in uint bits)
+{
+   vec2 uv = unpackSnorm2x16( bits );
+   vec3 d = vec3(uv, 1.0f - abs( uv.x ) - abs( uv.y ));
+   if (d.z < 0.0f) d.xy = (1.0f - abs( d.yx )) * vec2(d.x >= 0.0f ? 1.0f : -1.0f, d.y >= 0.0f ? 1.0f : -1.0f);
+   return normalize( d );
+}
\ No newline at end of file
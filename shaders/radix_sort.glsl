@@ -0,0 +1,23 @@
+#define RADIX_BIT_NUM 8u
+#define RADIX_SIZE 256u
+#define RADIX_BLOCK_SIZE 256u
+
+// the indirect dispatch arguments come first so that the same buffer can be used with glDispatchComputeIndirect.
+layout (binding = 0, std430) buffer SortInfo
+{
+   uvec3 BlockNum;
+   uint ElementNum;
+};
+layout (binding = 1, std430) buffer InKeys { uint InKey[]; };
+layout (binding = 2, std430) buffer InValues { uint InValue[]; };
+layout (binding = 3, std430) buffer OutKeys { uint OutKey[]; };
+layout (binding = 4, std430) buffer OutValues { uint OutValue[]; };
+// the digit counts are stored digit by digit, so that its exclusive scan directly gives the global offsets
+layout (binding = 5, std430) buffer Histograms { uint Histogram[]; };
+
+uniform uint Shift;
+
+uint getDigit(in uint key)
+{
+   return (key >> Shift) & (RADIX_SIZE - 1u);
+}
\ No newline at end of file
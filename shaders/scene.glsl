@@ -0,0 +1,720 @@
+struct MaterialInfo
+{
+   vec3 Albedo;
+   int Type; // 1: Metal, 2: Lambertian
+};
+
+// spheres only refer to their materials, so any number of them can share one.
+struct SphereInfo
+{
+   vec3 Center;
+   float Radius;
+   int MaterialIndex;
+};
+
+struct VertexInfo
+{
+   vec3 Position;
+   vec3 Normal;
+};
+
+// three indices into the vertex buffer, so that the meshes share their vertices between triangles.
+struct TriangleInfo
+{
+   uvec3 Indices;
+   int MaterialIndex;
+};
+
+// a leaf holds Count primitives from Offset on, and an inner node has the children Offset and -Count.
+struct BVHNode
+{
+   vec3 Min;
+   int Offset;
+   vec3 Max;
+   int Count;
+};
+
+// a 4-wide node of 64 bytes. the child boxes are quantized to a byte per plane within the node, where the scale of
+// each axis is a power of two whose biased exponent is a byte of Exponents, and the byte of a child in a plane word
+// is its index. a child is an inner node at Child, or a leaf of Count primitives from Child on, by its byte of Counts.
+struct WideBVHNode
+{
+   vec3 Origin;
+   uint Exponents;
+   uint Planes[6]; // min x, min y, min z, max x, max y, max z
+   int Child[4];
+   uint Counts;
+   uint Padding;
+};
+
+// a uniform grid over the box of a geometry. the primitives which overlap a cell are listed in GridCell
+// from the start of the cell to the start of the next one, where the cells of the grid begin at CellOffset.
+// the grids are stored as GRID_INFO_SIZE words each at the front of GridCell, ahead of the cells.
+#define GRID_INFO_SIZE 12
+struct GridInfo
+{
+   vec3 Min;
+   int CellOffset;
+   vec3 CellSize;
+   ivec3 Resolution;
+};
+
+// an instance places a geometry in the world. its bottom-level BVH starts at the Root node,
+// or at the WideRoot node of the wide BVH when the geometry has one. a geometry in a grid has none of them.
+struct InstanceInfo
+{
+   vec4 WorldToObject[3]; // the rows of the affine transform
+   int Root;
+   int MaterialIndex; // replaces the materials of the geometry unless it is negative
+   int WideRoot;
+   int Grid; // the bottom level is the grid of this index unless it is negative
+};
+
+layout (binding = 8, std430) readonly buffer Spheres { SphereInfo Sphere[]; };
+layout (binding = 9, std430) readonly buffer Materials { MaterialInfo Material[]; };
+// the refit defines this as coherent, since it writes the nodes which the other invocations read,
+// and the builder on the GPU writes both the nodes and the primitives.
+#ifndef NODE_ACCESS
+#define NODE_ACCESS readonly
+#endif
+#ifndef PRIMITIVE_ACCESS
+#define PRIMITIVE_ACCESS readonly
+#endif
+#ifndef GRID_CELL_ACCESS
+#define GRID_CELL_ACCESS readonly
+#endif
+layout (binding = 10, std430) NODE_ACCESS buffer BVHNodes { BVHNode Node[]; };
+layout (binding = 11, std430) PRIMITIVE_ACCESS buffer Primitives { uint Primitive[]; };
+layout (binding = 12, std430) readonly buffer Vertices { VertexInfo Vertex[]; };
+layout (binding = 13, std430) readonly buffer Triangles { TriangleInfo Triangle[]; };
+layout (binding = 14, std430) readonly buffer Instances { InstanceInfo Instance[]; };
+layout (binding = 15, std430) readonly buffer WideBVHNodes { WideBVHNode WideNode[]; };
+layout (binding = 17, std430) GRID_CELL_ACCESS buffer GridCells { uint GridCell[]; };
+// the instance of a chunk which is not resident has no root, and the rays take it as empty. a shader which defines
+// RESIDENCY_FEEDBACK marks the instances whose boxes its rays reach, requests the missing chunks, and sets ChunkMissed.
+// the box of a missing chunk is the node at its WideRoot. the feedback of an instance keeps the highest value,
+// and the values match those of ResidencyGL.
+#ifdef RESIDENCY_FEEDBACK
+layout (binding = 18, std430) buffer Residency { uint Feedback[]; };
+uniform int UseResidency;
+#define FEEDBACK_BOUNCE_USED 1u
+#define FEEDBACK_PRIMARY_USED 2u
+#define FEEDBACK_BOUNCE_MISSED 3u
+#define FEEDBACK_PRIMARY_MISSED 4u
+bool PrimaryRay = false;
+bool ChunkMissed = false;
+#endif
+// a proxy stands in for the subtree of a node of a bottom level: a sphere bounding its primitives, their albedo
+// weighted by their areas, and the chance that a ray through the sphere hits any of them. the binary nodes
+// have the proxies of their indices, and the wide nodes have theirs from WideProxyOffset on.
+#ifdef LEVEL_OF_DETAIL
+#ifndef PROXY_ACCESS
+#define PROXY_ACCESS readonly
+#endif
+struct ProxyInfo
+{
+   vec3 Center;
+   float Radius;
+   vec3 Albedo;
+   float Coverage;
+};
+
+layout (binding = 19, std430) PROXY_ACCESS buffer Proxies { ProxyInfo Proxy[]; };
+uniform float LevelOfDetailBias; // a proxy replaces its subtree when it is no larger than the footprint times this, 0 never
+uniform int WideProxyOffset;
+// the footprint of a ray is a cone of RayConeWidth at its origin, which widens by RayConeSpread per unit of distance.
+// ProxyFootprint is the same cone in the object space of the instance which the ray is in, over the ray parameter.
+bool UseProxies = false;
+float RayConeWidth = 0.0f;
+float RayConeSpread = 0.0f;
+uint ProxySeed = 0u;
+vec2 ProxyFootprint = vec2(0.0f);
+#endif
+
+uniform int SphereNum;
+
+// a primitive is a triangle index, or a sphere index with this bit set.
+#define SPHERE_PRIMITIVE 0x80000000u
+// each level of the BVH is built no deeper than 32, and every level of a BVH pushes at most one node.
+#define BVH_STACK_SIZE 64
+// a wide node takes two levels of the binary BVH and pushes at most three of its four children.
+#define WIDE_BVH_CHILD_NUM 4
+#define WIDE_BVH_STACK_SIZE 48
+#define WIDE_BVH_INNER_CHILD 0xFFu
+
+const float zero = 0.0f;
+const float one = 1.0f;
+
+// the camera sits at the origin looking down -z, and the image plane spans [-1, 1] vertically at z = -1.
+vec3 getPrimaryRayDirection(in vec2 pixel, in ivec2 image_size)
+{
+   float u = (2.0f * pixel.x - float(image_size.x)) / float(image_size.y);
+   float v = (2.0f * pixel.y - float(image_size.y)) / float(image_size.y);
+   return vec3(u, v, -one);
+}
+
+bool hitSphere(
+   inout float t,
+   inout int material,
+   inout vec3 position,
+   inout vec3 normal,
+   in vec3 ray_origin,
+   in vec3 ray_direction,
+   in float t_min,
+   in float t_max,
+   in SphereInfo sphere
+)
+{
+   const float epsilon = 1e-4f;
+   vec3 oc = ray_origin - sphere.Center;
+   float a = dot( ray_direction, ray_direction );
+   float b = dot( oc, ray_direction );
+   float c = dot( oc, oc ) - sphere.Radius * sphere.Radius;
+   float discriminant = b * b - a * c;
+
+   float t1 = t_max, t2 = t_max;
+   if (abs( a ) < epsilon) {
+      if (abs( b ) >= epsilon) {
+         t1 = -0.5f * c / b;
+      }
+   }
+   else if (abs( discriminant ) < epsilon) {
+      t1 = -b / a;
+   }
+   else if (discriminant > zero) {
+      discriminant = sqrt( discriminant );
+      float n = b >= zero ? -(discriminant + b) : (discriminant - b);
+      t1 = c / n;
+      t2 = n / a;
+   }
+
+   if (t_min < t1 && t1 < t_max) {
+      t = t1;
+      material = sphere.MaterialIndex;
+      position = ray_origin + t * ray_direction;
+      normal = (position - sphere.Center) / sphere.Radius;
+      return true;
+   }
+   else if (t_min < t2 && t2 < t_max) {
+      t = t2;
+      material = sphere.MaterialIndex;
+      position = ray_origin + t * ray_direction;
+      normal = (position - sphere.Center) / sphere.Radius;
+      return true;
+   }
+   return false;
+}
+
+bool hitSphere(
+   inout float t,
+   inout int material,
+   inout vec3 position,
+   inout vec3 normal,
+   in vec3 ray_origin,
+   in vec3 ray_direction,
+   in float t_min,
+   in float t_max,
+   in int index
+)
+{
+   return hitSphere( t, material, position, normal, ray_origin, ray_direction, t_min, t_max, Sphere[index] );
+}
+
+// the watertight test of Woop, Benthin and Wald. the ray is sheared so that it points down the z axis, and the edge
+// functions are evaluated in 2D where the ray is the origin. an edge shared by two triangles gives the same value
+// to both of them, so a ray through the edge hits one of them instead of slipping through the crack between them.
+bool hitTriangle(
+   inout float t,
+   inout int material,
+   inout vec3 position,
+   inout vec3 normal,
+   in vec3 ray_origin,
+   in vec3 ray_direction,
+   in float t_min,
+   in float t_max,
+   in int index
+)
+{
+   TriangleInfo triangle = Triangle[index];
+   VertexInfo v0 = Vertex[triangle.Indices.x];
+   VertexInfo v1 = Vertex[triangle.Indices.y];
+   VertexInfo v2 = Vertex[triangle.Indices.z];
+
+   vec3 d = abs( ray_direction );
+   int kz = d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+   int kx = kz == 2 ? 0 : kz + 1;
+   int ky = kx == 2 ? 0 : kx + 1;
+   if (ray_direction[kz] < zero) {
+      int k = kx;
+      kx = ky;
+      ky = k;
+   }
+   float sx = ray_direction[kx] / ray_direction[kz];
+   float sy = ray_direction[ky] / ray_direction[kz];
+   float sz = one / ray_direction[kz];
+
+   vec3 a = v0.Position - ray_origin;
+   vec3 b = v1.Position - ray_origin;
+   vec3 c = v2.Position - ray_origin;
+   float ax = a[kx] - sx * a[kz];
+   float ay = a[ky] - sy * a[kz];
+   float bx = b[kx] - sx * b[kz];
+   float by = b[ky] - sy * b[kz];
+   float cx = c[kx] - sx * c[kz];
+   float cy = c[ky] - sy * c[kz];
+   float u = cx * by - cy * bx;
+   float v = ax * cy - ay * cx;
+   float w = bx * ay - by * ax;
+   if (u == zero || v == zero || w == zero) {
+      // the ray passes through an edge or a vertex within the rounding error, which only double precision can settle.
+      u = float(double(cx) * double(by) - double(cy) * double(bx));
+      v = float(double(ax) * double(cy) - double(ay) * double(cx));
+      w = float(double(bx) * double(ay) - double(by) * double(ax));
+   }
+   if ((u < zero || v < zero || w < zero) && (u > zero || v > zero || w > zero)) return false;
+
+   float determinant = u + v + w;
+   if (determinant == zero) return false;
+
+   float scaled_t = u * sz * a[kz] + v * sz * b[kz] + w * sz * c[kz];
+   float hit_t = scaled_t / determinant;
+   if (hit_t <= t_min || t_max <= hit_t) return false;
+
+   t = hit_t;
+   material = triangle.MaterialIndex;
+   position = ray_origin + t * ray_direction;
+   normal = normalize( (u * v0.Normal + v * v1.Normal + w * v2.Normal) / determinant );
+   // both sides of a triangle can be hit, so the normal is turned to the side of the face which the ray comes from.
+   vec3 face_normal = cross( v1.Position - v0.Position, v2.Position - v0.Position );
+   if (dot( face_normal, ray_direction ) > zero) face_normal = -face_normal;
+   if (dot( normal, face_normal ) < zero) normal = -normal;
+   return true;
+}
+
+bool hitPrimitive(
+   inout float t,
+   inout int material,
+   inout vec3 position,
+   inout vec3 normal,
+   in vec3 ray_origin,
+   in vec3 ray_direction,
+   in float t_min,
+   in float t_max,
+   in uint primitive
+)
+{
+   if ((primitive & SPHERE_PRIMITIVE) != 0u) {
+      return hitSphere( t, material, position, normal, ray_origin, ray_direction, t_min, t_max, int(primitive & ~SPHERE_PRIMITIVE) );
+   }
+   return hitTriangle( t, material, position, normal, ray_origin, ray_direction, t_min, t_max, int(primitive) );
+}
+
+bool hitBox(out float distance, in vec3 ray_origin, in vec3 inverse_direction, in float t_min, in float t_max, in int index)
+{
+   vec3 t0 = (Node[index].Min - ray_origin) * inverse_direction;
+   vec3 t1 = (Node[index].Max - ray_origin) * inverse_direction;
+   vec3 near = min( t0, t1 );
+   vec3 far = max( t0, t1 );
+   distance = max( max( near.x, near.y ), max( near.z, t_min ) );
+   return distance <= min( min( far.x, far.y ), min( far.z, t_max ) );
+}
+
+vec3 transformPoint(in int instance, in vec3 point)
+{
+   vec4 p = vec4(point, one);
+   return vec3(dot( Instance[instance].WorldToObject[0], p ), dot( Instance[instance].WorldToObject[1], p ), dot( Instance[instance].WorldToObject[2], p ));
+}
+
+vec3 transformDirection(in int instance, in vec3 direction)
+{
+   return vec3(
+      dot( Instance[instance].WorldToObject[0].xyz, direction ),
+      dot( Instance[instance].WorldToObject[1].xyz, direction ),
+      dot( Instance[instance].WorldToObject[2].xyz, direction )
+   );
+}
+
+// a normal goes back to the world with the inverse transpose of the object-to-world transform,
+// which is the transpose of the world-to-object transform.
+vec3 transformNormalToWorld(in int instance, in vec3 normal)
+{
+   return normalize(
+      normal.x * Instance[instance].WorldToObject[0].xyz +
+      normal.y * Instance[instance].WorldToObject[1].xyz +
+      normal.z * Instance[instance].WorldToObject[2].xyz
+   );
+}
+
+// in a packet, the lanes of a subgroup take every decision together, so that their traversals stay the same.
+bool isTakenByAny(in bool condition, in bool packet)
+{
+#ifdef USE_SUBGROUP
+   if (packet) return subgroupAny( condition );
+#endif
+   return condition;
+}
+
+bool isTakenByMost(in bool condition, in bool packet)
+{
+#ifdef USE_SUBGROUP
+   if (packet) return subgroupBallotBitCount( subgroupBallot( condition ) ) * 2u > subgroupBallotBitCount( subgroupBallot( true ) );
+#endif
+   return condition;
+}
+
+#ifdef LEVEL_OF_DETAIL
+float getProxyRandomFloat(in int proxy_index)
+{
+   uint hash = ProxySeed ^ (uint(proxy_index) * 0x9E3779B9u);
+   hash = (hash ^ (hash >> 16u)) * 0x7FEB352Du;
+   hash = (hash ^ (hash >> 15u)) * 0x846CA68Bu;
+   hash = hash ^ (hash >> 16u);
+   return float(hash) / 4294967296.0f;
+}
+
+// returns true if the subtree of the node is skipped. a ray which misses the bounding sphere misses the whole subtree.
+// a ray from outside a proxy no larger than its footprint hits the sphere with the chance of its coverage, and passes
+// through the subtree otherwise, so the clusters of tiny primitives look right on average. the material of a proxy
+// hit is the negative index of the proxy from -1 down.
+bool replaceByProxy(
+   inout bool hit_proxy,
+   inout float closest_so_far,
+   inout int material,
+   inout vec3 normal,
+   in vec3 ray_origin,
+   in vec3 ray_direction,
+   in float t_min,
+   in int proxy_index
+)
+{
+   if (!UseProxies || LevelOfDetailBias <= zero) return false;
+
+   ProxyInfo proxy = Proxy[proxy_index];
+   if (proxy.Coverage <= zero) return false;
+
+   vec3 oc = ray_origin - proxy.Center;
+   float a = dot( ray_direction, ray_direction );
+   float b = dot( oc, ray_direction );
+   float c = dot( oc, oc ) - proxy.Radius * proxy.Radius;
+   float discriminant = b * b - a * c;
+   if (discriminant < zero) return true;
+
+   discriminant = sqrt( discriminant );
+   float t_near = (-b - discriminant) / a;
+   float t_far = (-b + discriminant) / a;
+   if (t_far <= t_min || t_near >= closest_so_far) return true;
+   if (t_near <= t_min || 2.0f * proxy.Radius > LevelOfDetailBias * (ProxyFootprint.x + ProxyFootprint.y * t_near)) return false;
+   if (getProxyRandomFloat( proxy_index ) >= proxy.Coverage) return true;
+
+   hit_proxy = true;
+   closest_so_far = t_near;
+   material = -1 - proxy_index;
+   normal = (ray_origin + t_near * ray_direction - proxy.Center) / proxy.Radius;
+   return true;
+}
+#endif
+
+vec4 getChildPlanes(in uint plane, in float origin, in float scale)
+{
+   return origin + vec4(uvec4(plane, plane >> 8u, plane >> 16u, plane >> 24u) & 0xFFu) * scale;
+}
+
+// the four children of a node are tested at once, a vector lane each. the leaves are intersected right away,
+// and the nearest inner child is visited next while the others wait on the stack, so the nodes are tested
+// against the closest hit so far when they are popped.
+bool hitWideBVH(
+   inout float closest_so_far,
+   inout int material,
+   inout vec3 position,
+   inout vec3 normal,
+   in vec3 ray_origin,
+   in vec3 ray_direction,
+   in vec3 inverse_direction,
+   in float t_min,
+   in int root,
+   in bool packet
+)
+{
+   float t;
+   bool hit_anything = false;
+   int stack[WIDE_BVH_STACK_SIZE];
+   int top = 0;
+   int index = root;
+   while (true) {
+#ifdef LEVEL_OF_DETAIL
+      bool hit_proxy = false;
+      if (replaceByProxy( hit_proxy, closest_so_far, material, normal, ray_origin, ray_direction, t_min, WideProxyOffset + index )) {
+         hit_anything = hit_anything || hit_proxy;
+         if (top == 0) break;
+         index = stack[--top];
+         continue;
+      }
+#endif
+      WideBVHNode node = WideNode[index];
+      vec3 scale = uintBitsToFloat( (uvec3(node.Exponents, node.Exponents >> 8u, node.Exponents >> 16u) & 0xFFu) << 23u );
+      vec4 t0x = (getChildPlanes( node.Planes[0], node.Origin.x, scale.x ) - ray_origin.x) * inverse_direction.x;
+      vec4 t0y = (getChildPlanes( node.Planes[1], node.Origin.y, scale.y ) - ray_origin.y) * inverse_direction.y;
+      vec4 t0z = (getChildPlanes( node.Planes[2], node.Origin.z, scale.z ) - ray_origin.z) * inverse_direction.z;
+      vec4 t1x = (getChildPlanes( node.Planes[3], node.Origin.x, scale.x ) - ray_origin.x) * inverse_direction.x;
+      vec4 t1y = (getChildPlanes( node.Planes[4], node.Origin.y, scale.y ) - ray_origin.y) * inverse_direction.y;
+      vec4 t1z = (getChildPlanes( node.Planes[5], node.Origin.z, scale.z ) - ray_origin.z) * inverse_direction.z;
+      vec4 near = max( max( min( t0x, t1x ), min( t0y, t1y ) ), max( min( t0z, t1z ), vec4(t_min) ) );
+      vec4 far = min( min( max( t0x, t1x ), max( t0y, t1y ) ), min( max( t0z, t1z ), vec4(closest_so_far) ) );
+      bvec4 hit_child = lessThanEqual( near, far );
+
+      int inner_num = 0;
+      int inner_children[WIDE_BVH_CHILD_NUM];
+      float inner_distances[WIDE_BVH_CHILD_NUM];
+      for (int i = 0; i < WIDE_BVH_CHILD_NUM; ++i) {
+         uint count = (node.Counts >> (8u * uint(i))) & 0xFFu;
+         if (count == 0u || !isTakenByAny( hit_child[i], packet )) continue;
+
+         if (count == WIDE_BVH_INNER_CHILD) {
+            // the lanes of a packet keep the order of the slots, since they would not agree on the distances.
+            int k = inner_num++;
+            for (; !packet && k > 0 && inner_distances[k - 1] < near[i]; --k) {
+               inner_children[k] = inner_children[k - 1];
+               inner_distances[k] = inner_distances[k - 1];
+            }
+            inner_children[k] = node.Child[i];
+            inner_distances[k] = near[i];
+         }
+         else {
+            for (int p = node.Child[i]; p < node.Child[i] + int(count); ++p) {
+               if (hitPrimitive( t, material, position, normal, ray_origin, ray_direction, t_min, closest_so_far, Primitive[p] )) {
+                  hit_anything = true;
+                  closest_so_far = t;
+               }
+            }
+         }
+      }
+
+      if (inner_num > 0) {
+         for (int i = 0; i < inner_num - 1; ++i) stack[top++] = inner_children[i];
+         index = inner_children[inner_num - 1];
+         continue;
+      }
+      if (top == 0) break;
+      index = stack[--top];
+   }
+   return hit_anything;
+}
+
+GridInfo getGrid(in int grid_index)
+{
+   int i = grid_index * GRID_INFO_SIZE;
+   GridInfo grid;
+   grid.Min = uintBitsToFloat( uvec3(GridCell[i], GridCell[i + 1], GridCell[i + 2]) );
+   grid.CellOffset = int(GridCell[i + 3]);
+   grid.CellSize = uintBitsToFloat( uvec3(GridCell[i + 4], GridCell[i + 5], GridCell[i + 6]) );
+   grid.Resolution = ivec3(GridCell[i + 8], GridCell[i + 9], GridCell[i + 10]);
+   return grid;
+}
+
+int getCell(in GridInfo grid, in ivec3 cell)
+{
+   return grid.CellOffset + (cell.z * grid.Resolution.y + cell.y) * grid.Resolution.x + cell.x;
+}
+
+// the cells along the ray are visited in order by the 3D-DDA of Amanatides and Woo. a primitive is listed in every cell
+// which its box overlaps, so a hit found in a cell may lie in a later one, and the walk stops at the cell which
+// holds the closest hit so far.
+bool hitGrid(
+   inout float closest_so_far,
+   inout int material,
+   inout vec3 position,
+   inout vec3 normal,
+   in vec3 ray_origin,
+   in vec3 ray_direction,
+   in vec3 inverse_direction,
+   in float t_min,
+   in int grid_index
+)
+{
+   GridInfo grid = getGrid( grid_index );
+   vec3 t0 = (grid.Min - ray_origin) * inverse_direction;
+   vec3 t1 = (grid.Min + vec3(grid.Resolution) * grid.CellSize - ray_origin) * inverse_direction;
+   float t_enter = max( max( min( t0.x, t1.x ), min( t0.y, t1.y ) ), max( min( t0.z, t1.z ), t_min ) );
+   float t_exit = min( min( max( t0.x, t1.x ), max( t0.y, t1.y ) ), min( max( t0.z, t1.z ), closest_so_far ) );
+   if (t_enter > t_exit) return false;
+
+   vec3 entry = ray_origin + t_enter * ray_direction;
+   ivec3 cell = clamp( ivec3(floor( (entry - grid.Min) / grid.CellSize )), ivec3(0), grid.Resolution - 1 );
+   ivec3 step = ivec3(greaterThanEqual( inverse_direction, vec3(zero) )) * 2 - 1;
+   vec3 boundary = grid.Min + vec3(cell + max( step, ivec3(0) )) * grid.CellSize;
+   vec3 t_next = (boundary - ray_origin) * inverse_direction;
+   vec3 t_delta = abs( grid.CellSize * inverse_direction );
+   // the ray never crosses the planes which it runs parallel to.
+   t_next = mix( t_next, vec3(1e+30f), equal( ray_direction, vec3(zero) ) );
+
+   float t;
+   bool hit_anything = false;
+   while (true) {
+      int index = getCell( grid, cell );
+      for (uint i = GridCell[index]; i < GridCell[index + 1]; ++i) {
+         if (hitPrimitive( t, material, position, normal, ray_origin, ray_direction, t_min, closest_so_far, GridCell[i] )) {
+            hit_anything = true;
+            closest_so_far = t;
+         }
+      }
+
+      int axis = t_next.x < t_next.y ? (t_next.x < t_next.z ? 0 : 2) : (t_next.y < t_next.z ? 1 : 2);
+      if (t_next[axis] >= min( t_exit, closest_so_far )) break;
+
+      cell[axis] += step[axis];
+      if (cell[axis] < 0 || cell[axis] >= grid.Resolution[axis]) break;
+      t_next[axis] += t_delta[axis];
+   }
+   return hit_anything;
+}
+
+// the top-level BVH holds the instances, and each of them leads to the bottom-level BVH of its geometry, which is
+// traversed with the ray in its object space. both levels share the stack, and the ray returns to the world when
+// the stack is back where it was on entering the instance. the nearer child is visited first while the farther one
+// waits on the stack, and its children are tested against the closest hit so far when it is popped.
+// a bottom level with a wide BVH or a grid is traversed at once by hitWideBVH or hitGrid when its instance is entered.
+bool traverse(
+   inout int material,
+   inout vec3 position,
+   inout vec3 normal,
+   in vec3 ray_origin,
+   in vec3 ray_direction,
+   in float t_min,
+   in float t_max,
+   in bool packet
+)
+{
+   float t;
+   bool hit_anything = false;
+   float closest_so_far = t_max;
+   int hit_instance = 0;
+   vec3 origin = ray_origin;
+   vec3 direction = ray_direction;
+   vec3 inverse_direction = one / direction;
+   int stack[BVH_STACK_SIZE];
+   int top = 0;
+   int index = 0;
+   int instance = -1, instance_end = 0, instance_top = 0;
+   bool entering = false;
+   while (true) {
+      BVHNode node = Node[index];
+#ifdef LEVEL_OF_DETAIL
+      // a skipped subtree is taken as an empty leaf.
+      bool hit_proxy = false;
+      if (instance >= 0 && replaceByProxy( hit_proxy, closest_so_far, material, normal, origin, direction, t_min, index )) {
+         node.Count = 0;
+         if (hit_proxy) {
+            hit_anything = true;
+            hit_instance = instance;
+         }
+      }
+#endif
+      if (node.Count < 0) {
+         int near_child = node.Offset, far_child = -node.Count;
+         float near_distance, far_distance;
+         bool hit_near = hitBox( near_distance, origin, inverse_direction, t_min, closest_so_far, near_child );
+         bool hit_far = hitBox( far_distance, origin, inverse_direction, t_min, closest_so_far, far_child );
+         bool any_near = isTakenByAny( hit_near, packet );
+         bool any_far = isTakenByAny( hit_far, packet );
+         if (any_near && any_far) {
+            if (isTakenByMost( hit_far && (!hit_near || far_distance < near_distance), packet )) {
+               int k = near_child;
+               near_child = far_child;
+               far_child = k;
+            }
+            stack[top++] = far_child;
+            index = near_child;
+            continue;
+         }
+         if (any_near || any_far) {
+            index = any_near ? near_child : far_child;
+            continue;
+         }
+      }
+      else if (instance < 0) {
+         if (node.Count > 0) {
+            instance = node.Offset;
+            instance_end = node.Offset + node.Count;
+            instance_top = top;
+            entering = true;
+         }
+      }
+      else {
+         for (int i = node.Offset; i < node.Offset + node.Count; ++i) {
+            if (hitPrimitive( t, material, position, normal, origin, direction, t_min, closest_so_far, Primitive[i] )) {
+               hit_anything = true;
+               closest_so_far = t;
+               hit_instance = instance;
+            }
+         }
+      }
+
+      if (instance >= 0 && top == instance_top) {
+         // the ray enters the instances of the leaf one after another, and goes back to the world after the last one.
+         if (!entering) instance++;
+         entering = false;
+         for (; instance < instance_end; ++instance) {
+            origin = transformPoint( instance, ray_origin );
+            direction = transformDirection( instance, ray_direction );
+            inverse_direction = one / direction;
+#ifdef LEVEL_OF_DETAIL
+            ProxyFootprint = vec2(RayConeWidth * length( direction ) / length( ray_direction ), RayConeSpread * length( direction ));
+#endif
+            int grid = Instance[instance].Grid;
+            int wide_root = Instance[instance].WideRoot;
+            bool resident = grid >= 0 || Instance[instance].Root >= 0;
+#ifdef RESIDENCY_FEEDBACK
+            float distance;
+            if (UseResidency != 0 && grid < 0 &&
+                hitBox( distance, origin, inverse_direction, t_min, closest_so_far, resident ? Instance[instance].Root : wide_root )) {
+               uint feedback = resident ?
+                  (PrimaryRay ? FEEDBACK_PRIMARY_USED : FEEDBACK_BOUNCE_USED) :
+                  (PrimaryRay ? FEEDBACK_PRIMARY_MISSED : FEEDBACK_BOUNCE_MISSED);
+               if (Feedback[instance] < feedback) atomicMax( Feedback[instance], feedback );
+               ChunkMissed = ChunkMissed || !resident;
+            }
+#endif
+            if (!resident) continue;
+            if (grid < 0 && wide_root < 0) break;
+
+            bool hit_bottom_level = grid >= 0 ?
+               hitGrid( closest_so_far, material, position, normal, origin, direction, inverse_direction, t_min, grid ) :
+               hitWideBVH( closest_so_far, material, position, normal, origin, direction, inverse_direction, t_min, wide_root, packet );
+            if (hit_bottom_level) {
+               hit_anything = true;
+               hit_instance = instance;
+            }
+         }
+         if (instance < instance_end) {
+            index = Instance[instance].Root;
+            continue;
+         }
+         instance = -1;
+         origin = ray_origin;
+         direction = ray_direction;
+         inverse_direction = one / direction;
+      }
+      if (top == 0) break;
+      index = stack[--top];
+   }
+
+   if (hit_anything) {
+      position = ray_origin + closest_so_far * ray_direction;
+      normal = transformNormalToWorld( hit_instance, normal );
+      if (Instance[hit_instance].MaterialIndex >= 0) material = Instance[hit_instance].MaterialIndex;
+   }
+   return hit_anything;
+}
+
+bool hit(
+   inout int material,
+   inout vec3 position,
+   inout vec3 normal,
+   in vec3 ray_origin,
+   in vec3 ray_direction,
+   in float t_min,
+   in float t_max
+)
+{
+   return traverse( material, position, normal, ray_origin, ray_direction, t_min, t_max, false );
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+float getRandomFloat(inout uint seed)
+{
+   seed = (seed ^ 61u) ^ (seed >> 16u);
+   seed *= 9u;
+   seed = seed ^ (seed >> 4u);
+   seed *= 0x27d4eb2du;
+   seed = seed ^ (seed >> 15u);
+   return float(seed) / 4294967296.0f;
+}
+
+vec3 getRandomPointInUnitSphere(inout uint seed)
+{
+   const float two_pi = 6.28318530718f;
+   vec3 point = vec3(getRandomFloat( seed ), getRandomFloat( seed ), getRandomFloat( seed ));
+   point = point * vec3(2.0f, two_pi, one) - vec3(one, zero, zero); // x: [-1, 1], y: [0, 2pi], z: [0, 1]
+   float phi = point.y;
+   float r = pow( point.z, one / 3.0f );
+   return r * vec3(sqrt( one - point.x * point.x ) * vec2(sin( phi ), cos( phi )), point.x);
+}
+
+bool scatter(
+   inout vec3 ray_origin,
+   inout vec3 ray_direction,
+   inout uint seed,
+   in int type,
+   in vec3 position,
+   in vec3 normal
+)
+{
+   if (type == 1) {
+      vec3 reflected = reflect( normalize( ray_direction ), normal );
+      ray_origin = position;
+      ray_direction = reflected + 0.02f * getRandomPointInUnitSphere( seed );
+      return dot( ray_direction, normal ) > zero;
+   }
+   else {
+      ray_origin = position;
+      ray_direction = normal + getRandomPointInUnitSphere( seed );
+      return true;
+   }
+}
+
+vec3 getBackgroundColor(in vec3 ray_direction)
+{
+   vec3 direction = normalize( ray_direction );
+   float t = 0.5f * direction.y + 0.5f;
+   return mix( vec3(one), vec3(0.5f, 0.7f, one), t );
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#version 460
+
+#include "scene.glsl"
+
+uniform mat4 ProjectionMatrix;
+uniform ivec2 FrameSize;
+
+flat in vec4 sphere;
+flat in int sphere_material;
+
+// the visible cap of a sphere always lies in front of its impostor quad.
+layout (depth_less) out float gl_FragDepth;
+
+layout (location = 0) out vec4 position_output;
+layout (location = 1) out vec4 normal_output;
+layout (location = 2) out vec4 material_output; // index into the material table
+
+void main()
+{
+   float t;
+   int material;
+   vec3 position, normal;
+   vec3 ray_direction = getPrimaryRayDirection( gl_FragCoord.xy, FrameSize );
+   SphereInfo world_sphere = SphereInfo(sphere.xyz, sphere.w, sphere_material);
+   if (!hitSphere( t, material, position, normal, vec3(zero), ray_direction, 1e-3f, 1E+7f, world_sphere )) {
+      discard;
+   }
+
+   vec4 clip_position = ProjectionMatrix * vec4(position, one);
+   gl_FragDepth = 0.5f * clip_position.z / clip_position.w + 0.5f;
+
+   position_output = vec4(position, one);
+   normal_output = vec4(normal, zero);
+   material_output = vec4(float(material), zero, zero, zero);
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#version 460
+
+#include "scene.glsl"
+
+uniform mat4 ProjectionMatrix;
+uniform mat4 WorldMatrix;
+uniform int SphereOffset;
+uniform int MaterialIndex;
+
+layout (location = 0) in vec3 v_position;
+
+flat out vec4 sphere; // the center and the radius in the world
+flat out int sphere_material;
+
+void main()
+{
+   // the spheres of a geometry are drawn once per instance, which is assumed to scale them uniformly.
+   SphereInfo object_sphere = Sphere[SphereOffset + gl_InstanceID];
+   vec3 center = vec3(WorldMatrix * vec4(object_sphere.Center, one));
+   float radius = object_sphere.Radius * length( WorldMatrix[0].xyz );
+   sphere = vec4(center, radius);
+   sphere_material = MaterialIndex >= 0 ? MaterialIndex : object_sphere.MaterialIndex;
+   float distance_to_center = length( center );
+   if (distance_to_center <= radius) {
+      // the camera is inside the sphere, so every pixel can see it. the quad is pushed to the far plane
+      // so that the ray-casted depth is never behind it.
+      gl_Position = vec4(v_position.xy, one, one);
+      return;
+   }
+
+   // a quad through the center, perpendicular to the view direction, covers the whole silhouette
+   // when its half size matches the radius of the tangent cone at that distance.
+   vec3 w = center / distance_to_center;
+   vec3 up = abs( w.y ) < 0.99f ? vec3(zero, one, zero) : vec3(one, zero, zero);
+   vec3 u = normalize( cross( up, w ) );
+   vec3 v = cross( w, u );
+   float half_size = distance_to_center * radius / sqrt( distance_to_center * distance_to_center - radius * radius );
+   vec3 corner = center + half_size * (v_position.x * u + v_position.y * v);
+   gl_Position = ProjectionMatrix * vec4(corner, one);
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#include "packing.glsl"
+
+#define WAVEFRONT_GROUP_SIZE 256u
+#define MAX_DEPTH 50
+
+// the direction and the throughput are packed, which shrinks a ray from 48 to 32 bytes.
+struct Ray
+{
+   vec3 Origin;
+   uint Pixel;
+   uint Direction; // octahedral, 16 bits per axis
+   uint Seed;
+   uvec2 Throughput; // half floats
+};
+
+// the closest hit of a ray, kept between the intersection and the shading when they run as separate passes.
+struct Hit
+{
+   vec3 Position;
+   int Material; // -1 if the ray hits nothing
+   vec3 Normal;
+   float Padding;
+};
+
+// the indirect dispatch arguments come first so that the same buffer can be used with glDispatchComputeIndirect.
+layout (binding = 0, std430) buffer WavefrontState
+{
+   uvec3 ExtendGroupNum;
+   uint RayNum;
+   uint NextRayNum;
+};
+layout (binding = 1, std430) buffer CurrentRayQueue { Ray CurrentRays[]; };
+layout (binding = 2, std430) buffer NextRayQueue { Ray NextRays[]; };
+
+// the accumulation holds the running mean rather than the sum, so it stays in the range of a single sample
+// and the later samples are not rounded away in the low precision formats.
+layout (binding = 3, std430) buffer Accumulations { uint Accumulation[]; };
+
+uniform int SampleIndex;
+uniform int AccumulationFormat;
+
+Ray getRay(in vec3 origin, in uint pixel, in vec3 direction, in uint seed)
+{
+   return Ray(origin, pixel, packDirection( direction ), seed, uvec2(packHalf2x16( vec2(1.0f) ), packHalf2x16( vec2(1.0f, 0.0f) )));
+}
+
+vec3 getThroughput(in Ray ray)
+{
+   return vec3(unpackHalf2x16( ray.Throughput.x ), unpackHalf2x16( ray.Throughput.y ).x);
+}
+
+void scaleThroughput(inout Ray ray, in vec3 albedo)
+{
+#ifdef HALF_ARITHMETIC
+   f16vec4 throughput = f16vec4(unpackFloat2x16( ray.Throughput.x ), unpackFloat2x16( ray.Throughput.y ));
+   throughput *= f16vec4(vec4(albedo, 0.0f));
+   ray.Throughput = uvec2(packFloat2x16( throughput.xy ), packFloat2x16( throughput.zw ));
+#else
+   vec3 throughput = getThroughput( ray ) * albedo;
+   ray.Throughput = uvec2(packHalf2x16( throughput.xy ), packHalf2x16( vec2(throughput.z, 0.0f) ));
+#endif
+}
+
+// every pixel has only one path in flight, so its mean is updated without atomics when the path ends.
+// a path which ends without radiance still has to update the mean, because it counts as a sample.
+void accumulateRadiance(in uint pixel, in vec3 radiance)
+{
+   uint word_num = getRadianceWordNum( AccumulationFormat );
+   uvec4 words = uvec4(0u);
+   for (uint i = 0u; i < word_num; ++i) words[i] = Accumulation[pixel * word_num + i];
+   vec3 mean = SampleIndex == 0 ? vec3(0.0f) : decodeRadiance( words, AccumulationFormat );
+   mean += (radiance - mean) / float(SampleIndex + 1);
+   words = encodeRadiance( mean, AccumulationFormat );
+   for (uint i = 0u; i < word_num; ++i) Accumulation[pixel * word_num + i] = words[i];
+}
\ No newline at end of file
@@ -0,0 +1,1186 @@
+#include "acceleration_structure.h"
+#include "residency.h"
+
+AccelerationStructureGL::AccelerationStructureGL() :
+   GeometryChanged( true ), InstancesChanged( true ), NodeFormat( NODE_FORMAT::WIDE ), RefitNum( 0 ), RebuildNum( 0 ),
+   Version( 0 ), MemoryBudget( 0 ), ProxyMaterials( nullptr )
+{
+}
+
+AccelerationStructureGL::~AccelerationStructureGL() = default;
+
+void AccelerationStructureGL::setShaders(const std::string& shader_directory_path)
+{
+   RefitShader = std::make_unique<ShaderGL>();
+   RefitShader->setComputeShader( std::string(shader_directory_path + "/bvh_refit.comp").c_str() );
+   RefitShader->addUniformLocation( "LeafOffset" );
+   RefitShader->addUniformLocation( "LeafNum" );
+
+   CostShader = std::make_unique<ShaderGL>();
+   CostShader->setComputeShader( std::string(shader_directory_path + "/bvh_cost.comp").c_str() );
+   CostShader->addUniformLocation( "NodeOffset" );
+   CostShader->addUniformLocation( "NodeNum" );
+   CostShader->addUniformLocation( "GeometryIndex" );
+
+   LinearBuilder = std::make_unique<LinearBVHGL>();
+   LinearBuilder->setShaders( shader_directory_path );
+
+   GridBuilder = std::make_unique<UniformGridGL>();
+   GridBuilder->setShaders( shader_directory_path );
+
+   LevelOfDetail = std::make_unique<LevelOfDetailGL>();
+   LevelOfDetail->setShaders( shader_directory_path );
+}
+
+bool AccelerationStructureGL::hasOnlyWorldSpheres() const
+{
+   // the sphere buffer of a paged scene is a pool of the resident chunks.
+   return !isPaged() && getTriangles().empty() && InstanceTransforms.size() == 1 && InstanceMaterials[0] < 0 &&
+      InstanceTransforms[0] == glm::mat4(1.0f) && Geometries[InstanceGeometries[0]].SphereNum == static_cast<int>(getSpheres().size());
+}
+
+GLsizeiptr AccelerationStructureGL::getGeometrySize() const
+{
+   // a static scene has no hierarchies on the CPU, so its nodes are counted by the buffers, along with the top level.
+   if (isStatic()) {
+      return static_cast<GLsizeiptr>(
+         sizeof( Sphere ) * MappedSpheres.size() + sizeof( Vertex ) * MappedVertices.size() +
+         sizeof( Triangle ) * MappedTriangles.size()
+      ) + NodeBuffer.getSize() + PrimitiveBuffer.getSize();
+   }
+
+   size_t node_num = 0, primitive_num = 0;
+   for (const auto& geometry : Geometries) {
+      node_num += getNodeNum( geometry );
+      primitive_num += getPrimitiveNum( geometry );
+   }
+   return static_cast<GLsizeiptr>(
+      sizeof( Sphere ) * Spheres.size() + sizeof( Vertex ) * Vertices.size() + sizeof( Triangle ) * Triangles.size() +
+      sizeof( BVHNode ) * node_num + sizeof( uint ) * primitive_num
+   );
+}
+
+GLsizeiptr AccelerationStructureGL::getBottomLevelNodeSize(NODE_FORMAT format) const
+{
+   size_t size = 0;
+   for (const auto& geometry : Geometries) {
+      const bool wide = format == NODE_FORMAT::WIDE && !geometry.WideHierarchy.getNodes().empty();
+      size += wide ?
+         sizeof( WideBVHNode ) * geometry.WideHierarchy.getNodes().size() : sizeof( BVHNode ) * getNodeNum( geometry );
+   }
+   return static_cast<GLsizeiptr>(size);
+}
+
+GLsizeiptr AccelerationStructureGL::getInstanceSize() const
+{
+   return static_cast<GLsizeiptr>(sizeof( Instance ) * InstanceTransforms.size() + sizeof( BVHNode ) * TopLevel.getNodes().size());
+}
+
+int AccelerationStructureGL::addGeometry(
+   const std::vector<Sphere>& spheres,
+   const std::vector<Vertex>& vertices,
+   const std::vector<Triangle>& triangles,
+   BUILDER builder
+)
+{
+   Geometry geometry;
+   geometry.SphereOffset = static_cast<int>(Spheres.size());
+   geometry.SphereNum = static_cast<int>(spheres.size());
+   geometry.TriangleOffset = static_cast<int>(Triangles.size());
+   geometry.TriangleNum = static_cast<int>(triangles.size());
+   geometry.VertexOffset = static_cast<int>(Vertices.size());
+   geometry.VertexNum = static_cast<int>(vertices.size());
+   geometry.PrimitiveOffset = 0;
+   geometry.NodeOffset = 0;
+   geometry.WideNodeOffset = 0;
+   geometry.LeafOffset = 0;
+   geometry.LeafNum = 0;
+   geometry.GridIndex = -1;
+   geometry.Builder = builder;
+   geometry.Moved = false;
+   geometry.Refitted = false;
+   geometry.CostRequested = false;
+   geometry.BuildCost = 0.0f;
+   buildHierarchy( geometry, spheres, vertices, triangles );
+
+   const auto vertex_offset = static_cast<uint>(Vertices.size());
+   Spheres.insert( Spheres.end(), spheres.begin(), spheres.end() );
+   Vertices.insert( Vertices.end(), vertices.begin(), vertices.end() );
+   for (const auto& triangle : triangles) {
+      Triangles.emplace_back(
+         triangle.Indices[0] + vertex_offset,
+         triangle.Indices[1] + vertex_offset,
+         triangle.Indices[2] + vertex_offset,
+         triangle.MaterialIndex
+      );
+   }
+   geometry.Bounds = getGeometryBounds( geometry );
+   Geometries.emplace_back( std::move( geometry ) );
+   GeometryChanged = true;
+   return static_cast<int>(Geometries.size()) - 1;
+}
+
+void AccelerationStructureGL::setBuilder(int geometry_index, BUILDER builder)
+{
+   Geometry& geometry = Geometries[geometry_index];
+   if (geometry.Builder == builder) return;
+
+   geometry.Builder = builder;
+   geometry.Refitted = false;
+   geometry.CostRequested = false;
+   std::vector<Sphere> spheres;
+   std::vector<Vertex> vertices;
+   std::vector<Triangle> triangles;
+   copyPrimitives( spheres, vertices, triangles, geometry );
+   buildHierarchy( geometry, spheres, vertices, triangles );
+   GeometryChanged = true;
+}
+
+void AccelerationStructureGL::buildHierarchy(
+   Geometry& geometry,
+   const std::vector<Sphere>& spheres,
+   const std::vector<Vertex>& vertices,
+   const std::vector<Triangle>& triangles
+)
+{
+   if (geometry.Builder == BUILDER::SAH) geometry.Hierarchy.build( spheres, vertices, triangles );
+   else if (geometry.Builder == BUILDER::LIST) geometry.Hierarchy.buildLeaf( spheres, vertices, triangles );
+   else {
+      geometry.Hierarchy = BVH();
+      geometry.WideHierarchy = WideBVH();
+      return;
+   }
+   geometry.WideHierarchy.convert( geometry.Hierarchy );
+   geometry.BuildCost = geometry.Hierarchy.getCost();
+}
+
+bool AccelerationStructureGL::getBuilder(BUILDER& builder, const std::string& name)
+{
+   const std::map<std::string, BUILDER> builders = {
+      { "sah", BUILDER::SAH }, { "linear", BUILDER::LINEAR }, { "grid", BUILDER::GRID }, { "list", BUILDER::LIST }
+   };
+   const auto it = builders.find( name );
+   if (it == builders.end()) return false;
+
+   builder = it->second;
+   return true;
+}
+
+AccelerationStructureGL::BUILDER AccelerationStructureGL::chooseBuilder(
+   const std::vector<Sphere>& spheres,
+   const std::vector<Vertex>& vertices,
+   const std::vector<Triangle>& triangles
+)
+{
+   std::vector<BoundingBox> boxes;
+   boxes.reserve( spheres.size() + triangles.size() );
+   for (const auto& sphere : spheres) boxes.emplace_back( sphere.Center - sphere.Radius, sphere.Center + sphere.Radius );
+   for (const auto& triangle : triangles) {
+      const glm::vec3& a = vertices[triangle.Indices[0]].Position;
+      const glm::vec3& b = vertices[triangle.Indices[1]].Position;
+      const glm::vec3& c = vertices[triangle.Indices[2]].Position;
+      boxes.emplace_back( glm::min( a, glm::min( b, c ) ), glm::max( a, glm::max( b, c ) ) );
+   }
+   if (boxes.empty()) return BUILDER::SAH;
+
+   BoundingBox bounds;
+   glm::vec3 size_sum(0.0f), size_square_sum(0.0f);
+   for (const auto& box : boxes) {
+      bounds.Min = glm::min( bounds.Min, box.Min );
+      bounds.Max = glm::max( bounds.Max, box.Max );
+      size_sum += box.Max - box.Min;
+      size_square_sum += (box.Max - box.Min) * (box.Max - box.Min);
+   }
+   const auto primitive_num = static_cast<float>(boxes.size());
+   const glm::vec3 extent = glm::max( bounds.Max - bounds.Min, glm::vec3(std::numeric_limits<float>::min()) );
+   const float root_area = BVH::getSurfaceArea( glm::vec3(0.0f), extent );
+
+   // every ray through the bounds tests all the primitives of the list.
+   const float list_cost = BVH::IntersectionCost * primitive_num;
+
+   // a random line through the bounds crosses a cell with the probability of their surface area ratio,
+   // and a box is listed in more cells as it grows against them, so the grid suffers from primitives of varied sizes.
+   // the occupancy counts the cells which hold the center of a primitive.
+   const glm::ivec3 resolution = UniformGridGL::getResolution( bounds, static_cast<int>(boxes.size()) );
+   const glm::vec3 cell_size = extent / glm::vec3(resolution);
+   const int cell_num = resolution.x * resolution.y * resolution.z;
+   float reference_num = 0.0f;
+   int occupied_num = 0;
+   std::vector<bool> occupied(cell_num, false);
+   for (const auto& box : boxes) {
+      const glm::vec3 overlap = glm::min( glm::vec3(1.0f) + (box.Max - box.Min) / cell_size, glm::vec3(resolution) );
+      reference_num += overlap.x * overlap.y * overlap.z;
+      const glm::ivec3 cell = glm::clamp(
+         glm::ivec3((0.5f * (box.Min + box.Max) - bounds.Min) / cell_size), glm::ivec3(0), resolution - 1
+      );
+      const int index = (cell.z * resolution.y + cell.y) * resolution.x + cell.x;
+      if (!occupied[index]) {
+         occupied[index] = true;
+         occupied_num++;
+      }
+   }
+   const float cell_probability = BVH::getSurfaceArea( glm::vec3(0.0f), cell_size ) / root_area;
+   const float grid_cost = cell_probability * (GridStepCost * static_cast<float>(cell_num) + BVH::IntersectionCost * reference_num);
+
+   // the tree follows where the primitives are, so the nodes of a level are taken as cubes sharing the occupied volume,
+   // grown by the typical size of the primitives. each level halves the primitives of a node down to the leaves.
+   const float occupied_volume = static_cast<float>(occupied_num) / static_cast<float>(cell_num) * extent.x * extent.y * extent.z;
+   const glm::vec3 mean_size = size_sum / primitive_num;
+   const glm::vec3 deviation = glm::sqrt( glm::max( size_square_sum / primitive_num - mean_size * mean_size, glm::vec3(0.0f) ) );
+   float tree_cost = 0.0f;
+   for (float k = primitive_num;; k *= 0.5f) {
+      const bool leaf = k <= static_cast<float>(ExpectedLeafSize);
+      const glm::vec3 node_size = glm::min( glm::vec3(std::cbrt( occupied_volume * k / primitive_num )) + mean_size + deviation, extent );
+      const float node_cost = leaf ? BVH::IntersectionCost * k : BVH::TraversalCost;
+      tree_cost += primitive_num / k * node_cost * BVH::getSurfaceArea( glm::vec3(0.0f), node_size ) / root_area;
+      if (leaf) break;
+   }
+
+   if (list_cost <= tree_cost && list_cost <= grid_cost) return BUILDER::LIST;
+   return grid_cost < tree_cost ? BUILDER::GRID : BUILDER::SAH;
+}
+
+void AccelerationStructureGL::setNodeFormat(NODE_FORMAT format)
+{
+   NodeFormat = format;
+   InstancesChanged = true;
+}
+
+int AccelerationStructureGL::addInstance(int geometry_index, const glm::mat4& to_world, int material_index)
+{
+   InstanceGeometries.emplace_back( geometry_index );
+   InstanceMaterials.emplace_back( material_index );
+   InstanceTransforms.emplace_back( to_world );
+   InstancesChanged = true;
+   return static_cast<int>(InstanceTransforms.size()) - 1;
+}
+
+void AccelerationStructureGL::setInstanceTransform(int instance_index, const glm::mat4& to_world)
+{
+   InstanceTransforms[instance_index] = to_world;
+   InstancesChanged = true;
+}
+
+void AccelerationStructureGL::moveSpheres(int geometry_index, const std::vector<Sphere>& spheres)
+{
+   Geometry& geometry = Geometries[geometry_index];
+   std::copy( spheres.begin(), spheres.end(), Spheres.begin() + geometry.SphereOffset );
+   geometry.Moved = true;
+}
+
+void AccelerationStructureGL::clear()
+{
+   // the residency reads the pages of the file on other threads, so it is stopped first.
+   Residency.reset();
+   ProxyMaterials = nullptr;
+   File.reset();
+   StructureFile.reset();
+   CacheFilePath.clear();
+   MappedSpheres = {};
+   MappedVertices = {};
+   MappedTriangles = {};
+   Spheres.clear();
+   Vertices.clear();
+   Triangles.clear();
+   Geometries.clear();
+   InstanceGeometries.clear();
+   InstanceMaterials.clear();
+   InstanceTransforms.clear();
+   GeometryChanged = true;
+   InstancesChanged = true;
+   Version++;
+}
+
+bool AccelerationStructureGL::save(const std::string& file_path, const std::vector<Material>& materials) const
+{
+   return write( file_path, &materials, 0, true );
+}
+
+bool AccelerationStructureGL::write(
+   const std::string& file_path,
+   const std::vector<Material>* materials,
+   uint64_t key,
+   bool with_primitives
+) const
+{
+   // the buffers of a paged scene hold only its resident chunks.
+   if (isPaged()) {
+      std::cerr << "Could not write a paged scene " << file_path << "\n";
+      return false;
+   }
+
+   std::vector<SceneFile::GeometryRecord> geometries;
+   for (const auto& geometry : Geometries) {
+      geometries.push_back(
+         {
+            geometry.Bounds,
+            geometry.SphereOffset, geometry.SphereNum,
+            geometry.TriangleOffset, geometry.TriangleNum,
+            geometry.VertexOffset, geometry.VertexNum,
+            static_cast<int>(geometry.Builder), 0
+         }
+      );
+   }
+   std::vector<SceneFile::InstanceRecord> instances;
+   for (size_t i = 0; i < InstanceTransforms.size(); ++i) {
+      instances.push_back( { InstanceTransforms[i], InstanceGeometries[i], InstanceMaterials[i], {} } );
+   }
+
+   // the buffers are read back rather than rebuilt, so the nodes refitted or built on the GPU are saved as they are.
+   std::vector<BVHNode> nodes;
+   std::vector<uint> primitives, cells;
+   std::vector<Instance> gpu_instances;
+   std::vector<WideBVHNode> wide_nodes;
+   readBuffer( nodes, NodeBuffer );
+   readBuffer( primitives, PrimitiveBuffer );
+   readBuffer( gpu_instances, InstanceBuffer );
+   readBuffer( wide_nodes, WideNodeBuffer );
+   readBuffer( cells, GridBuilder->getCellBuffer() );
+
+   using SECTION = SceneFile::SECTION;
+   std::array<SceneFile::SectionData, static_cast<int>(SECTION::COUNT)> sections;
+   if (materials != nullptr) sections[static_cast<int>(SECTION::MATERIALS)] = ArrayView<Material>(*materials);
+   if (with_primitives) {
+      sections[static_cast<int>(SECTION::SPHERES)] = getSpheres();
+      sections[static_cast<int>(SECTION::VERTICES)] = getVertices();
+      sections[static_cast<int>(SECTION::TRIANGLES)] = getTriangles();
+      sections[static_cast<int>(SECTION::GEOMETRIES)] = ArrayView<SceneFile::GeometryRecord>(geometries);
+      sections[static_cast<int>(SECTION::INSTANCES)] = ArrayView<SceneFile::InstanceRecord>(instances);
+   }
+   sections[static_cast<int>(SECTION::NODES)] = ArrayView<BVHNode>(nodes);
+   sections[static_cast<int>(SECTION::PRIMITIVES)] = ArrayView<uint>(primitives);
+   sections[static_cast<int>(SECTION::GPU_INSTANCES)] = ArrayView<Instance>(gpu_instances);
+   sections[static_cast<int>(SECTION::WIDE_NODES)] = ArrayView<WideBVHNode>(wide_nodes);
+   sections[static_cast<int>(SECTION::GRID_CELLS)] = ArrayView<uint>(cells);
+   return SceneFile::write( file_path, sections, key );
+}
+
+bool AccelerationStructureGL::load(std::shared_ptr<const SceneFile> file, const std::string& cache_file_path)
+{
+   using SECTION = SceneFile::SECTION;
+   ArrayView<Sphere> spheres;
+   ArrayView<Vertex> vertices;
+   ArrayView<Triangle> triangles;
+   ArrayView<SceneFile::GeometryRecord> geometries;
+   ArrayView<SceneFile::InstanceRecord> instances;
+   if (!file->get( spheres, SECTION::SPHERES ) || !file->get( vertices, SECTION::VERTICES ) ||
+       !file->get( triangles, SECTION::TRIANGLES ) || !file->get( geometries, SECTION::GEOMETRIES ) ||
+       !file->get( instances, SECTION::INSTANCES )) return false;
+   if (!hasValidRecords( spheres, vertices, triangles, geometries, instances )) {
+      std::cerr << "Invalid records in scene file\n";
+      return false;
+   }
+
+   ArrayView<BVHNode> nodes;
+   ArrayView<uint> primitives, cells;
+   ArrayView<Instance> gpu_instances;
+   ArrayView<WideBVHNode> wide_nodes;
+   const auto get_structure = [&](const SceneFile& source)
+   {
+      return source.hasAccelerationStructure() &&
+         source.get( nodes, SECTION::NODES ) && source.get( primitives, SECTION::PRIMITIVES ) &&
+         source.get( gpu_instances, SECTION::GPU_INSTANCES ) && source.get( wide_nodes, SECTION::WIDE_NODES ) &&
+         source.get( cells, SECTION::GRID_CELLS );
+   };
+
+   // a cache is taken only if it was built for the same primitives with the same parameters.
+   // any other cache is built again and replaced, which also happens when another process has replaced it meanwhile.
+   clear();
+   uint64_t key = 0;
+   std::shared_ptr<const SceneFile> structure;
+   if (get_structure( *file )) structure = file;
+   else if (!cache_file_path.empty()) {
+      key = getCacheKey( *file );
+      auto cache = std::make_shared<SceneFile>();
+      if (std::ifstream(cache_file_path).is_open() && cache->open( cache_file_path ) && cache->getKey() == key &&
+          get_structure( *cache )) structure = std::move( cache );
+   }
+
+   if (structure == nullptr) {
+      // the builders take the primitives of a geometry with the triangles indexing its own vertices.
+      // with a memory budget, a large geometry of spheres becomes a geometry for each of its chunks,
+      // and each of its instances becomes an instance of every chunk.
+      std::vector<std::vector<int>> record_geometries;
+      bool split = false;
+      for (const auto& record : geometries) {
+         record_geometries.emplace_back();
+         if (MemoryBudget > 0 && record.TriangleNum == 0 && record.SphereNum > ChunkSphereNum) {
+            for (const auto& chunk : getSphereChunks(
+               std::vector<Sphere>(spheres.begin() + record.SphereOffset, spheres.begin() + record.SphereOffset + record.SphereNum)
+            )) record_geometries.back().emplace_back( addGeometry( chunk, {}, {}, static_cast<BUILDER>(record.Builder) ) );
+            split = true;
+            continue;
+         }
+
+         std::vector<Triangle> local_triangles(
+            triangles.begin() + record.TriangleOffset, triangles.begin() + record.TriangleOffset + record.TriangleNum
+         );
+         for (auto& triangle : local_triangles) {
+            for (auto& index : triangle.Indices) index -= static_cast<uint>(record.VertexOffset);
+         }
+         record_geometries.back().emplace_back(
+            addGeometry(
+               std::vector<Sphere>(spheres.begin() + record.SphereOffset, spheres.begin() + record.SphereOffset + record.SphereNum),
+               std::vector<Vertex>(vertices.begin() + record.VertexOffset, vertices.begin() + record.VertexOffset + record.VertexNum),
+               local_triangles,
+               static_cast<BUILDER>(record.Builder)
+            )
+         );
+      }
+      for (const auto& record : instances) {
+         for (const int geometry : record_geometries[record.Geometry]) addInstance( geometry, record.ToWorld, record.MaterialIndex );
+      }
+      if (key == 0) return true;
+
+      // a scene is paged only from the pages of a file, so the written cache is loaded like any other.
+      update();
+      if (!write( cache_file_path, nullptr, key, split ) || MemoryBudget == 0) return true;
+
+      auto cache = std::make_shared<SceneFile>();
+      if (!cache->open( cache_file_path ) || cache->getKey() != key || !get_structure( *cache )) return true;
+
+      clear();
+      structure = std::move( cache );
+   }
+
+   // the cache of a split scene holds its own primitives, which are ordered by the chunks.
+   ArrayView<SceneFile::GeometryRecord> structure_geometries;
+   if (structure != file && structure->get( structure_geometries, SECTION::GEOMETRIES ) && !structure_geometries.empty() &&
+       (!structure->get( spheres, SECTION::SPHERES ) || !structure->get( vertices, SECTION::VERTICES ) ||
+        !structure->get( triangles, SECTION::TRIANGLES ) || !structure->get( geometries, SECTION::GEOMETRIES ) ||
+        !structure->get( instances, SECTION::INSTANCES ))) return false;
+   if (structure != file && !structure_geometries.empty() &&
+       !hasValidRecords( spheres, vertices, triangles, geometries, instances )) {
+      std::cerr << "Invalid records in scene cache file\n";
+      return false;
+   }
+
+   // only the records of the geometries and the instances are kept on the CPU, and they describe the buffers.
+   for (const auto& record : geometries) {
+      Geometry geometry{};
+      geometry.SphereOffset = record.SphereOffset;
+      geometry.SphereNum = record.SphereNum;
+      geometry.TriangleOffset = record.TriangleOffset;
+      geometry.TriangleNum = record.TriangleNum;
+      geometry.VertexOffset = record.VertexOffset;
+      geometry.VertexNum = record.VertexNum;
+      geometry.GridIndex = -1;
+      geometry.Builder = static_cast<BUILDER>(record.Builder);
+      geometry.Bounds = record.Bounds;
+      Geometries.emplace_back( std::move( geometry ) );
+   }
+   for (const auto& record : instances) {
+      InstanceGeometries.emplace_back( record.Geometry );
+      InstanceMaterials.emplace_back( record.MaterialIndex );
+      InstanceTransforms.emplace_back( record.ToWorld );
+   }
+
+   // the buffers are never updated, so the driver is free to place them where the shaders read them fastest.
+   // a scene larger than the budget is paged instead, which fills the buffers with the resident chunks.
+   if (MemoryBudget > 0) {
+      Residency = std::make_unique<ResidencyGL>(
+         ResidencyGL::Buffers{
+            { &SphereBuffer, &VertexBuffer, &TriangleBuffer, &NodeBuffer, &PrimitiveBuffer, &WideNodeBuffer },
+            &InstanceBuffer, &FeedbackBuffer
+         }
+      );
+      if (!Residency->initialize( { spheres, vertices, triangles, nodes, primitives, gpu_instances, wide_nodes }, MemoryBudget )) {
+         Residency.reset();
+      }
+   }
+   if (Residency == nullptr) {
+      createBuffer( SphereBuffer, spheres, 0 );
+      createBuffer( VertexBuffer, vertices, 0 );
+      createBuffer( TriangleBuffer, triangles, 0 );
+      createBuffer( NodeBuffer, nodes, 0 );
+      createBuffer( PrimitiveBuffer, primitives, 0 );
+      createBuffer( InstanceBuffer, gpu_instances, 0 );
+      createBuffer( WideNodeBuffer, wide_nodes, 0 );
+      FeedbackBuffer.create( static_cast<GLsizeiptr>(sizeof( GLuint ) * std::max<size_t>( gpu_instances.size(), 1 )) );
+      FeedbackBuffer.clear();
+   }
+   GridBuilder->setCells( cells );
+   const bool from_cache = structure != file;
+   File = std::move( file );
+   if (from_cache) CacheFilePath = cache_file_path;
+   StructureFile = std::move( structure );
+   MappedSpheres = spheres;
+   MappedVertices = vertices;
+   MappedTriangles = triangles;
+   GeometryChanged = false;
+   InstancesChanged = false;
+   Version++;
+   return true;
+}
+
+bool AccelerationStructureGL::hasValidRecords(
+   ArrayView<Sphere> spheres,
+   ArrayView<Vertex> vertices,
+   ArrayView<Triangle> triangles,
+   ArrayView<SceneFile::GeometryRecord> geometries,
+   ArrayView<SceneFile::InstanceRecord> instances
+)
+{
+   const auto is_in = [](int offset, int num, size_t size) {
+      return offset >= 0 && num >= 0 && static_cast<size_t>(offset) + static_cast<size_t>(num) <= size;
+   };
+   for (const auto& record : geometries) {
+      if (!is_in( record.SphereOffset, record.SphereNum, spheres.size() ) ||
+          !is_in( record.VertexOffset, record.VertexNum, vertices.size() ) ||
+          !is_in( record.TriangleOffset, record.TriangleNum, triangles.size() ) ||
+          record.Builder < 0 || record.Builder > static_cast<int>(BUILDER::LIST)) return false;
+
+      // the triangles index the vertices of the whole scene, but only those of their own geometry.
+      for (int i = record.TriangleOffset; i < record.TriangleOffset + record.TriangleNum; ++i) {
+         for (const uint index : triangles[static_cast<size_t>(i)].Indices) {
+            if (index < static_cast<uint>(record.VertexOffset) ||
+                index - static_cast<uint>(record.VertexOffset) >= static_cast<uint>(record.VertexNum)) return false;
+         }
+      }
+   }
+   for (const auto& record : instances) {
+      if (record.Geometry < 0 || static_cast<size_t>(record.Geometry) >= geometries.size()) return false;
+   }
+   return true;
+}
+
+bool AccelerationStructureGL::optimize(BVHOptimizer::Statistics& statistics, const TraversalProfile& profile)
+{
+   // the structure of a saved scene belongs to its file, which is never written but by save.
+   statistics = {};
+   if (!isStatic() || isPaged() || CacheFilePath.empty()) {
+      std::cerr << "Could not optimize a scene without a cache\n";
+      return false;
+   }
+
+   std::vector<BVHNode> nodes;
+   std::vector<Instance> instances;
+   readBuffer( nodes, NodeBuffer );
+   readBuffer( instances, InstanceBuffer );
+   if (profile.NodeVisits.size() != nodes.size()) {
+      std::cerr << "Could not optimize the scene with the profile of another one\n";
+      return false;
+   }
+
+   // the instances of a tree add their rays in its object space.
+   std::map<int, std::vector<int>> tree_instances;
+   for (size_t i = 0; i < instances.size(); ++i) {
+      if (instances[i].Grid < 0 && instances[i].Root >= 0) tree_instances[instances[i].Root].emplace_back( static_cast<int>(i) );
+   }
+
+   std::vector<WideBVHNode> wide_nodes;
+   std::map<int, int> wide_roots;
+   for (const auto& tree : tree_instances) {
+      // the nodes of a tree are taken with local children, and put back in the same slots with the root at its own.
+      const int root = tree.first;
+      std::vector<int> slots;
+      std::vector<int> stack = { root };
+      while (!stack.empty()) {
+         const int index = stack.back();
+         stack.pop_back();
+         slots.emplace_back( index );
+         if (!nodes[index].isLeaf()) {
+            stack.emplace_back( -nodes[index].Count );
+            stack.emplace_back( nodes[index].Offset );
+         }
+      }
+      std::sort( slots.begin() + 1, slots.end() );
+      std::unordered_map<int, int> local_indices;
+      for (size_t i = 0; i < slots.size(); ++i) local_indices[slots[i]] = static_cast<int>(i);
+      std::vector<BVHNode> local_nodes;
+      for (const int slot : slots) {
+         BVHNode node = nodes[slot];
+         if (!node.isLeaf()) {
+            node.Offset = local_indices[node.Offset];
+            node.Count = -local_indices[-node.Count];
+         }
+         local_nodes.emplace_back( node );
+      }
+
+      BVHOptimizer optimizer(std::move( local_nodes ));
+      for (const int i : tree.second) {
+         const auto& m = instances[i].WorldToObject;
+         for (const auto& ray : profile.Rays) {
+            const glm::vec4 origin(ray.Origin, 1.0f);
+            optimizer.addRay(
+               {
+                  glm::vec3(glm::dot( m[0], origin ), glm::dot( m[1], origin ), glm::dot( m[2], origin )), ray.MinT,
+                  glm::vec3(
+                     glm::dot( glm::vec3(m[0]), ray.Direction ),
+                     glm::dot( glm::vec3(m[1]), ray.Direction ),
+                     glm::dot( glm::vec3(m[2]), ray.Direction )
+                  ),
+                  ray.MaxT
+               }
+            );
+         }
+      }
+      statistics.TreeNum++;
+      statistics.RayNum += optimizer.getRayNum();
+      statistics.CostBefore += optimizer.getCost();
+      statistics.RotationNum += optimizer.rotate();
+      optimizer.reorder();
+      statistics.CostAfter += optimizer.getCost();
+
+      const std::vector<BVHNode>& optimized_nodes = optimizer.getNodes();
+      for (size_t i = 0; i < optimized_nodes.size(); ++i) {
+         BVHNode node = optimized_nodes[i];
+         if (!node.isLeaf()) {
+            node.Offset = slots[node.Offset];
+            node.Count = -slots[-node.Count];
+         }
+         nodes[slots[i]] = node;
+      }
+
+      // the wide nodes are collapsed again from the new tree, which may take a different number of them.
+      if (instances[tree.second.front()].WideRoot < 0) continue;
+
+      WideBVH wide_hierarchy;
+      wide_hierarchy.convert( optimized_nodes );
+      if (wide_hierarchy.getNodes().empty()) continue;
+
+      const auto wide_offset = static_cast<int>(wide_nodes.size());
+      wide_roots[root] = wide_offset;
+      for (auto node : wide_hierarchy.getNodes()) {
+         for (int i = 0; i < WideBVH::ChildNum; ++i) {
+            if (((node.Counts >> (8 * i)) & 0xFFu) == WideBVH::InnerChild) node.Child[i] += wide_offset;
+         }
+         wide_nodes.emplace_back( node );
+      }
+   }
+   for (auto& instance : instances) {
+      if (instance.Grid >= 0 || instance.Root < 0) continue;
+
+      const auto it = wide_roots.find( instance.Root );
+      instance.WideRoot = it != wide_roots.end() ? it->second : -1;
+   }
+
+   // the cache is written from the buffers, and loaded again as the optimized scene.
+   createBuffer( NodeBuffer, nodes );
+   createBuffer( InstanceBuffer, instances );
+   createBuffer( WideNodeBuffer, wide_nodes );
+   ArrayView<SceneFile::GeometryRecord> structure_geometries;
+   const bool with_primitives = StructureFile->get( structure_geometries, SceneFile::SECTION::GEOMETRIES ) &&
+      !structure_geometries.empty();
+   const std::string cache_file_path = CacheFilePath;
+   return write( cache_file_path, nullptr, StructureFile->getKey(), with_primitives ) && load( File, cache_file_path );
+}
+
+uint64_t AccelerationStructureGL::getCacheKey(const SceneFile& file) const
+{
+   // anything that changes the build changes the key: the primitives, their geometries and instances,
+   // and the parameters of the builders and of the layout of the buffers.
+   const std::array<float, 12> parameters = {
+      static_cast<float>(SceneFile::Version), static_cast<float>(NodeFormat),
+      static_cast<float>(BVH::MaxDepth), static_cast<float>(BVH::BinNum), static_cast<float>(BVH::MaxLeafSize),
+      BVH::TraversalCost, BVH::IntersectionCost,
+      static_cast<float>(WideBVH::ChildNum), static_cast<float>(LinearBVHGL::MortonBitNum),
+      UniformGridGL::CellsPerPrimitive, static_cast<float>(UniformGridGL::MaxResolution),
+      static_cast<float>(MemoryBudget > 0 ? ChunkSphereNum : 0)
+   };
+   uint64_t key = SceneFile::getHash( parameters.data(), sizeof( parameters ), 0 );
+   for (const auto section : {
+      SceneFile::SECTION::SPHERES, SceneFile::SECTION::VERTICES, SceneFile::SECTION::TRIANGLES,
+      SceneFile::SECTION::GEOMETRIES, SceneFile::SECTION::INSTANCES
+   }) key = file.getSectionHash( section, key );
+   // 0 is the key of the files which hold their own primitives.
+   return key == 0 ? 1 : key;
+}
+
+std::vector<std::vector<Sphere>> AccelerationStructureGL::getSphereChunks(std::vector<Sphere> spheres)
+{
+   if (static_cast<int>(spheres.size()) <= ChunkSphereNum) return { std::move( spheres ) };
+
+   BoundingBox bounds;
+   for (const auto& sphere : spheres) {
+      bounds.Min = glm::min( bounds.Min, sphere.Center );
+      bounds.Max = glm::max( bounds.Max, sphere.Center );
+   }
+   const glm::vec3 extent = bounds.Max - bounds.Min;
+   const int axis = extent.x > extent.y && extent.x > extent.z ? 0 : extent.y > extent.z ? 1 : 2;
+   const auto middle = spheres.begin() + static_cast<std::ptrdiff_t>(spheres.size() / 2);
+   std::nth_element(
+      spheres.begin(), middle, spheres.end(),
+      [axis](const Sphere& a, const Sphere& b) { return a.Center[axis] < b.Center[axis]; }
+   );
+   std::vector<std::vector<Sphere>> chunks = getSphereChunks( std::vector<Sphere>(spheres.begin(), middle) );
+   std::vector<std::vector<Sphere>> upper_chunks = getSphereChunks( std::vector<Sphere>(middle, spheres.end()) );
+   chunks.insert( chunks.end(), std::make_move_iterator( upper_chunks.begin() ), std::make_move_iterator( upper_chunks.end() ) );
+   return chunks;
+}
+
+BoundingBox AccelerationStructureGL::getWorldBounds(const BoundingBox& bounds, const glm::mat4& to_world)
+{
+   BoundingBox world_bounds;
+   for (int i = 0; i < 8; ++i) {
+      const glm::vec3 corner(
+         (i & 1) != 0 ? bounds.Max.x : bounds.Min.x,
+         (i & 2) != 0 ? bounds.Max.y : bounds.Min.y,
+         (i & 4) != 0 ? bounds.Max.z : bounds.Min.z
+      );
+      const glm::vec3 world_corner = glm::vec3(to_world * glm::vec4(corner, 1.0f));
+      world_bounds.Min = glm::min( world_bounds.Min, world_corner );
+      world_bounds.Max = glm::max( world_bounds.Max, world_corner );
+   }
+   return world_bounds;
+}
+
+BoundingBox AccelerationStructureGL::getSceneBounds() const
+{
+   if (!TopLevel.getNodes().empty()) return { TopLevel.getNodes()[0].Min, TopLevel.getNodes()[0].Max };
+
+   BoundingBox scene_bounds;
+   for (size_t i = 0; i < InstanceTransforms.size(); ++i) {
+      const BoundingBox bounds = getWorldBounds( Geometries[InstanceGeometries[i]].Bounds, InstanceTransforms[i] );
+      scene_bounds.Min = glm::min( scene_bounds.Min, bounds.Min );
+      scene_bounds.Max = glm::max( scene_bounds.Max, bounds.Max );
+   }
+   return scene_bounds;
+}
+
+int AccelerationStructureGL::getNodeNum(const Geometry& geometry)
+{
+   return geometry.Builder == BUILDER::LINEAR ?
+      LinearBVHGL::getNodeNum( geometry.SphereNum + geometry.TriangleNum ) :
+      static_cast<int>(geometry.Hierarchy.getNodes().size());
+}
+
+int AccelerationStructureGL::getPrimitiveNum(const Geometry& geometry)
+{
+   return geometry.Builder == BUILDER::LINEAR ?
+      geometry.SphereNum + geometry.TriangleNum :
+      static_cast<int>(geometry.Hierarchy.getPrimitives().size());
+}
+
+BoundingBox AccelerationStructureGL::getGeometryBounds(const Geometry& geometry) const
+{
+   BoundingBox bounds;
+   for (int i = geometry.SphereOffset; i < geometry.SphereOffset + geometry.SphereNum; ++i) {
+      bounds.Min = glm::min( bounds.Min, Spheres[i].Center - Spheres[i].Radius );
+      bounds.Max = glm::max( bounds.Max, Spheres[i].Center + Spheres[i].Radius );
+   }
+   for (int i = geometry.VertexOffset; i < geometry.VertexOffset + geometry.VertexNum; ++i) {
+      bounds.Min = glm::min( bounds.Min, Vertices[i].Position );
+      bounds.Max = glm::max( bounds.Max, Vertices[i].Position );
+   }
+   return bounds;
+}
+
+void AccelerationStructureGL::copyPrimitives(
+   std::vector<Sphere>& spheres,
+   std::vector<Vertex>& vertices,
+   std::vector<Triangle>& triangles,
+   const Geometry& geometry
+) const
+{
+   // the triangles of the copy index the copied vertices.
+   spheres.assign( Spheres.begin() + geometry.SphereOffset, Spheres.begin() + geometry.SphereOffset + geometry.SphereNum );
+   vertices.assign( Vertices.begin() + geometry.VertexOffset, Vertices.begin() + geometry.VertexOffset + geometry.VertexNum );
+   triangles.clear();
+   const auto vertex_offset = static_cast<uint>(geometry.VertexOffset);
+   for (int t = geometry.TriangleOffset; t < geometry.TriangleOffset + geometry.TriangleNum; ++t) {
+      triangles.emplace_back(
+         Triangles[t].Indices[0] - vertex_offset,
+         Triangles[t].Indices[1] - vertex_offset,
+         Triangles[t].Indices[2] - vertex_offset,
+         Triangles[t].MaterialIndex
+      );
+   }
+}
+
+void AccelerationStructureGL::placeGeometries()
+{
+   // the nodes of a linear build are placeholders until the GPU builds them, and every one of them can hold a leaf.
+   int primitive_offset = 0, node_offset = 0, wide_node_offset = 0, leaf_offset = 0, grid_index = 0;
+   for (auto& geometry : Geometries) {
+      geometry.GridIndex = geometry.Builder == BUILDER::GRID ? grid_index++ : -1;
+      geometry.PrimitiveOffset = primitive_offset;
+      geometry.NodeOffset = node_offset;
+      geometry.WideNodeOffset = wide_node_offset;
+      geometry.LeafOffset = leaf_offset;
+      geometry.LeafNum = geometry.Builder == BUILDER::LINEAR ? getNodeNum( geometry ) : static_cast<int>(std::count_if(
+         geometry.Hierarchy.getNodes().begin(), geometry.Hierarchy.getNodes().end(),
+         [](const BVHNode& node) { return node.isLeaf(); }
+      ));
+      primitive_offset += getPrimitiveNum( geometry );
+      node_offset += getNodeNum( geometry );
+      wide_node_offset += static_cast<int>(geometry.WideHierarchy.getNodes().size());
+      leaf_offset += geometry.LeafNum;
+   }
+}
+
+std::vector<Instance> AccelerationStructureGL::getInstances() const
+{
+   // the instances are stored in the order of the top-level leaves, which refer to them by their position.
+   // the wide nodes are only as new as the hierarchy on the CPU, so a geometry refitted since then uses the binary ones.
+   const auto top_level_node_num = static_cast<int>(TopLevel.getNodes().size());
+   std::vector<Instance> instances(InstanceTransforms.size());
+   for (size_t i = 0; i < instances.size(); ++i) {
+      const uint index = TopLevel.getPrimitives()[i];
+      const Geometry& geometry = Geometries[InstanceGeometries[index]];
+      const glm::mat4 to_object = glm::inverse( InstanceTransforms[index] );
+      for (int r = 0; r < 3; ++r) instances[i].WorldToObject[r] = glm::row( to_object, r );
+      instances[i].Root = top_level_node_num + geometry.NodeOffset;
+      instances[i].MaterialIndex = InstanceMaterials[index];
+      const bool wide = NodeFormat == NODE_FORMAT::WIDE && !geometry.WideHierarchy.getNodes().empty() &&
+         !geometry.Moved && !geometry.Refitted;
+      instances[i].WideRoot = wide ? geometry.WideNodeOffset : -1;
+      instances[i].Grid = geometry.GridIndex;
+   }
+   return instances;
+}
+
+std::vector<BVHNode> AccelerationStructureGL::getBottomLevelNodes() const
+{
+   // the children and the primitives of a bottom level are relocated to where it is placed in the shared buffers.
+   const auto top_level_node_num = static_cast<int>(TopLevel.getNodes().size());
+   std::vector<BVHNode> nodes;
+   for (const auto& geometry : Geometries) {
+      if (geometry.Builder == BUILDER::LINEAR) {
+         nodes.resize( nodes.size() + getNodeNum( geometry ) );
+         continue;
+      }
+
+      const int node_offset = top_level_node_num + geometry.NodeOffset;
+      for (auto node : geometry.Hierarchy.getNodes()) {
+         if (node.isLeaf()) node.Offset += geometry.PrimitiveOffset;
+         else {
+            node.Offset += node_offset;
+            node.Count -= node_offset;
+         }
+         nodes.emplace_back( node );
+      }
+   }
+   return nodes;
+}
+
+std::vector<WideBVHNode> AccelerationStructureGL::getWideNodes() const
+{
+   std::vector<WideBVHNode> nodes;
+   for (const auto& geometry : Geometries) {
+      for (auto node : geometry.WideHierarchy.getNodes()) {
+         for (int i = 0; i < WideBVH::ChildNum; ++i) {
+            const uint count = (node.Counts >> (8 * i)) & 0xFFu;
+            if (count == WideBVH::InnerChild) node.Child[i] += geometry.WideNodeOffset;
+            else if (count != WideBVH::EmptyChild) node.Child[i] += geometry.PrimitiveOffset;
+         }
+         nodes.emplace_back( node );
+      }
+   }
+   return nodes;
+}
+
+std::vector<uint> AccelerationStructureGL::getBottomLevelPrimitives() const
+{
+   std::vector<uint> primitives;
+   for (const auto& geometry : Geometries) {
+      if (geometry.Builder == BUILDER::LINEAR) {
+         primitives.resize( primitives.size() + getPrimitiveNum( geometry ) );
+         continue;
+      }
+
+      for (const auto& primitive : geometry.Hierarchy.getPrimitives()) {
+         if ((primitive & BVH::SpherePrimitive) != 0) {
+            primitives.emplace_back( (primitive + static_cast<uint>(geometry.SphereOffset)) | BVH::SpherePrimitive );
+         }
+         else primitives.emplace_back( primitive + static_cast<uint>(geometry.TriangleOffset) );
+      }
+   }
+   return primitives;
+}
+
+void AccelerationStructureGL::uploadAll()
+{
+   std::vector<BVHNode> nodes = TopLevel.getNodes();
+   const std::vector<BVHNode> bottom_level_nodes = getBottomLevelNodes();
+   nodes.insert( nodes.end(), bottom_level_nodes.begin(), bottom_level_nodes.end() );
+
+   // the refit walks from the leaves of the bottom levels up to their roots, which have no parent.
+   // the linear builder overwrites the parents and the leaves of its geometry.
+   std::vector<int> parents(nodes.size(), -1);
+   std::vector<int> leaves;
+   int max_linear_primitive_num = 0;
+   for (auto i = static_cast<int>(TopLevel.getNodes().size()); i < static_cast<int>(nodes.size()); ++i) {
+      if (nodes[i].isLeaf()) leaves.emplace_back( i );
+      else {
+         parents[nodes[i].Offset] = i;
+         parents[-nodes[i].Count] = i;
+      }
+   }
+   for (const auto& geometry : Geometries) {
+      if (geometry.Builder == BUILDER::LINEAR) max_linear_primitive_num = std::max( max_linear_primitive_num, getPrimitiveNum( geometry ) );
+   }
+
+   createBuffer( SphereBuffer, Spheres );
+   createBuffer( VertexBuffer, Vertices );
+   createBuffer( TriangleBuffer, Triangles );
+   createBuffer( NodeBuffer, nodes );
+   createBuffer( PrimitiveBuffer, getBottomLevelPrimitives() );
+   createBuffer( InstanceBuffer, getInstances() );
+   createBuffer( WideNodeBuffer, getWideNodes() );
+   createBuffer( ParentBuffer, parents );
+   createBuffer( LeafBuffer, leaves );
+   VisitBuffer.create( static_cast<GLsizeiptr>(sizeof( GLuint ) * nodes.size()) );
+   CostBuffer.create( static_cast<GLsizeiptr>(sizeof( float ) * std::max<size_t>( Geometries.size(), 1 )) );
+   if (max_linear_primitive_num > 0) LinearBuilder->setBuffers( max_linear_primitive_num );
+
+   // the boxes which were refitted on the GPU are replaced with the older ones of the hierarchies, so they are refitted again,
+   // and the placeholders of the linear builds are built. the grids are built right away, since their buffers are
+   // bound even when no geometry is in a grid.
+   for (auto& geometry : Geometries) {
+      if (geometry.Refitted || geometry.Builder == BUILDER::LINEAR) geometry.Moved = true;
+      geometry.Refitted = false;
+      geometry.CostRequested = false;
+   }
+   buildGrids();
+}
+
+void AccelerationStructureGL::bindRefitBuffers() const
+{
+   ParentBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 0 );
+   LeafBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 1 );
+   VisitBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 2 );
+   CostBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 3 );
+}
+
+void AccelerationStructureGL::fitBoxes(const Geometry& geometry, int leaf_num) const
+{
+   glUseProgram( RefitShader->getShaderProgram() );
+   RefitShader->uniform1i( "LeafOffset", geometry.LeafOffset );
+   RefitShader->uniform1i( "LeafNum", leaf_num );
+   glDispatchCompute( (leaf_num + RefitGroupSize - 1) / RefitGroupSize, 1, 1 );
+   glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+}
+
+void AccelerationStructureGL::refit(int geometry_index)
+{
+   Geometry& geometry = Geometries[geometry_index];
+   if (geometry.SphereNum + geometry.TriangleNum == 0) return;
+
+   const int node_offset = static_cast<int>(TopLevel.getNodes().size()) + geometry.NodeOffset;
+   fitBoxes( geometry, geometry.LeafNum );
+
+   glUseProgram( CostShader->getShaderProgram() );
+   CostShader->uniform1i( "NodeOffset", node_offset );
+   CostShader->uniform1i( "NodeNum", static_cast<int>(geometry.Hierarchy.getNodes().size()) );
+   CostShader->uniform1i( "GeometryIndex", geometry_index );
+   glDispatchCompute( 1, 1, 1 );
+
+   geometry.Moved = false;
+   geometry.Refitted = true;
+   geometry.CostRequested = true;
+   RefitNum++;
+}
+
+void AccelerationStructureGL::build(int geometry_index)
+{
+   Geometry& geometry = Geometries[geometry_index];
+   geometry.Moved = false;
+   if (geometry.SphereNum + geometry.TriangleNum == 0) return;
+
+   // the radix sort of the builder takes the bindings of the refit buffers, so they are bound again for the fit.
+   LinearBuilder->build(
+      geometry.Bounds,
+      geometry.SphereOffset, geometry.SphereNum,
+      geometry.TriangleOffset, geometry.TriangleNum,
+      static_cast<int>(TopLevel.getNodes().size()) + geometry.NodeOffset,
+      geometry.PrimitiveOffset,
+      geometry.LeafOffset,
+      ParentBuffer,
+      LeafBuffer
+   );
+   bindRefitBuffers();
+   fitBoxes( geometry, geometry.SphereNum + geometry.TriangleNum );
+}
+
+void AccelerationStructureGL::buildGrids()
+{
+   // the grids share the buffers, so all of them are built again when any of them has moved.
+   GridBuilder->clear();
+   for (auto& geometry : Geometries) {
+      if (geometry.Builder != BUILDER::GRID) continue;
+
+      GridBuilder->addGrid(
+         geometry.Bounds, geometry.SphereOffset, geometry.SphereNum, geometry.TriangleOffset, geometry.TriangleNum
+      );
+      geometry.Moved = false;
+   }
+   bindBuffers();
+   GridBuilder->build();
+}
+
+void AccelerationStructureGL::setProxies(const BufferGL* material_buffer)
+{
+   ProxyMaterials = isPaged() ? nullptr : material_buffer;
+   if (ProxyMaterials != nullptr && (isStatic() || !Geometries.empty())) buildProxies();
+}
+
+void AccelerationStructureGL::buildProxies()
+{
+   // the buffers hold a placeholder when they are empty, so the nodes are counted by the hierarchies or the file.
+   // the bottom levels of a loaded scene follow its top level, so they begin at the first root of its instances.
+   int first_node = getTopLevelNodeNum(), node_num = first_node, wide_node_num = 0;
+   if (isStatic()) {
+      ArrayView<BVHNode> nodes;
+      ArrayView<WideBVHNode> wide_nodes;
+      ArrayView<Instance> instances;
+      if (!StructureFile->get( nodes, SceneFile::SECTION::NODES ) || !StructureFile->get( wide_nodes, SceneFile::SECTION::WIDE_NODES ) ||
+          !StructureFile->get( instances, SceneFile::SECTION::GPU_INSTANCES )) return;
+
+      node_num = static_cast<int>(nodes.size());
+      wide_node_num = static_cast<int>(wide_nodes.size());
+      first_node = node_num;
+      for (const auto& instance : instances) {
+         if (instance.Root >= 0) first_node = std::min( first_node, instance.Root );
+      }
+   }
+   else {
+      for (const auto& geometry : Geometries) {
+         node_num += getNodeNum( geometry );
+         wide_node_num += static_cast<int>(geometry.WideHierarchy.getNodes().size());
+      }
+   }
+   bindBuffers();
+   ProxyMaterials->bindBase( GL_SHADER_STORAGE_BUFFER, 9 );
+   LevelOfDetail->build( first_node, node_num, wide_node_num );
+}
+
+void AccelerationStructureGL::requestRebuilds()
+{
+   // the costs were computed with the refits of the last update, so reading them back rarely waits for the GPU.
+   const bool requested = std::any_of(
+      Geometries.begin(), Geometries.end(), [](const Geometry& geometry) { return geometry.CostRequested; }
+   );
+   if (!requested) return;
+
+   std::vector<float> costs(Geometries.size());
+   CostBuffer.read( costs );
+   for (size_t i = 0; i < Geometries.size(); ++i) {
+      Geometry& geometry = Geometries[i];
+      if (!geometry.CostRequested) continue;
+
+      geometry.CostRequested = false;
+      if (geometry.Rebuild.valid() || costs[i] <= geometry.BuildCost * MaxCostGrowth) continue;
+
+      // the rebuild works on a copy, so the spheres can keep moving while it runs.
+      std::vector<Sphere> spheres;
+      std::vector<Vertex> vertices;
+      std::vector<Triangle> triangles;
+      copyPrimitives( spheres, vertices, triangles, geometry );
+      geometry.Rebuild = std::async(
+         std::launch::async,
+         [spheres = std::move( spheres ), vertices = std::move( vertices ), triangles = std::move( triangles )]()
+         {
+            BVH hierarchy;
+            hierarchy.build( spheres, vertices, triangles );
+            return hierarchy;
+         }
+      );
+   }
+}
+
+void AccelerationStructureGL::swapRebuiltGeometries()
+{
+   // a finished tree replaces the refitted one between frames, so that no frame sees a half-built hierarchy.
+   // the spheres have moved on since the copy was taken, so it is refitted right away.
+   for (auto& geometry : Geometries) {
+      if (!geometry.Rebuild.valid() || geometry.Rebuild.wait_for( std::chrono::seconds(0) ) != std::future_status::ready) continue;
+
+      BVH hierarchy = geometry.Rebuild.get();
+      if (geometry.Builder != BUILDER::SAH) continue;
+
+      geometry.Hierarchy = std::move( hierarchy );
+      geometry.WideHierarchy.convert( geometry.Hierarchy );
+      geometry.BuildCost = geometry.Hierarchy.getCost();
+      geometry.Moved = true;
+      GeometryChanged = true;
+      RebuildNum++;
+   }
+}
+
+void AccelerationStructureGL::update()
+{
+   if (isStatic()) {
+      if (isPaged()) {
+         Residency->update();
+         Version++;
+      }
+      return;
+   }
+
+   requestRebuilds();
+   swapRebuiltGeometries();
+   const bool moved = std::any_of(
+      Geometries.begin(), Geometries.end(), [](const Geometry& geometry) { return geometry.Moved; }
+   );
+   if (!GeometryChanged && !InstancesChanged && !moved) return;
+
+   if (GeometryChanged) placeGeometries();
+   for (auto& geometry : Geometries) {
+      if (geometry.Moved) geometry.Bounds = getGeometryBounds( geometry );
+   }
+
+   const size_t top_level_node_num = TopLevel.getNodes().size();
+   std::vector<BoundingBox> bounds;
+   bounds.reserve( InstanceTransforms.size() );
+   for (size_t i = 0; i < InstanceTransforms.size(); ++i) {
+      bounds.emplace_back( getWorldBounds( Geometries[InstanceGeometries[i]].Bounds, InstanceTransforms[i] ) );
+   }
+   TopLevel.build( bounds );
+
+   // the bottom levels move only when the top level changes its size, which a moved instance never does.
+   if (GeometryChanged || top_level_node_num != TopLevel.getNodes().size()) uploadAll();
+   else {
+      NodeBuffer.update( TopLevel.getNodes() );
+      InstanceBuffer.update( getInstances() );
+      for (const auto& geometry : Geometries) {
+         if (!geometry.Moved || geometry.SphereNum == 0) continue;
+
+         const std::vector<Sphere> spheres(
+            Spheres.begin() + geometry.SphereOffset, Spheres.begin() + geometry.SphereOffset + geometry.SphereNum
+         );
+         SphereBuffer.update( spheres, static_cast<GLintptr>(sizeof( Sphere ) * geometry.SphereOffset) );
+      }
+   }
+   // raytracer.comp marks the instances its rays reach even when the scene is not paged.
+   const auto feedback_size = static_cast<GLsizeiptr>(sizeof( GLuint ) * std::max<size_t>( InstanceTransforms.size(), 1 ));
+   if (FeedbackBuffer.getSize() != feedback_size) {
+      FeedbackBuffer.create( feedback_size );
+      FeedbackBuffer.clear();
+   }
+
+   if (std::any_of( Geometries.begin(), Geometries.end(), [](const Geometry& geometry) { return geometry.Moved; } )) {
+      VisitBuffer.clear();
+      bindBuffers();
+      bindRefitBuffers();
+      glMemoryBarrier( GL_BUFFER_UPDATE_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT );
+      bool grid_moved = false;
+      for (int i = 0; i < static_cast<int>(Geometries.size()); ++i) {
+         if (!Geometries[i].Moved) continue;
+
+         if (Geometries[i].Builder == BUILDER::LINEAR) build( i );
+         else if (Geometries[i].Builder == BUILDER::GRID) grid_moved = true;
+         else refit( i );
+      }
+      if (grid_moved) buildGrids();
+      glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT );
+   }
+   if (ProxyMaterials != nullptr) buildProxies();
+   GeometryChanged = false;
+   InstancesChanged = false;
+   Version++;
+}
+
+void AccelerationStructureGL::bindBuffers() const
+{
+   SphereBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 8 );
+   NodeBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 10 );
+   PrimitiveBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 11 );
+   VertexBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 12 );
+   TriangleBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 13 );
+   InstanceBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 14 );
+   WideNodeBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 15 );
+   GridBuilder->bindBuffers();
+   FeedbackBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 18 );
+   LevelOfDetail->bindBuffers();
+}
\ No newline at end of file
@@ -0,0 +1,430 @@
+#include "bvh.h"
+#include "task_pool.h"
+
+void BVH::build(const std::vector<Sphere>& spheres, const std::vector<Vertex>& vertices, const std::vector<Triangle>& triangles)
+{
+   setReferences( spheres, vertices, triangles );
+   build( MaxLeafSize );
+}
+
+void BVH::buildLeaf(const std::vector<Sphere>& spheres, const std::vector<Vertex>& vertices, const std::vector<Triangle>& triangles)
+{
+   setReferences( spheres, vertices, triangles );
+   BVHNode node;
+   node.Min = glm::vec3(std::numeric_limits<float>::max());
+   node.Max = glm::vec3(std::numeric_limits<float>::lowest());
+   for (const auto& reference : References) {
+      node.Min = glm::min( node.Min, reference.Min );
+      node.Max = glm::max( node.Max, reference.Max );
+   }
+   if (References.empty()) node.Min = node.Max = glm::vec3(0.0f);
+   node.Count = static_cast<int>(References.size());
+   LeafSize = node.Count;
+   Depth = 1;
+   Nodes.assign( 1, node );
+
+   Primitives.resize( References.size() );
+   for (size_t i = 0; i < References.size(); ++i) Primitives[i] = References[i].Primitive;
+   References.clear();
+}
+
+void BVH::setReferences(const std::vector<Sphere>& spheres, const std::vector<Vertex>& vertices, const std::vector<Triangle>& triangles)
+{
+   References.clear();
+   References.reserve( spheres.size() + triangles.size() );
+   for (size_t i = 0; i < spheres.size(); ++i) {
+      const glm::vec3 radius(spheres[i].Radius);
+      References.push_back(
+         { spheres[i].Center - radius, spheres[i].Center + radius, spheres[i].Center, static_cast<uint>(i) | SpherePrimitive }
+      );
+   }
+   for (size_t i = 0; i < triangles.size(); ++i) {
+      const glm::vec3& a = vertices[triangles[i].Indices[0]].Position;
+      const glm::vec3& b = vertices[triangles[i].Indices[1]].Position;
+      const glm::vec3& c = vertices[triangles[i].Indices[2]].Position;
+      const glm::vec3 min = glm::min( a, glm::min( b, c ) );
+      const glm::vec3 max = glm::max( a, glm::max( b, c ) );
+      References.push_back( { min, max, 0.5f * (min + max), static_cast<uint>(i) } );
+   }
+}
+
+void BVH::build(const std::vector<BoundingBox>& boxes)
+{
+   References.clear();
+   References.reserve( boxes.size() );
+   for (size_t i = 0; i < boxes.size(); ++i) {
+      References.push_back( { boxes[i].Min, boxes[i].Max, 0.5f * (boxes[i].Min + boxes[i].Max), static_cast<uint>(i) } );
+   }
+   build( 1 );
+}
+
+void BVH::build(int leaf_size)
+{
+   LeafSize = leaf_size;
+   const auto count = static_cast<int>(References.size());
+   Parallel = count >= TaskReferenceNum && TaskPool::get().getThreadNum() > 1;
+   if (count >= ParallelReferenceNum) Scratch.resize( References.size() );
+   Nodes.clear();
+   if (Parallel) {
+      Arena.resize( static_cast<size_t>(std::max( 2 * count - 1, 1 )) );
+      Depth = buildNode( 0, 0, count, 1 );
+      Nodes.reserve( Arena.size() );
+      Nodes.emplace_back();
+      layOut( 0, 0 );
+      std::vector<BVHNode>().swap( Arena );
+   }
+   else {
+      Depth = 0;
+      Nodes.reserve( static_cast<size_t>(std::max( 2 * count - 1, 1 )) );
+      Nodes.emplace_back();
+      buildNodeSerially( 0, 0, count, 1 );
+   }
+   std::vector<Reference>().swap( Scratch );
+
+   Primitives.resize( References.size() );
+   for (size_t i = 0; i < References.size(); ++i) Primitives[i] = References[i].Primitive;
+   References.clear();
+}
+
+float BVH::getCost() const
+{
+   const float root_area = Nodes.empty() ? 0.0f : getSurfaceArea( Nodes[0].Min, Nodes[0].Max );
+   if (root_area <= 0.0f) return 0.0f;
+
+   float cost = 0.0f;
+   for (const auto& node : Nodes) {
+      const float area = getSurfaceArea( node.Min, node.Max );
+      cost += node.isLeaf() ? IntersectionCost * static_cast<float>(node.Count) * area : TraversalCost * area;
+   }
+   return cost / root_area;
+}
+
+BVHNode BVH::getReferenceBounds(int begin, int end) const
+{
+   BVHNode node;
+   node.Min = glm::vec3(std::numeric_limits<float>::max());
+   node.Max = glm::vec3(std::numeric_limits<float>::lowest());
+   if (!Parallel || end - begin < ParallelReferenceNum) {
+      for (int i = begin; i < end; ++i) {
+         node.Min = glm::min( node.Min, References[i].Min );
+         node.Max = glm::max( node.Max, References[i].Max );
+      }
+   }
+   else {
+      std::vector<BVHNode> blocks(getBlockNum( end - begin ), node);
+      TaskPool::get().run(
+         static_cast<int>(blocks.size()), [&](int b) {
+            const int block_end = std::min( begin + (b + 1) * BlockReferenceNum, end );
+            for (int i = begin + b * BlockReferenceNum; i < block_end; ++i) {
+               blocks[b].Min = glm::min( blocks[b].Min, References[i].Min );
+               blocks[b].Max = glm::max( blocks[b].Max, References[i].Max );
+            }
+         }
+      );
+      for (const auto& block : blocks) {
+         node.Min = glm::min( node.Min, block.Min );
+         node.Max = glm::max( node.Max, block.Max );
+      }
+   }
+   if (begin == end) node.Min = node.Max = glm::vec3(0.0f);
+   return node;
+}
+
+int BVH::partition(int begin, int end, int axis, float position)
+{
+   const auto is_left = [axis, position](const Reference& reference) { return reference.Centroid[axis] < position; };
+   const int count = end - begin;
+   if (count < ParallelReferenceNum) {
+      return static_cast<int>(std::partition( References.data() + begin, References.data() + end, is_left ) - References.data());
+   }
+   if (!Parallel) {
+      // the left references move up in place and the right ones are set aside, so both keep their order as in the blocks.
+      int left = begin, right = 0;
+      for (int i = begin; i < end; ++i) {
+         if (is_left( References[i] )) References[left++] = References[i];
+         else Scratch[right++] = References[i];
+      }
+      std::copy( Scratch.begin(), Scratch.begin() + right, References.begin() + left );
+      return left;
+   }
+
+   // the blocks keep the order of their references on both sides, so no division of them among the threads changes it.
+   // every block counts its left references first, and then writes both sides where the counts before it end.
+   TaskPool& pool = TaskPool::get();
+   const int block_num = getBlockNum( count );
+   std::vector<int> left_offsets(block_num + 1, 0);
+   pool.run(
+      block_num, [&](int b) {
+         const int block_end = std::min( begin + (b + 1) * BlockReferenceNum, end );
+         left_offsets[b + 1] = static_cast<int>(
+            std::count_if( References.begin() + begin + b * BlockReferenceNum, References.begin() + block_end, is_left )
+         );
+      }
+   );
+   std::partial_sum( left_offsets.begin(), left_offsets.end(), left_offsets.begin() );
+   const int mid = begin + left_offsets[block_num];
+   pool.run(
+      block_num, [&](int b) {
+         const int block_begin = begin + b * BlockReferenceNum;
+         const int block_end = std::min( block_begin + BlockReferenceNum, end );
+         int left = begin + left_offsets[b];
+         int right = mid + (block_begin - begin - left_offsets[b]);
+         for (int i = block_begin; i < block_end; ++i) {
+            if (is_left( References[i] )) Scratch[left++] = References[i];
+            else Scratch[right++] = References[i];
+         }
+      }
+   );
+   pool.run(
+      block_num, [&](int b) {
+         const int block_begin = begin + b * BlockReferenceNum;
+         const int block_end = std::min( block_begin + BlockReferenceNum, end );
+         std::copy( Scratch.begin() + block_begin, Scratch.begin() + block_end, References.begin() + block_begin );
+      }
+   );
+   return mid;
+}
+
+int BVH::buildNode(int arena_index, int begin, int end, int depth)
+{
+   BVHNode node = getReferenceBounds( begin, end );
+   int axis = 0;
+   float position = 0.0f;
+   const int count = end - begin;
+   const bool split = depth < MaxDepth && count > 1 && (
+      count < ParallelReferenceNum ?
+         findSplit( axis, position, References.data() + begin, count, node, LeafSize ) :
+         findSplitInParallel( axis, position, begin, end, node )
+   );
+   if (!split) {
+      node.Offset = begin;
+      node.Count = count;
+      Arena[arena_index] = node;
+      return depth;
+   }
+
+   int mid = partition( begin, end, axis, position );
+   if (mid == begin || mid == end) {
+      // all the centroids fell on one side, which only happens when they coincide, so the references are halved.
+      mid = begin + count / 2;
+   }
+
+   const int left = arena_index + 1;
+   const int right = arena_index + 2 * (mid - begin);
+   node.Offset = left;
+   node.Count = -right;
+   Arena[arena_index] = node;
+   if (count < TaskReferenceNum) {
+      return std::max( buildNode( left, begin, mid, depth + 1 ), buildNode( right, mid, end, depth + 1 ) );
+   }
+
+   TaskPool& pool = TaskPool::get();
+   std::atomic<int> pending( 0 );
+   int right_depth = 0;
+   pool.fork( [&]() { right_depth = buildNode( right, mid, end, depth + 1 ); }, pending );
+   const int left_depth = buildNode( left, begin, mid, depth + 1 );
+   pool.wait( pending );
+   return std::max( left_depth, right_depth );
+}
+
+void BVH::buildNodeSerially(int node_index, int begin, int end, int depth)
+{
+   BVHNode node = getReferenceBounds( begin, end );
+   Depth = std::max( Depth, depth );
+
+   int axis = 0;
+   float position = 0.0f;
+   const int count = end - begin;
+   const bool split = depth < MaxDepth && count > 1 && findSplit( axis, position, References.data() + begin, count, node, LeafSize );
+   if (!split) {
+      node.Offset = begin;
+      node.Count = count;
+      Nodes[node_index] = node;
+      return;
+   }
+
+   int mid = partition( begin, end, axis, position );
+   if (mid == begin || mid == end) {
+      // all the centroids fell on one side, which only happens when they coincide, so the references are halved.
+      mid = begin + count / 2;
+   }
+
+   const auto left = static_cast<int>(Nodes.size());
+   Nodes.emplace_back();
+   Nodes.emplace_back();
+   node.Offset = left;
+   node.Count = -(left + 1);
+   Nodes[node_index] = node;
+   buildNodeSerially( left, begin, mid, depth + 1 );
+   buildNodeSerially( left + 1, mid, end, depth + 1 );
+}
+
+void BVH::layOut(int node_index, int arena_index)
+{
+   // the children of a node are placed next to each other as they are reached, which is how a serial build places them.
+   BVHNode node = Arena[arena_index];
+   if (!node.isLeaf()) {
+      const auto left = static_cast<int>(Nodes.size());
+      Nodes.emplace_back();
+      Nodes.emplace_back();
+      layOut( left, node.Offset );
+      layOut( left + 1, -node.Count );
+      node.Offset = left;
+      node.Count = -(left + 1);
+   }
+   Nodes[node_index] = node;
+}
+
+void BVH::getCentroidBounds(glm::vec3& centroid_min, glm::vec3& centroid_max, const Reference* references, int count)
+{
+   centroid_min = glm::vec3(std::numeric_limits<float>::max());
+   centroid_max = glm::vec3(std::numeric_limits<float>::lowest());
+   for (int i = 0; i < count; ++i) {
+      centroid_min = glm::min( centroid_min, references[i].Centroid );
+      centroid_max = glm::max( centroid_max, references[i].Centroid );
+   }
+}
+
+glm::vec3 BVH::getBinScale(const glm::vec3& centroid_min, const glm::vec3& centroid_max)
+{
+   // an axis along which the centroids coincide has no bins.
+   glm::vec3 scale(0.0f);
+   for (int a = 0; a < 3; ++a) {
+      const float extent = centroid_max[a] - centroid_min[a];
+      if (extent > 0.0f) scale[a] = static_cast<float>(BinNum) / extent;
+   }
+   return scale;
+}
+
+void BVH::addToBins(Bins& bins, const Reference* references, int count, const glm::vec3& centroid_min, const glm::vec3& scale)
+{
+   for (int a = 0; a < 3; ++a) {
+      if (scale[a] == 0.0f) continue;
+
+      for (int i = 0; i < count; ++i) {
+         const int b = std::min( static_cast<int>((references[i].Centroid[a] - centroid_min[a]) * scale[a]), BinNum - 1 );
+         bins[a][b].Min = glm::min( bins[a][b].Min, references[i].Min );
+         bins[a][b].Max = glm::max( bins[a][b].Max, references[i].Max );
+         bins[a][b].Count++;
+      }
+   }
+}
+
+bool BVH::findSplitInParallel(int& axis, float& position, int begin, int end, const BVHNode& node) const
+{
+   // the bounds and the bins of the blocks are merged by their minima, maxima, and counts, which is exact.
+   TaskPool& pool = TaskPool::get();
+   const int count = end - begin;
+   const int block_num = getBlockNum( count );
+   std::vector<std::pair<glm::vec3, glm::vec3>> centroid_bounds(block_num);
+   pool.run(
+      block_num, [&](int b) {
+         const int block_begin = begin + b * BlockReferenceNum;
+         const int block_count = std::min( BlockReferenceNum, end - block_begin );
+         getCentroidBounds( centroid_bounds[b].first, centroid_bounds[b].second, References.data() + block_begin, block_count );
+      }
+   );
+   glm::vec3 centroid_min(std::numeric_limits<float>::max());
+   glm::vec3 centroid_max(std::numeric_limits<float>::lowest());
+   for (const auto& bounds : centroid_bounds) {
+      centroid_min = glm::min( centroid_min, bounds.first );
+      centroid_max = glm::max( centroid_max, bounds.second );
+   }
+
+   const glm::vec3 scale = getBinScale( centroid_min, centroid_max );
+   std::vector<Bins> block_bins(block_num);
+   pool.run(
+      block_num, [&](int b) {
+         const int block_begin = begin + b * BlockReferenceNum;
+         const int block_count = std::min( BlockReferenceNum, end - block_begin );
+         addToBins( block_bins[b], References.data() + block_begin, block_count, centroid_min, scale );
+      }
+   );
+   Bins bins;
+   for (const auto& block : block_bins) {
+      for (int a = 0; a < 3; ++a) {
+         for (int b = 0; b < BinNum; ++b) {
+            bins[a][b].Min = glm::min( bins[a][b].Min, block[a][b].Min );
+            bins[a][b].Max = glm::max( bins[a][b].Max, block[a][b].Max );
+            bins[a][b].Count += block[a][b].Count;
+         }
+      }
+   }
+   return chooseSplit( axis, position, bins, centroid_min, centroid_max, count, node, LeafSize );
+}
+
+bool BVH::findSplit(
+   int& axis,
+   float& position,
+   const Reference* references,
+   int count,
+   const BVHNode& node,
+   int leaf_size
+)
+{
+   glm::vec3 centroid_min, centroid_max;
+   getCentroidBounds( centroid_min, centroid_max, references, count );
+   Bins bins;
+   addToBins( bins, references, count, centroid_min, getBinScale( centroid_min, centroid_max ) );
+   return chooseSplit( axis, position, bins, centroid_min, centroid_max, count, node, leaf_size );
+}
+
+bool BVH::chooseSplit(
+   int& axis,
+   float& position,
+   const Bins& bins,
+   const glm::vec3& centroid_min,
+   const glm::vec3& centroid_max,
+   int count,
+   const BVHNode& node,
+   int leaf_size
+)
+{
+   float best_cost = std::numeric_limits<float>::max();
+   for (int a = 0; a < 3; ++a) {
+      const float extent = centroid_max[a] - centroid_min[a];
+      if (extent <= 0.0f) continue;
+
+      const float scale = static_cast<float>(BinNum) / extent;
+
+      // sweeping from the right first leaves the right side of every plane ready for the sweep from the left.
+      std::array<float, BinNum - 1> right_areas{};
+      std::array<int, BinNum - 1> right_counts{};
+      Bin right;
+      for (int b = BinNum - 1; b > 0; --b) {
+         right.Min = glm::min( right.Min, bins[a][b].Min );
+         right.Max = glm::max( right.Max, bins[a][b].Max );
+         right.Count += bins[a][b].Count;
+         right_areas[b - 1] = getSurfaceArea( right.Min, right.Max );
+         right_counts[b - 1] = right.Count;
+      }
+      Bin left;
+      for (int b = 0; b < BinNum - 1; ++b) {
+         left.Min = glm::min( left.Min, bins[a][b].Min );
+         left.Max = glm::max( left.Max, bins[a][b].Max );
+         left.Count += bins[a][b].Count;
+         if (left.Count == 0 || right_counts[b] == 0) continue;
+
+         const float cost = getSurfaceArea( left.Min, left.Max ) * static_cast<float>(left.Count) +
+            right_areas[b] * static_cast<float>(right_counts[b]);
+         if (cost < best_cost) {
+            best_cost = cost;
+            axis = a;
+            position = centroid_min[a] + static_cast<float>(b + 1) / scale;
+         }
+      }
+   }
+
+   const float area = getSurfaceArea( node.Min, node.Max );
+   const float leaf_cost = IntersectionCost * static_cast<float>(count);
+   if (best_cost == std::numeric_limits<float>::max()) {
+      // the centroids coincide, so no plane separates them, but a big leaf still has to be halved.
+      if (count <= leaf_size) return false;
+      const glm::vec3 extent = node.Max - node.Min;
+      axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+      position = centroid_min[axis];
+      return true;
+   }
+   const float split_cost = TraversalCost + IntersectionCost * best_cost / std::max( area, std::numeric_limits<float>::min() );
+   return split_cost < leaf_cost || count > leaf_size;
+}
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include "bvh_optimizer.h"
+
+BVHOptimizer::BVHOptimizer(std::vector<BVHNode> nodes) : Nodes( std::move( nodes ) )
+{
+}
+
+bool BVHOptimizer::hitBox(const Ray& ray, const glm::vec3& min, const glm::vec3& max)
+{
+   // the same slab test as hitBox in scene.glsl.
+   const glm::vec3 t0 = (min - ray.Origin) * ray.InverseDirection;
+   const glm::vec3 t1 = (max - ray.Origin) * ray.InverseDirection;
+   const glm::vec3 near = glm::min( t0, t1 );
+   const glm::vec3 far = glm::max( t0, t1 );
+   const float distance = std::max( std::max( near.x, near.y ), std::max( near.z, ray.MinT ) );
+   return distance <= std::min( std::min( far.x, far.y ), std::min( far.z, ray.MaxT ) );
+}
+
+void BVHOptimizer::addRay(const RaySegment& ray)
+{
+   if (Nodes.empty()) return;
+
+   const Ray r{ ray.Origin, 1.0f / ray.Direction, ray.MinT, ray.MaxT };
+   if (!hitBox( r, Nodes[0].Min, Nodes[0].Max )) return;
+
+   Rays.emplace_back( r );
+   VisitsFound = false;
+}
+
+void BVHOptimizer::findVisits()
+{
+   // a child lies in the box of its parent, so only the rays of the parent can cross it.
+   Visits.assign( Nodes.size(), {} );
+   if (Nodes.empty()) return;
+
+   Visits[0].resize( Rays.size() );
+   std::iota( Visits[0].begin(), Visits[0].end(), 0 );
+   std::vector<int> stack = { 0 };
+   while (!stack.empty()) {
+      const int index = stack.back();
+      stack.pop_back();
+      const BVHNode& node = Nodes[index];
+      if (node.isLeaf()) continue;
+
+      for (const int child : { node.Offset, -node.Count }) {
+         for (const int ray : Visits[index]) {
+            if (hitBox( Rays[ray], Nodes[child].Min, Nodes[child].Max )) Visits[child].emplace_back( ray );
+         }
+         stack.emplace_back( child );
+      }
+   }
+   VisitsFound = true;
+}
+
+int BVHOptimizer::getVisitNum(int node_index, const glm::vec3& min, const glm::vec3& max) const
+{
+   return static_cast<int>(std::count_if(
+      Visits[node_index].begin(), Visits[node_index].end(), [&](int ray) { return hitBox( Rays[ray], min, max ); }
+   ));
+}
+
+double BVHOptimizer::getCost()
+{
+   if (!VisitsFound) findVisits();
+
+   double cost = 0.0;
+   for (size_t i = 0; i < Nodes.size(); ++i) {
+      const auto visit_num = static_cast<double>(Visits[i].size());
+      cost += Nodes[i].isLeaf() ? BVH::IntersectionCost * static_cast<double>(Nodes[i].Count) * visit_num : BVH::TraversalCost * visit_num;
+   }
+   return cost;
+}
+
+int BVHOptimizer::rotate()
+{
+   if (Nodes.empty() || Rays.empty()) return 0;
+   if (!VisitsFound) findVisits();
+
+   int rotation_num = 0;
+   std::vector<int> depths(Nodes.size()), heights(Nodes.size());
+   for (int pass = 0; pass < MaxPassNum; ++pass) {
+      // the children are visited before their parents, so the heights below a node are up to date when it is rotated.
+      std::vector<int> order;
+      std::vector<int> stack = { 0 };
+      depths[0] = 0;
+      while (!stack.empty()) {
+         const int index = stack.back();
+         stack.pop_back();
+         order.emplace_back( index );
+         const BVHNode& node = Nodes[index];
+         if (node.isLeaf()) continue;
+
+         for (const int child : { node.Offset, -node.Count }) {
+            depths[child] = depths[index] + 1;
+            stack.emplace_back( child );
+         }
+      }
+
+      int pass_rotation_num = 0;
+      for (auto it = order.rbegin(); it != order.rend(); ++it) {
+         const int index = *it;
+         BVHNode& node = Nodes[index];
+         if (node.isLeaf()) {
+            heights[index] = 0;
+            continue;
+         }
+
+         // the child B on side s takes the other child A, and gives up its child G on side g to the node.
+         const std::array<int, 2> children = { node.Offset, -node.Count };
+         int best_side = -1, best_grandchild = -1, best_visit_num = 0;
+         glm::vec3 best_min, best_max;
+         for (int s = 0; s < 2; ++s) {
+            const int a = children[1 - s];
+            const BVHNode& b = Nodes[children[s]];
+            if (b.isLeaf() || depths[index] + 2 + heights[a] > BVH::MaxDepth) continue;
+
+            const std::array<int, 2> grandchildren = { b.Offset, -b.Count };
+            for (int g = 0; g < 2; ++g) {
+               const int k = grandchildren[1 - g];
+               const glm::vec3 min = glm::min( Nodes[a].Min, Nodes[k].Min );
+               const glm::vec3 max = glm::max( Nodes[a].Max, Nodes[k].Max );
+               const int visit_num = getVisitNum( index, min, max );
+               const int gain = static_cast<int>(Visits[children[s]].size()) - visit_num;
+               if (gain > 0 && (best_side < 0 || visit_num < best_visit_num)) {
+                  best_side = s;
+                  best_grandchild = g;
+                  best_visit_num = visit_num;
+                  best_min = min;
+                  best_max = max;
+               }
+            }
+         }
+
+         if (best_side >= 0) {
+            const int a = children[1 - best_side];
+            const int b = children[best_side];
+            const std::array<int, 2> grandchildren = { Nodes[b].Offset, -Nodes[b].Count };
+            const int g = grandchildren[best_grandchild];
+            const int k = grandchildren[1 - best_grandchild];
+            Nodes[b].Min = best_min;
+            Nodes[b].Max = best_max;
+            Nodes[b].Offset = a;
+            Nodes[b].Count = -k;
+            node.Offset = best_side == 0 ? b : g;
+            node.Count = -(best_side == 0 ? g : b);
+            std::vector<int> visits;
+            for (const int ray : Visits[index]) {
+               if (hitBox( Rays[ray], best_min, best_max )) visits.emplace_back( ray );
+            }
+            Visits[b] = std::move( visits );
+            heights[b] = 1 + std::max( heights[a], heights[k] );
+            pass_rotation_num++;
+         }
+         heights[index] = 1 + std::max( heights[node.Offset], heights[-node.Count] );
+      }
+      rotation_num += pass_rotation_num;
+      if (pass_rotation_num == 0) break;
+   }
+   return rotation_num;
+}
+
+void BVHOptimizer::reorder()
+{
+   if (Nodes.empty()) return;
+   if (!VisitsFound) findVisits();
+
+   std::vector<int> order;
+   std::vector<int> stack = { 0 };
+   while (!stack.empty()) {
+      const int index = stack.back();
+      stack.pop_back();
+      order.emplace_back( index );
+      const BVHNode& node = Nodes[index];
+      if (node.isLeaf()) continue;
+
+      int hot = node.Offset, cold = -node.Count;
+      if (Visits[cold].size() > Visits[hot].size()) std::swap( hot, cold );
+      stack.emplace_back( cold );
+      stack.emplace_back( hot );
+   }
+
+   std::vector<int> new_indices(Nodes.size(), -1);
+   for (size_t i = 0; i < order.size(); ++i) new_indices[order[i]] = static_cast<int>(i);
+   std::vector<BVHNode> nodes;
+   std::vector<std::vector<int>> visits;
+   nodes.reserve( order.size() );
+   visits.reserve( order.size() );
+   for (const int index : order) {
+      BVHNode node = Nodes[index];
+      if (!node.isLeaf()) {
+         node.Offset = new_indices[node.Offset];
+         node.Count = -new_indices[-node.Count];
+      }
+      nodes.emplace_back( node );
+      visits.emplace_back( std::move( Visits[index] ) );
+   }
+   Nodes = std::move( nodes );
+   Visits = std::move( visits );
+}
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include "cache_layout.h"
+
+void CacheLayout::cluster(std::vector<int>& order, int first_line, const ChildLineGetter& get_child_lines)
+{
+   std::vector<Line> child_lines;
+   std::vector<Line> seeds = { Line(0.0f, first_line) };
+   std::priority_queue<Line> frontier;
+   while (!seeds.empty()) {
+      frontier.emplace( seeds.back() );
+      seeds.pop_back();
+      for (int i = 0; i < ClusterLineNum && !frontier.empty(); ++i) {
+         const int line = frontier.top().Index;
+         frontier.pop();
+         order.emplace_back( line );
+         child_lines.clear();
+         get_child_lines( child_lines, line );
+         for (const auto& child_line : child_lines) frontier.emplace( child_line );
+      }
+
+      // the largest of the lines left out ends up on the top of the stack, so its cluster comes right after this one.
+      const auto first_seed = static_cast<std::ptrdiff_t>(seeds.size());
+      for (; !frontier.empty(); frontier.pop()) seeds.emplace_back( frontier.top() );
+      std::reverse( seeds.begin() + first_seed, seeds.end() );
+   }
+}
+
+void CacheLayout::layOut(
+   BVHNodes& laid_out,
+   std::vector<int>& old_indices,
+   std::vector<Instance>& instances,
+   const std::vector<BVHNode>& nodes
+)
+{
+   static_assert( 2 * sizeof( BVHNode ) == LineSize, "two binary nodes fill a cache line" );
+
+   laid_out.clear();
+   old_indices.clear();
+   if (nodes.empty()) return;
+
+   std::vector<int> new_indices(nodes.size(), -1);
+   const auto add_line = [&](int first, int second) {
+      for (const int index : { first, second }) {
+         const bool added = index >= 0 && new_indices[index] < 0;
+         if (added) new_indices[index] = static_cast<int>(old_indices.size());
+         old_indices.emplace_back( added ? index : -1 );
+      }
+   };
+   // the line of an inner node is the one of its children.
+   const auto get_child_lines = [&nodes](std::vector<Line>& child_lines, int line) {
+      for (const int child : { nodes[line].Offset, -nodes[line].Count }) {
+         const BVHNode& node = nodes[child];
+         if (!node.isLeaf()) child_lines.emplace_back( BVH::getSurfaceArea( node.Min, node.Max ), child );
+      }
+   };
+
+   std::vector<int> roots = { 0 };
+   for (const auto& instance : instances) {
+      if (instance.Root >= 0) roots.emplace_back( instance.Root );
+   }
+   std::vector<int> order;
+   for (const int root : roots) {
+      if (new_indices[root] >= 0) continue;
+
+      add_line( root, -1 );
+      if (nodes[root].isLeaf()) continue;
+
+      order.clear();
+      cluster( order, root, get_child_lines );
+      for (const int line : order) add_line( nodes[line].Offset, -nodes[line].Count );
+   }
+
+   laid_out.resize( old_indices.size() );
+   for (size_t i = 0; i < old_indices.size(); ++i) {
+      if (old_indices[i] < 0) continue;
+
+      BVHNode node = nodes[old_indices[i]];
+      if (!node.isLeaf()) {
+         node.Offset = new_indices[node.Offset];
+         node.Count = -new_indices[-node.Count];
+      }
+      laid_out[i] = node;
+   }
+   for (auto& instance : instances) {
+      if (instance.Root >= 0) instance.Root = new_indices[instance.Root];
+   }
+}
+
+void CacheLayout::layOut(WideBVHNodes& laid_out, std::vector<Instance>& instances, const std::vector<WideBVHNode>& nodes)
+{
+   static_assert( sizeof( WideBVHNode ) == LineSize, "a wide node fills a cache line" );
+
+   laid_out.clear();
+   if (nodes.empty()) return;
+
+   const auto get_child_lines = [&nodes](std::vector<Line>& child_lines, int line) {
+      const WideBVHNode& node = nodes[line];
+      for (int i = 0; i < WideBVH::ChildNum; ++i) {
+         if (((node.Counts >> (8 * i)) & 0xFFu) != WideBVH::InnerChild) continue;
+
+         glm::vec3 min, max;
+         for (int a = 0; a < 3; ++a) {
+            const float scale = WideBVH::getScale( node.Exponents, a );
+            min[a] = node.Origin[a] + static_cast<float>((node.Planes[a] >> (8 * i)) & 0xFFu) * scale;
+            max[a] = node.Origin[a] + static_cast<float>((node.Planes[a + 3] >> (8 * i)) & 0xFFu) * scale;
+         }
+         child_lines.emplace_back( BVH::getSurfaceArea( min, max ), node.Child[i] );
+      }
+   };
+
+   std::vector<int> order;
+   std::vector<int> new_indices(nodes.size(), -1);
+   for (const auto& instance : instances) {
+      if (instance.WideRoot < 0 || new_indices[instance.WideRoot] >= 0) continue;
+
+      const size_t first = order.size();
+      cluster( order, instance.WideRoot, get_child_lines );
+      for (size_t i = first; i < order.size(); ++i) new_indices[order[i]] = static_cast<int>(i);
+   }
+
+   laid_out.resize( order.size() );
+   for (size_t i = 0; i < order.size(); ++i) {
+      WideBVHNode node = nodes[order[i]];
+      for (int c = 0; c < WideBVH::ChildNum; ++c) {
+         if (((node.Counts >> (8 * c)) & 0xFFu) == WideBVH::InnerChild) node.Child[c] = new_indices[node.Child[c]];
+      }
+      laid_out[i] = node;
+   }
+   for (auto& instance : instances) {
+      if (instance.WideRoot >= 0) instance.WideRoot = new_indices[instance.WideRoot];
+   }
+}
\ No newline at end of file
@@ -1,6 +1,6 @@
 #include "canvas.h"
    
-CanvasGL::CanvasGL() : CanvasID( 0 ), COLOR0TextureID( 0 ), StencilTextureID( 0 )
+CanvasGL::CanvasGL() : CanvasID( 0 ), COLOR0TextureID( 0 ), StencilTextureID( 0 ), DepthTextureID( 0 )
 {
 }
 
@@ -19,6 +19,14 @@ void CanvasGL::deleteAllTextures()
       glDeleteTextures( 1, &StencilTextureID );
       StencilTextureID = 0;
    }
+   if (DepthTextureID != 0) {
+      glDeleteTextures( 1, &DepthTextureID );
+      DepthTextureID = 0;
+   }
+   if (!ColorTextureIDs.empty()) {
+      glDeleteTextures( static_cast<GLsizei>(ColorTextureIDs.size()), ColorTextureIDs.data() );
+      ColorTextureIDs.clear();
+   }
    if (CanvasID != 0) {
       glDeleteFramebuffers( 1, &CanvasID );
       CanvasID = 0;
@@ -80,6 +88,44 @@ void CanvasGL::setMultiSampledCanvas(int width, int height, int sample_num, GLen
    glCheckNamedFramebufferStatus( CanvasID, GL_FRAMEBUFFER );
 }
 
+void CanvasGL::setMultipleRenderTargetCanvas(int width, int height, const std::vector<GLenum>& formats, bool use_depth)
+{
+   deleteAllTextures();
+
+   glCreateFramebuffers( 1, &CanvasID );
+
+   std::vector<GLenum> draw_buffers;
+   for (size_t i = 0; i < formats.size(); ++i) {
+      GLuint texture_id;
+      glCreateTextures( GL_TEXTURE_2D, 1, &texture_id );
+      glTextureStorage2D( texture_id, 1, formats[i], width, height );
+      glTextureParameteri( texture_id, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+      glTextureParameteri( texture_id, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+      glTextureParameteri( texture_id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+      glTextureParameteri( texture_id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+
+      const auto attachment = static_cast<GLenum>(GL_COLOR_ATTACHMENT0 + i);
+      glNamedFramebufferTexture( CanvasID, attachment, texture_id, 0 );
+      draw_buffers.emplace_back( attachment );
+      if (i == 0) COLOR0TextureID = texture_id;
+      else ColorTextureIDs.emplace_back( texture_id );
+   }
+   glNamedFramebufferDrawBuffers( CanvasID, static_cast<GLsizei>(draw_buffers.size()), draw_buffers.data() );
+
+   if (use_depth) {
+      glCreateTextures( GL_TEXTURE_2D, 1, &DepthTextureID );
+      glTextureStorage2D( DepthTextureID, 1, GL_DEPTH_COMPONENT32F, width, height );
+      glTextureParameteri( DepthTextureID, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+      glTextureParameteri( DepthTextureID, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+      glTextureParameteri( DepthTextureID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+      glTextureParameteri( DepthTextureID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+
+      glNamedFramebufferTexture( CanvasID, GL_DEPTH_ATTACHMENT, DepthTextureID, 0 );
+   }
+
+   glCheckNamedFramebufferStatus( CanvasID, GL_FRAMEBUFFER );
+}
+
 void CanvasGL::clearColor(int buffer_index) const
 {
    constexpr std::array<GLfloat, 4> clear_color = {
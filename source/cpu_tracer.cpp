@@ -0,0 +1,1250 @@
+#include "cpu_tracer.h"
+
+#include <immintrin.h>
+
+CPUTracer::CPUTracer() :
+   Lazy( false ), SimdSupported( __builtin_cpu_supports( "avx2" ) != 0 ),
+   ThreadNum( std::max( static_cast<int>(std::thread::hardware_concurrency()), 1 ) ), CopiedScene( nullptr ),
+   CopiedVersion( 0 ), CopiedOptions( 0 ), BufferNodeNum( 0 )
+{
+}
+
+void CPUTracer::setScene(
+   const AccelerationStructureGL& scene,
+   const std::vector<Material>& materials,
+   bool cache_layout,
+   bool eight_wide
+)
+{
+   Lazy = false;
+   Materials = materials;
+   const int options = (cache_layout ? 1 : 0) | (eight_wide ? 2 : 0);
+   if (isCopied( scene, options )) return;
+
+   std::vector<BVHNode> nodes;
+   std::vector<WideBVHNode> wide_nodes;
+   readBuffer( Spheres, scene.getSphereBuffer() );
+   readBuffer( Vertices, scene.getVertexBuffer() );
+   readBuffer( Triangles, scene.getTriangleBuffer() );
+   readBuffer( nodes, scene.getNodeBuffer() );
+   readBuffer( Primitives, scene.getPrimitiveBuffer() );
+   readBuffer( Instances, scene.getInstanceBuffer() );
+   readBuffer( wide_nodes, scene.getWideNodeBuffer() );
+   readBuffer( GridCells, scene.getGridCellBuffer() );
+
+   // the 8-wide trees are converted before the layout moves the roots of the instances, and the instances of
+   // a geometry share its tree.
+   Wide8Nodes.clear();
+   Wide8Roots.assign( Instances.size(), -1 );
+   if (eight_wide && SimdSupported) {
+      WideBVH8 wide;
+      std::map<int, int> wide_roots;
+      for (size_t i = 0; i < Instances.size(); ++i) {
+         const int root = Instances[i].Root;
+         if (root < 0 || Instances[i].Grid >= 0) continue;
+
+         auto it = wide_roots.find( root );
+         if (it == wide_roots.end()) {
+            wide.convert( nodes, root );
+            const int wide_root = wide.getNodes().empty() ? -1 : static_cast<int>(Wide8Nodes.size());
+            for (WideBVH8Node node : wide.getNodes()) {
+               for (int c = 0; c < WideBVH8::ChildNum; ++c) {
+                  if (node.Counts[c] == WideBVH::InnerChild) node.Child[c] += wide_root;
+               }
+               Wide8Nodes.emplace_back( node );
+            }
+            it = wide_roots.emplace( root, wide_root ).first;
+         }
+         Wide8Roots[i] = it->second;
+      }
+   }
+
+   BufferNodeNum = static_cast<int>(nodes.size());
+   if (cache_layout) {
+      CacheLayout::layOut( Nodes, BufferNodeIndices, Instances, nodes );
+      CacheLayout::layOut( WideNodes, Instances, wide_nodes );
+   }
+   else {
+      Nodes.assign( nodes.begin(), nodes.end() );
+      BufferNodeIndices.resize( nodes.size() );
+      std::iota( BufferNodeIndices.begin(), BufferNodeIndices.end(), 0 );
+      WideNodes.assign( wide_nodes.begin(), wide_nodes.end() );
+   }
+   CopiedScene = &scene;
+   CopiedVersion = scene.getVersion();
+   CopiedOptions = options;
+}
+
+void CPUTracer::setLazyScene(const AccelerationStructureGL& scene, const std::vector<Material>& materials)
+{
+   // the primitives keep their indices in the whole scene, so the leaves refer to them as the buffers do.
+   // the nodes which the earlier frames have split are kept until the scene changes.
+   Lazy = true;
+   Materials = materials;
+   if (isCopied( scene, LazyCopy )) return;
+
+   const ArrayView<Sphere> spheres = scene.getSpheres();
+   const ArrayView<Vertex> vertices = scene.getVertices();
+   const ArrayView<Triangle> triangles = scene.getTriangles();
+   Spheres.assign( spheres.begin(), spheres.end() );
+   Vertices.assign( vertices.begin(), vertices.end() );
+   Triangles.assign( triangles.begin(), triangles.end() );
+
+   LazyGeometries.resize( static_cast<size_t>(scene.getGeometryNum()) );
+   for (int g = 0; g < scene.getGeometryNum(); ++g) {
+      const auto& geometry = scene.getGeometry( g );
+      std::vector<BVH::Reference> references;
+      references.reserve( static_cast<size_t>(geometry.SphereNum + geometry.TriangleNum) );
+      for (int i = geometry.SphereOffset; i < geometry.SphereOffset + geometry.SphereNum; ++i) {
+         const glm::vec3 radius(Spheres[i].Radius);
+         references.push_back(
+            { Spheres[i].Center - radius, Spheres[i].Center + radius, Spheres[i].Center, static_cast<uint>(i) | BVH::SpherePrimitive }
+         );
+      }
+      for (int i = geometry.TriangleOffset; i < geometry.TriangleOffset + geometry.TriangleNum; ++i) {
+         const glm::vec3& a = Vertices[Triangles[i].Indices[0]].Position;
+         const glm::vec3& b = Vertices[Triangles[i].Indices[1]].Position;
+         const glm::vec3& c = Vertices[Triangles[i].Indices[2]].Position;
+         const glm::vec3 min = glm::min( a, glm::min( b, c ) );
+         const glm::vec3 max = glm::max( a, glm::max( b, c ) );
+         references.push_back( { min, max, 0.5f * (min + max), static_cast<uint>(i) } );
+      }
+      if (LazyGeometries[g] == nullptr) LazyGeometries[g] = std::make_unique<LazyBVH>();
+      LazyGeometries[g]->reset( std::move( references ), BVH::MaxLeafSize );
+   }
+
+   std::vector<BVH::Reference> references;
+   LazyInstances.resize( static_cast<size_t>(scene.getInstanceNum()) );
+   for (int i = 0; i < scene.getInstanceNum(); ++i) {
+      const glm::mat4& to_world = scene.getInstanceTransform( i );
+      const glm::mat4 to_object = glm::inverse( to_world );
+      LazyInstance& instance = LazyInstances[i];
+      for (int r = 0; r < 3; ++r) instance.WorldToObject[r] = glm::row( to_object, r );
+      instance.Geometry = scene.getInstanceGeometry( i );
+      instance.MaterialIndex = scene.getInstanceMaterial( i );
+
+      const BoundingBox bounds = LazyGeometries[instance.Geometry]->getBounds();
+      BVH::Reference reference{
+         glm::vec3(std::numeric_limits<float>::max()), glm::vec3(std::numeric_limits<float>::lowest()), glm::vec3(0.0f),
+         static_cast<uint>(i)
+      };
+      for (int corner = 0; corner < 8; ++corner) {
+         const glm::vec3 point(
+            (corner & 1) != 0 ? bounds.Max.x : bounds.Min.x,
+            (corner & 2) != 0 ? bounds.Max.y : bounds.Min.y,
+            (corner & 4) != 0 ? bounds.Max.z : bounds.Min.z
+         );
+         const glm::vec3 world = glm::vec3(to_world * glm::vec4(point, 1.0f));
+         reference.Min = glm::min( reference.Min, world );
+         reference.Max = glm::max( reference.Max, world );
+      }
+      reference.Centroid = 0.5f * (reference.Min + reference.Max);
+      references.emplace_back( reference );
+   }
+   LazyTopLevel.reset( std::move( references ), 1 );
+   CopiedScene = &scene;
+   CopiedVersion = scene.getVersion();
+   CopiedOptions = LazyCopy;
+}
+
+int CPUTracer::getBuiltNodeNum() const
+{
+   int num = LazyTopLevel.getBuiltNodeNum();
+   for (const auto& geometry : LazyGeometries) num += geometry->getBuiltNodeNum();
+   return num;
+}
+
+int CPUTracer::getMaxNodeNum() const
+{
+   int num = LazyTopLevel.getMaxNodeNum();
+   for (const auto& geometry : LazyGeometries) num += geometry->getMaxNodeNum();
+   return num;
+}
+
+float CPUTracer::getRandomFloat(uint& seed)
+{
+   seed = (seed ^ 61u) ^ (seed >> 16u);
+   seed *= 9u;
+   seed = seed ^ (seed >> 4u);
+   seed *= 0x27d4eb2du;
+   seed = seed ^ (seed >> 15u);
+   return static_cast<float>(seed) / 4294967296.0f;
+}
+
+glm::vec3 CPUTracer::getRandomPointInUnitSphere(uint& seed)
+{
+   const float two_pi = 6.28318530718f;
+   glm::vec3 point(getRandomFloat( seed ), getRandomFloat( seed ), getRandomFloat( seed ));
+   point = point * glm::vec3(2.0f, two_pi, 1.0f) - glm::vec3(1.0f, 0.0f, 0.0f);
+   const float phi = point.y;
+   const float r = std::pow( point.z, 1.0f / 3.0f );
+   const float s = std::sqrt( 1.0f - point.x * point.x );
+   return r * glm::vec3(s * std::sin( phi ), s * std::cos( phi ), point.x);
+}
+
+uint CPUTracer::getSeed(const glm::ivec2& pixel, int frame_index)
+{
+   return (static_cast<uint>(pixel.x) * 1973u + static_cast<uint>(pixel.y) * 9277u + static_cast<uint>(frame_index) * 26699u) | 1u;
+}
+
+glm::vec3 CPUTracer::getPrimaryRayDirection(uint& seed, const glm::ivec2& pixel, const glm::ivec2& image_size)
+{
+   const float jitter_x = getRandomFloat( seed );
+   const float jitter_y = getRandomFloat( seed );
+   return {
+      (2.0f * (static_cast<float>(pixel.x) + jitter_x) - static_cast<float>(image_size.x)) / static_cast<float>(image_size.y),
+      (2.0f * (static_cast<float>(pixel.y) + jitter_y) - static_cast<float>(image_size.y)) / static_cast<float>(image_size.y),
+      -1.0f
+   };
+}
+
+glm::vec3 CPUTracer::getBackgroundColor(const glm::vec3& ray_direction)
+{
+   const glm::vec3 direction = glm::normalize( ray_direction );
+   const float t = 0.5f * direction.y + 0.5f;
+   return glm::mix( glm::vec3(1.0f), glm::vec3(0.5f, 0.7f, 1.0f), t );
+}
+
+bool CPUTracer::scatter(glm::vec3& ray_origin, glm::vec3& ray_direction, uint& seed, Material::TYPE type, const Hit& hit)
+{
+   if (type == Material::TYPE::METAL) {
+      const glm::vec3 reflected = glm::reflect( glm::normalize( ray_direction ), hit.Normal );
+      ray_origin = hit.Position;
+      ray_direction = reflected + 0.02f * getRandomPointInUnitSphere( seed );
+      return glm::dot( ray_direction, hit.Normal ) > 0.0f;
+   }
+   ray_origin = hit.Position;
+   ray_direction = hit.Normal + getRandomPointInUnitSphere( seed );
+   return true;
+}
+
+bool CPUTracer::hitSphere(
+   float& t,
+   Hit& hit,
+   const glm::vec3& ray_origin,
+   const glm::vec3& ray_direction,
+   float t_min,
+   float t_max,
+   int index
+) const
+{
+   const float epsilon = 1e-4f;
+   const Sphere& sphere = Spheres[index];
+   const glm::vec3 oc = ray_origin - sphere.Center;
+   const float a = glm::dot( ray_direction, ray_direction );
+   const float b = glm::dot( oc, ray_direction );
+   const float c = glm::dot( oc, oc ) - sphere.Radius * sphere.Radius;
+   float discriminant = b * b - a * c;
+
+   float t1 = t_max, t2 = t_max;
+   if (std::abs( a ) < epsilon) {
+      if (std::abs( b ) >= epsilon) t1 = -0.5f * c / b;
+   }
+   else if (std::abs( discriminant ) < epsilon) t1 = -b / a;
+   else if (discriminant > 0.0f) {
+      discriminant = std::sqrt( discriminant );
+      const float n = b >= 0.0f ? -(discriminant + b) : (discriminant - b);
+      t1 = c / n;
+      t2 = n / a;
+   }
+
+   if (t_min < t1 && t1 < t_max) t = t1;
+   else if (t_min < t2 && t2 < t_max) t = t2;
+   else return false;
+
+   hit.Material = sphere.MaterialIndex;
+   hit.Position = ray_origin + t * ray_direction;
+   hit.Normal = (hit.Position - sphere.Center) / sphere.Radius;
+   return true;
+}
+
+bool CPUTracer::hitTriangle(
+   float& t,
+   Hit& hit,
+   const glm::vec3& ray_origin,
+   const glm::vec3& ray_direction,
+   float t_min,
+   float t_max,
+   int index
+) const
+{
+   const Triangle& triangle = Triangles[index];
+   const Vertex& v0 = Vertices[triangle.Indices[0]];
+   const Vertex& v1 = Vertices[triangle.Indices[1]];
+   const Vertex& v2 = Vertices[triangle.Indices[2]];
+
+   const glm::vec3 d = glm::abs( ray_direction );
+   const int kz = d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+   int kx = kz == 2 ? 0 : kz + 1;
+   int ky = kx == 2 ? 0 : kx + 1;
+   if (ray_direction[kz] < 0.0f) std::swap( kx, ky );
+   const float sx = ray_direction[kx] / ray_direction[kz];
+   const float sy = ray_direction[ky] / ray_direction[kz];
+   const float sz = 1.0f / ray_direction[kz];
+
+   const glm::vec3 a = v0.Position - ray_origin;
+   const glm::vec3 b = v1.Position - ray_origin;
+   const glm::vec3 c = v2.Position - ray_origin;
+   const float ax = a[kx] - sx * a[kz];
+   const float ay = a[ky] - sy * a[kz];
+   const float bx = b[kx] - sx * b[kz];
+   const float by = b[ky] - sy * b[kz];
+   const float cx = c[kx] - sx * c[kz];
+   const float cy = c[ky] - sy * c[kz];
+   float u = cx * by - cy * bx;
+   float v = ax * cy - ay * cx;
+   float w = bx * ay - by * ax;
+   if (u == 0.0f || v == 0.0f || w == 0.0f) {
+      u = static_cast<float>(static_cast<double>(cx) * by - static_cast<double>(cy) * bx);
+      v = static_cast<float>(static_cast<double>(ax) * cy - static_cast<double>(ay) * cx);
+      w = static_cast<float>(static_cast<double>(bx) * ay - static_cast<double>(by) * ax);
+   }
+   if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f)) return false;
+
+   const float determinant = u + v + w;
+   if (determinant == 0.0f) return false;
+
+   const float scaled_t = u * sz * a[kz] + v * sz * b[kz] + w * sz * c[kz];
+   const float hit_t = scaled_t / determinant;
+   if (hit_t <= t_min || t_max <= hit_t) return false;
+
+   t = hit_t;
+   hit.Material = triangle.MaterialIndex;
+   hit.Position = ray_origin + t * ray_direction;
+   hit.Normal = glm::normalize( (u * v0.Normal + v * v1.Normal + w * v2.Normal) / determinant );
+   glm::vec3 face_normal = glm::cross( v1.Position - v0.Position, v2.Position - v0.Position );
+   if (glm::dot( face_normal, ray_direction ) > 0.0f) face_normal = -face_normal;
+   if (glm::dot( hit.Normal, face_normal ) < 0.0f) hit.Normal = -hit.Normal;
+   return true;
+}
+
+bool CPUTracer::hitPrimitive(
+   float& t,
+   Hit& hit,
+   const glm::vec3& ray_origin,
+   const glm::vec3& ray_direction,
+   float t_min,
+   float t_max,
+   uint primitive
+) const
+{
+   if ((primitive & BVH::SpherePrimitive) != 0u) {
+      const auto index = static_cast<int>(primitive & ~BVH::SpherePrimitive);
+      return hitSphere( t, hit, ray_origin, ray_direction, t_min, t_max, index );
+   }
+   return hitTriangle( t, hit, ray_origin, ray_direction, t_min, t_max, static_cast<int>(primitive) );
+}
+
+bool CPUTracer::hitBox(
+   float& distance,
+   const glm::vec3& ray_origin,
+   const glm::vec3& inverse_direction,
+   float t_min,
+   float t_max,
+   const BoundingBox& box
+)
+{
+   const glm::vec3 t0 = (box.Min - ray_origin) * inverse_direction;
+   const glm::vec3 t1 = (box.Max - ray_origin) * inverse_direction;
+   const glm::vec3 near = glm::min( t0, t1 );
+   const glm::vec3 far = glm::max( t0, t1 );
+   distance = std::max( std::max( near.x, near.y ), std::max( near.z, t_min ) );
+   return distance <= std::min( std::min( far.x, far.y ), std::min( far.z, t_max ) );
+}
+
+bool CPUTracer::hitWideBVH(
+   float& closest_so_far,
+   Hit& hit,
+   const glm::vec3& ray_origin,
+   const glm::vec3& ray_direction,
+   const glm::vec3& inverse_direction,
+   float t_min,
+   int root
+) const
+{
+   float t;
+   bool hit_anything = false;
+   std::array<int, WideStackSize> stack;
+   int top = 0;
+   int index = root;
+   const auto get_child_planes = [](uint plane, float origin, float scale) {
+      return origin + glm::vec4(glm::uvec4(plane, plane >> 8u, plane >> 16u, plane >> 24u) & 0xFFu) * scale;
+   };
+   while (true) {
+      const WideBVHNode& node = WideNodes[index];
+      const glm::vec3 scale(
+         WideBVH::getScale( node.Exponents, 0 ), WideBVH::getScale( node.Exponents, 1 ), WideBVH::getScale( node.Exponents, 2 )
+      );
+      const glm::vec4 t0x = (get_child_planes( node.Planes[0], node.Origin.x, scale.x ) - ray_origin.x) * inverse_direction.x;
+      const glm::vec4 t0y = (get_child_planes( node.Planes[1], node.Origin.y, scale.y ) - ray_origin.y) * inverse_direction.y;
+      const glm::vec4 t0z = (get_child_planes( node.Planes[2], node.Origin.z, scale.z ) - ray_origin.z) * inverse_direction.z;
+      const glm::vec4 t1x = (get_child_planes( node.Planes[3], node.Origin.x, scale.x ) - ray_origin.x) * inverse_direction.x;
+      const glm::vec4 t1y = (get_child_planes( node.Planes[4], node.Origin.y, scale.y ) - ray_origin.y) * inverse_direction.y;
+      const glm::vec4 t1z = (get_child_planes( node.Planes[5], node.Origin.z, scale.z ) - ray_origin.z) * inverse_direction.z;
+      const glm::vec4 near = glm::max( glm::max( glm::min( t0x, t1x ), glm::min( t0y, t1y ) ), glm::max( glm::min( t0z, t1z ), glm::vec4(t_min) ) );
+      const glm::vec4 far = glm::min( glm::min( glm::max( t0x, t1x ), glm::max( t0y, t1y ) ), glm::min( glm::max( t0z, t1z ), glm::vec4(closest_so_far) ) );
+      const glm::bvec4 hit_child = glm::lessThanEqual( near, far );
+
+      int inner_num = 0;
+      std::array<int, WideBVH::ChildNum> inner_children;
+      std::array<float, WideBVH::ChildNum> inner_distances;
+      for (int i = 0; i < WideBVH::ChildNum; ++i) {
+         const uint count = (node.Counts >> (8 * i)) & 0xFFu;
+         if (count == WideBVH::EmptyChild || !hit_child[i]) continue;
+
+         if (count == WideBVH::InnerChild) {
+            int k = inner_num++;
+            for (; k > 0 && inner_distances[k - 1] < near[i]; --k) {
+               inner_children[k] = inner_children[k - 1];
+               inner_distances[k] = inner_distances[k - 1];
+            }
+            inner_children[k] = node.Child[i];
+            inner_distances[k] = near[i];
+         }
+         else {
+            for (int p = node.Child[i]; p < node.Child[i] + static_cast<int>(count); ++p) {
+               if (hitPrimitive( t, hit, ray_origin, ray_direction, t_min, closest_so_far, Primitives[p] )) {
+                  hit_anything = true;
+                  closest_so_far = t;
+               }
+            }
+         }
+      }
+
+      if (inner_num > 0) {
+         // the far children are loaded while the nearest one is traversed.
+         for (int i = 0; i < inner_num - 1; ++i) {
+            __builtin_prefetch( &WideNodes[inner_children[i]] );
+            stack[top++] = inner_children[i];
+         }
+         index = inner_children[inner_num - 1];
+         continue;
+      }
+      if (top == 0) break;
+      index = stack[--top];
+   }
+   return hit_anything;
+}
+
+// the function is compiled for AVX2 alone, and it is called only where the CPU has it.
+__attribute__((target("avx2")))
+bool CPUTracer::hitWideBVH8(
+   float& closest_so_far,
+   Hit& hit,
+   const glm::vec3& ray_origin,
+   const glm::vec3& ray_direction,
+   const glm::vec3& inverse_direction,
+   float t_min,
+   int root
+) const
+{
+   // the lanes which are set in a mask, in their order, so that a permutation moves them to the front.
+   static const std::array<std::array<int, WideBVH8::ChildNum>, 256> compressions = []() {
+      std::array<std::array<int, WideBVH8::ChildNum>, 256> lanes{};
+      for (int mask = 0; mask < 256; ++mask) {
+         int n = 0;
+         for (int i = 0; i < WideBVH8::ChildNum; ++i) {
+            if ((mask & (1 << i)) != 0) lanes[mask][n++] = i;
+         }
+      }
+      return lanes;
+   }();
+
+   float t;
+   bool hit_anything = false;
+   // an entry keeps the distance at which the ray enters the node, so the nodes behind a closer hit are never loaded.
+   std::array<int, Wide8StackSize> stack;
+   std::array<float, Wide8StackSize> stack_distances;
+   int top = 0;
+   int index = root;
+   while (true) {
+      const WideBVH8Node& node = Wide8Nodes[index];
+      __m256 near = _mm256_set1_ps( t_min );
+      __m256 far = _mm256_set1_ps( closest_so_far );
+      for (int a = 0; a < 3; ++a) {
+         // the planes are decoded in the same float math as the 4-wide nodes.
+         const __m256 origin = _mm256_set1_ps( ray_origin[a] );
+         const __m256 inverse = _mm256_set1_ps( inverse_direction[a] );
+         const __m256 node_origin = _mm256_set1_ps( node.Origin[a] );
+         const __m256 scale = _mm256_set1_ps( WideBVH::getScale( node.Exponents, a ) );
+         const __m256 min_steps = _mm256_cvtepi32_ps(
+            _mm256_cvtepu8_epi32( _mm_loadl_epi64( reinterpret_cast<const __m128i*>(node.Planes[a].data()) ) )
+         );
+         const __m256 max_steps = _mm256_cvtepi32_ps(
+            _mm256_cvtepu8_epi32( _mm_loadl_epi64( reinterpret_cast<const __m128i*>(node.Planes[a + 3].data()) ) )
+         );
+         const __m256 t0 = _mm256_mul_ps(
+            _mm256_sub_ps( _mm256_add_ps( node_origin, _mm256_mul_ps( min_steps, scale ) ), origin ), inverse
+         );
+         const __m256 t1 = _mm256_mul_ps(
+            _mm256_sub_ps( _mm256_add_ps( node_origin, _mm256_mul_ps( max_steps, scale ) ), origin ), inverse
+         );
+         near = _mm256_max_ps( near, _mm256_min_ps( t0, t1 ) );
+         far = _mm256_min_ps( far, _mm256_max_ps( t0, t1 ) );
+      }
+      const int hit_mask = _mm256_movemask_ps( _mm256_cmp_ps( near, far, _CMP_LE_OQ ) );
+      const __m128i counts = _mm_loadl_epi64( reinterpret_cast<const __m128i*>(node.Counts.data()) );
+      const int inner_mask = _mm_movemask_epi8( _mm_cmpeq_epi8( counts, _mm_set1_epi8( static_cast<char>(WideBVH::InnerChild) ) ) ) & 0xFF;
+      const int empty_mask = _mm_movemask_epi8( _mm_cmpeq_epi8( counts, _mm_setzero_si128() ) ) & 0xFF;
+
+      for (int leaves = hit_mask & ~inner_mask & ~empty_mask; leaves != 0; leaves &= leaves - 1) {
+         const int i = __builtin_ctz( static_cast<uint>(leaves) );
+         for (int p = node.Child[i]; p < node.Child[i] + static_cast<int>(node.Counts[i]); ++p) {
+            if (hitPrimitive( t, hit, ray_origin, ray_direction, t_min, closest_so_far, Primitives[p] )) {
+               hit_anything = true;
+               closest_so_far = t;
+            }
+         }
+      }
+
+      const int inner_hits = hit_mask & inner_mask;
+      const int inner_num = __builtin_popcount( static_cast<uint>(inner_hits) );
+      if (inner_num > 0) {
+         // the hit children are moved to the front without branches, and only those few are sorted, the nearest last.
+         const __m256i lanes = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(compressions[inner_hits].data()) );
+         alignas(32) std::array<float, WideBVH8::ChildNum> distances;
+         alignas(32) std::array<int, WideBVH8::ChildNum> children;
+         _mm256_store_ps( distances.data(), _mm256_permutevar8x32_ps( near, lanes ) );
+         _mm256_store_si256(
+            reinterpret_cast<__m256i*>(children.data()),
+            _mm256_permutevar8x32_epi32( _mm256_loadu_si256( reinterpret_cast<const __m256i*>(node.Child.data()) ), lanes )
+         );
+         for (int i = 1; i < inner_num; ++i) {
+            const float distance = distances[i];
+            const int child = children[i];
+            int k = i;
+            for (; k > 0 && distances[k - 1] < distance; --k) {
+               distances[k] = distances[k - 1];
+               children[k] = children[k - 1];
+            }
+            distances[k] = distance;
+            children[k] = child;
+         }
+         for (int i = 0; i < inner_num - 1; ++i) {
+            __builtin_prefetch( &Wide8Nodes[children[i]] );
+            stack[top] = children[i];
+            stack_distances[top++] = distances[i];
+         }
+         index = children[inner_num - 1];
+         continue;
+      }
+
+      do {
+         if (top == 0) return hit_anything;
+      } while (stack_distances[--top] > closest_so_far);
+      index = stack[top];
+   }
+}
+
+__attribute__((target("avx2")))
+void CPUTracer::hitWideBVH8Stream(Stream& stream, int instance, int root) const
+{
+   float t;
+   stream.Entries.clear();
+   stream.Entries.push_back( { root, 0, static_cast<int>(stream.NodeRays.size()) } );
+   while (!stream.Entries.empty()) {
+      const StreamEntry entry = stream.Entries.back();
+      stream.Entries.pop_back();
+      // the rays above the entry belong to the entries which are done, and the rays which have found a closer hit
+      // since the node was pushed are dropped.
+      int end = entry.Begin;
+      for (int k = entry.Begin; k < entry.End; ++k) {
+         const int j = stream.NodeRays[k];
+         if (stream.NodeRayDistances[k] > stream.Distances[j]) continue;
+
+         stream.NodeRays[end] = j;
+         stream.NodeRayDistances[end++] = stream.NodeRayDistances[k];
+      }
+      stream.NodeRays.resize( static_cast<size_t>(end) );
+      stream.NodeRayDistances.resize( static_cast<size_t>(end) );
+
+      if (end - entry.Begin < Wide8StreamMinRayNum) {
+         for (int k = entry.Begin; k < end; ++k) {
+            const int j = stream.NodeRays[k];
+            if (hitWideBVH8(
+               stream.Distances[j], stream.Hits[j], stream.LocalOrigins[j], stream.LocalDirections[j],
+               stream.LocalInverses[j], StreamMinDistance, entry.Node
+            )) stream.HitInstances[j] = instance;
+         }
+         continue;
+      }
+
+      // the planes of the node are decoded once for all of its rays.
+      const WideBVH8Node& node = Wide8Nodes[entry.Node];
+      __m256 planes[6]; // in the order of the planes of the node
+      for (int a = 0; a < 3; ++a) {
+         const __m256 node_origin = _mm256_set1_ps( node.Origin[a] );
+         const __m256 scale = _mm256_set1_ps( WideBVH::getScale( node.Exponents, a ) );
+         for (const int plane : { a, a + 3 }) {
+            const __m256 steps = _mm256_cvtepi32_ps(
+               _mm256_cvtepu8_epi32( _mm_loadl_epi64( reinterpret_cast<const __m128i*>(node.Planes[plane].data()) ) )
+            );
+            planes[plane] = _mm256_add_ps( node_origin, _mm256_mul_ps( steps, scale ) );
+         }
+      }
+      const __m128i counts = _mm_loadl_epi64( reinterpret_cast<const __m128i*>(node.Counts.data()) );
+      const int inner_mask = _mm_movemask_epi8( _mm_cmpeq_epi8( counts, _mm_set1_epi8( static_cast<char>(WideBVH::InnerChild) ) ) ) & 0xFF;
+      const int empty_mask = _mm_movemask_epi8( _mm_cmpeq_epi8( counts, _mm_setzero_si128() ) ) & 0xFF;
+
+      std::array<float, WideBVH8::ChildNum> distance_sums{};
+      for (auto& rays : stream.ChildRays) rays.clear();
+      for (auto& distances : stream.ChildDistances) distances.clear();
+      for (int k = entry.Begin; k < end; ++k) {
+         const int j = stream.NodeRays[k];
+         const glm::vec3& ray_origin = stream.LocalOrigins[j];
+         const glm::vec3& inverse_direction = stream.LocalInverses[j];
+         __m256 near = _mm256_set1_ps( StreamMinDistance );
+         __m256 far = _mm256_set1_ps( stream.Distances[j] );
+         for (int a = 0; a < 3; ++a) {
+            const __m256 origin = _mm256_set1_ps( ray_origin[a] );
+            const __m256 inverse = _mm256_set1_ps( inverse_direction[a] );
+            const __m256 t0 = _mm256_mul_ps( _mm256_sub_ps( planes[a], origin ), inverse );
+            const __m256 t1 = _mm256_mul_ps( _mm256_sub_ps( planes[a + 3], origin ), inverse );
+            near = _mm256_max_ps( near, _mm256_min_ps( t0, t1 ) );
+            far = _mm256_min_ps( far, _mm256_max_ps( t0, t1 ) );
+         }
+         const int hit_mask = _mm256_movemask_ps( _mm256_cmp_ps( near, far, _CMP_LE_OQ ) );
+         for (int leaves = hit_mask & ~inner_mask & ~empty_mask; leaves != 0; leaves &= leaves - 1) {
+            const int i = __builtin_ctz( static_cast<uint>(leaves) );
+            for (int p = node.Child[i]; p < node.Child[i] + static_cast<int>(node.Counts[i]); ++p) {
+               if (hitPrimitive(
+                  t, stream.Hits[j], ray_origin, stream.LocalDirections[j], StreamMinDistance, stream.Distances[j], Primitives[p]
+               )) {
+                  stream.Distances[j] = t;
+                  stream.HitInstances[j] = instance;
+               }
+            }
+         }
+
+         alignas(32) std::array<float, WideBVH8::ChildNum> distances;
+         _mm256_store_ps( distances.data(), near );
+         for (int inner_hits = hit_mask & inner_mask; inner_hits != 0; inner_hits &= inner_hits - 1) {
+            const int i = __builtin_ctz( static_cast<uint>(inner_hits) );
+            stream.ChildRays[i].emplace_back( j );
+            stream.ChildDistances[i].emplace_back( distances[i] );
+            distance_sums[i] += distances[i];
+         }
+      }
+
+      // the children are pushed by the mean distance at which their rays enter them, so the nearest is taken first.
+      std::array<int, WideBVH8::ChildNum> children;
+      int child_num = 0;
+      for (int i = 0; i < WideBVH8::ChildNum; ++i) {
+         if (stream.ChildRays[i].empty()) continue;
+
+         distance_sums[i] /= static_cast<float>(stream.ChildRays[i].size());
+         int k = child_num++;
+         for (; k > 0 && distance_sums[children[k - 1]] < distance_sums[i]; --k) children[k] = children[k - 1];
+         children[k] = i;
+      }
+      for (int c = 0; c < child_num; ++c) {
+         const int i = children[c];
+         const auto begin = static_cast<int>(stream.NodeRays.size());
+         stream.NodeRays.insert( stream.NodeRays.end(), stream.ChildRays[i].begin(), stream.ChildRays[i].end() );
+         stream.NodeRayDistances.insert( stream.NodeRayDistances.end(), stream.ChildDistances[i].begin(), stream.ChildDistances[i].end() );
+         __builtin_prefetch( &Wide8Nodes[node.Child[i]] );
+         stream.Entries.push_back( { node.Child[i], begin, static_cast<int>(stream.NodeRays.size()) } );
+      }
+   }
+}
+
+GridInfo CPUTracer::getGrid(int grid_index) const
+{
+   const uint* words = &GridCells[static_cast<size_t>(grid_index) * UniformGridGL::GridInfoSize];
+   GridInfo grid;
+   grid.Min = glm::uintBitsToFloat( glm::uvec3(words[0], words[1], words[2]) );
+   grid.CellOffset = static_cast<int>(words[3]);
+   grid.CellSize = glm::uintBitsToFloat( glm::uvec3(words[4], words[5], words[6]) );
+   grid.Resolution = glm::ivec3(words[8], words[9], words[10]);
+   return grid;
+}
+
+bool CPUTracer::hitGrid(
+   float& closest_so_far,
+   Hit& hit,
+   const glm::vec3& ray_origin,
+   const glm::vec3& ray_direction,
+   const glm::vec3& inverse_direction,
+   float t_min,
+   int grid_index
+) const
+{
+   const GridInfo grid = getGrid( grid_index );
+   const glm::vec3 t0 = (grid.Min - ray_origin) * inverse_direction;
+   const glm::vec3 t1 = (grid.Min + glm::vec3(grid.Resolution) * grid.CellSize - ray_origin) * inverse_direction;
+   const glm::vec3 near = glm::min( t0, t1 );
+   const glm::vec3 far = glm::max( t0, t1 );
+   const float t_enter = std::max( std::max( near.x, near.y ), std::max( near.z, t_min ) );
+   const float t_exit = std::min( std::min( far.x, far.y ), std::min( far.z, closest_so_far ) );
+   if (t_enter > t_exit) return false;
+
+   const glm::vec3 entry = ray_origin + t_enter * ray_direction;
+   glm::ivec3 cell = glm::clamp( glm::ivec3(glm::floor( (entry - grid.Min) / grid.CellSize )), glm::ivec3(0), grid.Resolution - 1 );
+   glm::ivec3 step;
+   glm::vec3 t_next, t_delta;
+   for (int a = 0; a < 3; ++a) {
+      step[a] = inverse_direction[a] >= 0.0f ? 1 : -1;
+      const float boundary = grid.Min[a] + static_cast<float>(cell[a] + std::max( step[a], 0 )) * grid.CellSize[a];
+      t_next[a] = ray_direction[a] == 0.0f ? 1e+30f : (boundary - ray_origin[a]) * inverse_direction[a];
+      t_delta[a] = std::abs( grid.CellSize[a] * inverse_direction[a] );
+   }
+
+   float t;
+   bool hit_anything = false;
+   while (true) {
+      const int index = grid.CellOffset + (cell.z * grid.Resolution.y + cell.y) * grid.Resolution.x + cell.x;
+      for (uint i = GridCells[index]; i < GridCells[index + 1]; ++i) {
+         if (hitPrimitive( t, hit, ray_origin, ray_direction, t_min, closest_so_far, GridCells[i] )) {
+            hit_anything = true;
+            closest_so_far = t;
+         }
+      }
+
+      const int axis = t_next.x < t_next.y ? (t_next.x < t_next.z ? 0 : 2) : (t_next.y < t_next.z ? 1 : 2);
+      if (t_next[axis] >= std::min( t_exit, closest_so_far )) break;
+
+      cell[axis] += step[axis];
+      if (cell[axis] < 0 || cell[axis] >= grid.Resolution[axis]) break;
+      t_next[axis] += t_delta[axis];
+   }
+   return hit_anything;
+}
+
+bool CPUTracer::hitLazyBVH(
+   float& closest_so_far,
+   Hit& hit,
+   const glm::vec3& ray_origin,
+   const glm::vec3& ray_direction,
+   const glm::vec3& inverse_direction,
+   float t_min,
+   const LazyBVH& bvh
+) const
+{
+   float t, distance;
+   bool hit_anything = false;
+   std::array<int, StackSize> stack;
+   int top = 0;
+   int index = 0;
+   if (!hitBox( distance, ray_origin, inverse_direction, t_min, closest_so_far, bvh.getBounds() )) return false;
+
+   while (true) {
+      const BVHNode& node = bvh.getNode( index );
+      if (node.isLeaf()) {
+         for (int i = node.Offset; i < node.Offset + node.Count; ++i) {
+            if (hitPrimitive( t, hit, ray_origin, ray_direction, t_min, closest_so_far, bvh.getPrimitive( i ) )) {
+               hit_anything = true;
+               closest_so_far = t;
+            }
+         }
+      }
+      else {
+         // the boxes of the children are final before they are split, so only the children that are entered get split.
+         int near_child = node.Offset, far_child = -node.Count;
+         float near_distance, far_distance;
+         const bool hit_near = hitBox( near_distance, ray_origin, inverse_direction, t_min, closest_so_far, bvh.getBounds( near_child ) );
+         const bool hit_far = hitBox( far_distance, ray_origin, inverse_direction, t_min, closest_so_far, bvh.getBounds( far_child ) );
+         if (hit_near && hit_far) {
+            if (far_distance < near_distance) std::swap( near_child, far_child );
+            // the far child was loaded along with the near one, so the line of its children is loaded next.
+            bvh.prefetchChildren( far_child );
+            stack[top++] = far_child;
+            index = near_child;
+            continue;
+         }
+         if (hit_near || hit_far) {
+            index = hit_near ? near_child : far_child;
+            continue;
+         }
+      }
+      if (top == 0) break;
+      index = stack[--top];
+   }
+   return hit_anything;
+}
+
+bool CPUTracer::traverseLazily(Hit& hit, const glm::vec3& ray_origin, const glm::vec3& ray_direction, float t_min, float t_max) const
+{
+   float distance;
+   bool hit_anything = false;
+   float closest_so_far = t_max;
+   int hit_instance = 0;
+   const glm::vec3 inverse_direction = 1.0f / ray_direction;
+   std::array<int, StackSize> stack;
+   int top = 0;
+   int index = 0;
+   if (LazyInstances.empty() || !hitBox( distance, ray_origin, inverse_direction, t_min, closest_so_far, LazyTopLevel.getBounds() )) {
+      return false;
+   }
+
+   while (true) {
+      const BVHNode& node = LazyTopLevel.getNode( index );
+      if (node.isLeaf()) {
+         for (int i = node.Offset; i < node.Offset + node.Count; ++i) {
+            const auto instance_index = static_cast<int>(LazyTopLevel.getPrimitive( i ));
+            const LazyInstance& instance = LazyInstances[instance_index];
+            const auto& m = instance.WorldToObject;
+            const glm::vec4 p(ray_origin, 1.0f);
+            const glm::vec3 origin(glm::dot( m[0], p ), glm::dot( m[1], p ), glm::dot( m[2], p ));
+            const glm::vec3 direction(
+               glm::dot( glm::vec3(m[0]), ray_direction ),
+               glm::dot( glm::vec3(m[1]), ray_direction ),
+               glm::dot( glm::vec3(m[2]), ray_direction )
+            );
+            if (hitLazyBVH( closest_so_far, hit, origin, direction, 1.0f / direction, t_min, *LazyGeometries[instance.Geometry] )) {
+               hit_anything = true;
+               hit_instance = instance_index;
+            }
+         }
+      }
+      else {
+         int near_child = node.Offset, far_child = -node.Count;
+         float near_distance, far_distance;
+         const bool hit_near = hitBox(
+            near_distance, ray_origin, inverse_direction, t_min, closest_so_far, LazyTopLevel.getBounds( near_child )
+         );
+         const bool hit_far = hitBox(
+            far_distance, ray_origin, inverse_direction, t_min, closest_so_far, LazyTopLevel.getBounds( far_child )
+         );
+         if (hit_near && hit_far) {
+            if (far_distance < near_distance) std::swap( near_child, far_child );
+            // the far child was loaded along with the near one, so the line of its children is loaded next.
+            LazyTopLevel.prefetchChildren( far_child );
+            stack[top++] = far_child;
+            index = near_child;
+            continue;
+         }
+         if (hit_near || hit_far) {
+            index = hit_near ? near_child : far_child;
+            continue;
+         }
+      }
+      if (top == 0) break;
+      index = stack[--top];
+   }
+
+   if (hit_anything) {
+      const auto& m = LazyInstances[hit_instance].WorldToObject;
+      hit.Position = ray_origin + closest_so_far * ray_direction;
+      hit.Normal = glm::normalize( hit.Normal.x * glm::vec3(m[0]) + hit.Normal.y * glm::vec3(m[1]) + hit.Normal.z * glm::vec3(m[2]) );
+      if (LazyInstances[hit_instance].MaterialIndex >= 0) hit.Material = LazyInstances[hit_instance].MaterialIndex;
+   }
+   return hit_anything;
+}
+
+bool CPUTracer::hitScene(
+   float& closest_so_far,
+   int& hit_instance,
+   Hit& hit,
+   const glm::vec3& ray_origin,
+   const glm::vec3& ray_direction,
+   float t_min,
+   Counters* counters,
+   std::vector<int>* wide8_instances
+) const
+{
+   const auto transform_point = [this](int instance, const glm::vec3& point) {
+      const glm::vec4 p(point, 1.0f);
+      const auto& m = Instances[instance].WorldToObject;
+      return glm::vec3(glm::dot( m[0], p ), glm::dot( m[1], p ), glm::dot( m[2], p ));
+   };
+   const auto transform_direction = [this](int instance, const glm::vec3& direction) {
+      const auto& m = Instances[instance].WorldToObject;
+      return glm::vec3(
+         glm::dot( glm::vec3(m[0]), direction ),
+         glm::dot( glm::vec3(m[1]), direction ),
+         glm::dot( glm::vec3(m[2]), direction )
+      );
+   };
+
+   float t;
+   bool hit_anything = false;
+   glm::vec3 origin = ray_origin;
+   glm::vec3 direction = ray_direction;
+   glm::vec3 inverse_direction = 1.0f / direction;
+   std::array<int, StackSize> stack;
+   int top = 0;
+   int index = 0;
+   int instance = -1, instance_end = 0, instance_top = 0;
+   bool entering = false;
+   if (counters != nullptr) counters->RayNum++;
+   while (true) {
+      const BVHNode& node = Nodes[index];
+      if (counters != nullptr) counters->NodeVisits[index]++;
+      if (node.Count < 0) {
+         int near_child = node.Offset, far_child = -node.Count;
+         float near_distance, far_distance;
+         const bool hit_near = hitBox( near_distance, origin, inverse_direction, t_min, closest_so_far, near_child );
+         const bool hit_far = hitBox( far_distance, origin, inverse_direction, t_min, closest_so_far, far_child );
+         if (hit_near && hit_far) {
+            if (far_distance < near_distance) std::swap( near_child, far_child );
+            // the far child was loaded along with the near one, so the line of its children is loaded next.
+            if (!Nodes[far_child].isLeaf()) __builtin_prefetch( &Nodes[Nodes[far_child].Offset] );
+            stack[top++] = far_child;
+            index = near_child;
+            continue;
+         }
+         if (hit_near || hit_far) {
+            index = hit_near ? near_child : far_child;
+            continue;
+         }
+      }
+      else if (instance < 0) {
+         if (node.Count > 0) {
+            instance = node.Offset;
+            instance_end = node.Offset + node.Count;
+            instance_top = top;
+            entering = true;
+         }
+      }
+      else {
+         bool hit_leaf = false;
+         if (counters != nullptr) counters->LeafVisitNum++;
+         for (int i = node.Offset; i < node.Offset + node.Count; ++i) {
+            if (hitPrimitive( t, hit, origin, direction, t_min, closest_so_far, Primitives[i] )) {
+               hit_leaf = true;
+               closest_so_far = t;
+            }
+         }
+         if (hit_leaf) {
+            hit_anything = true;
+            hit_instance = instance;
+            if (counters != nullptr) counters->LeafHits[index]++;
+         }
+      }
+
+      if (instance >= 0 && top == instance_top) {
+         if (!entering) instance++;
+         entering = false;
+         for (; instance < instance_end; ++instance) {
+            // the chunk of a paged scene which is not resident is taken as empty.
+            const int grid = Instances[instance].Grid;
+            if (grid < 0 && Instances[instance].Root < 0) continue;
+
+            origin = transform_point( instance, ray_origin );
+            direction = transform_direction( instance, ray_direction );
+            inverse_direction = 1.0f / direction;
+            // the profile is of the binary nodes, so they are taken even where the wide ones exist.
+            const int wide_root = counters != nullptr ? -1 : Instances[instance].WideRoot;
+            const int wide8_root = counters != nullptr ? -1 : Wide8Roots[instance];
+            if (grid < 0 && wide_root < 0 && wide8_root < 0) break;
+
+            if (wide8_root >= 0 && wide8_instances != nullptr) {
+               wide8_instances->emplace_back( instance );
+               continue;
+            }
+            bool hit_bottom_level;
+            if (grid >= 0) hit_bottom_level = hitGrid( closest_so_far, hit, origin, direction, inverse_direction, t_min, grid );
+            else if (wide8_root >= 0) {
+               hit_bottom_level = hitWideBVH8( closest_so_far, hit, origin, direction, inverse_direction, t_min, wide8_root );
+            }
+            else hit_bottom_level = hitWideBVH( closest_so_far, hit, origin, direction, inverse_direction, t_min, wide_root );
+            if (hit_bottom_level) {
+               hit_anything = true;
+               hit_instance = instance;
+            }
+         }
+         if (instance < instance_end) {
+            index = Instances[instance].Root;
+            continue;
+         }
+         instance = -1;
+         origin = ray_origin;
+         direction = ray_direction;
+         inverse_direction = 1.0f / direction;
+      }
+      if (top == 0) break;
+      index = stack[--top];
+   }
+   return hit_anything;
+}
+
+void CPUTracer::setWorldHit(Hit& hit, const glm::vec3& ray_origin, const glm::vec3& ray_direction, float t, int instance) const
+{
+   const auto& m = Instances[instance].WorldToObject;
+   hit.Position = ray_origin + t * ray_direction;
+   hit.Normal = glm::normalize( hit.Normal.x * glm::vec3(m[0]) + hit.Normal.y * glm::vec3(m[1]) + hit.Normal.z * glm::vec3(m[2]) );
+   if (Instances[instance].MaterialIndex >= 0) hit.Material = Instances[instance].MaterialIndex;
+}
+
+bool CPUTracer::traverse(
+   Hit& hit,
+   const glm::vec3& ray_origin,
+   const glm::vec3& ray_direction,
+   float t_min,
+   float t_max,
+   Counters* counters
+) const
+{
+   float closest_so_far = t_max;
+   int hit_instance = 0;
+   if (!hitScene( closest_so_far, hit_instance, hit, ray_origin, ray_direction, t_min, counters, nullptr )) return false;
+
+   setWorldHit( hit, ray_origin, ray_direction, closest_so_far, hit_instance );
+   return true;
+}
+
+glm::vec3 CPUTracer::tracePixel(
+   const glm::ivec2& pixel,
+   const glm::ivec2& image_size,
+   int frame_index,
+   Counters* counters,
+   std::vector<RaySegment>* rays
+) const
+{
+   glm::vec3 color(0.0f);
+   uint seed = getSeed( pixel, frame_index );
+   const int sample_num = counters != nullptr ? 1 : SampleNum;
+   for (int i = 0; i < sample_num; ++i) {
+      int depth = 0;
+      bool need_to_repeat = true;
+      glm::vec3 partial_color(1.0f);
+      glm::vec3 ray_origin(0.0f);
+      glm::vec3 ray_direction = getPrimaryRayDirection( seed, pixel, image_size );
+      while (depth < MaxDepth && need_to_repeat) {
+         Hit hit;
+         const bool hit_anything = Lazy ?
+            traverseLazily( hit, ray_origin, ray_direction, 1e-3f, 1e+7f ) :
+            traverse( hit, ray_origin, ray_direction, 1e-3f, 1e+7f, counters );
+         if (rays != nullptr) {
+            // the hit is on the ray, so its distance is found again from its position.
+            const float t = hit_anything ?
+               glm::dot( hit.Position - ray_origin, ray_direction ) / glm::dot( ray_direction, ray_direction ) : 1e+7f;
+            rays->push_back( { ray_origin, 1e-3f, ray_direction, t } );
+         }
+         if (hit_anything) {
+            const Material& material = Materials[hit.Material];
+            need_to_repeat = scatter( ray_origin, ray_direction, seed, material.Type, hit );
+            partial_color *= need_to_repeat ? material.Albedo : glm::vec3(0.0f);
+         }
+         else {
+            need_to_repeat = false;
+            partial_color *= getBackgroundColor( ray_direction );
+         }
+         depth++;
+      }
+      if (!need_to_repeat) color += partial_color;
+   }
+   return glm::sqrt( color / static_cast<float>(sample_num) );
+}
+
+void CPUTracer::intersectStream(Stream& stream, int path_num) const
+{
+   // the top level is traversed by the rays one at a time, and the rays are then gathered by the 8-wide bottom levels
+   // which they enter, so that each of those is traversed once for all of its rays.
+   stream.InstanceRays.clear();
+   for (int j = 0; j < path_num; ++j) {
+      int hit_instance = 0;
+      stream.Distances[j] = 1e+7f;
+      stream.RayInstances.clear();
+      const bool hit_anything = hitScene(
+         stream.Distances[j], hit_instance, stream.Hits[j], stream.Origins[j], stream.Directions[j], StreamMinDistance,
+         nullptr, &stream.RayInstances
+      );
+      stream.HitInstances[j] = hit_anything ? hit_instance : -1;
+      for (const int instance : stream.RayInstances) stream.InstanceRays.emplace_back( instance, j );
+   }
+   // the rays of a single instance are listed in their order already.
+   if (!std::is_sorted( stream.InstanceRays.begin(), stream.InstanceRays.end() )) {
+      std::sort( stream.InstanceRays.begin(), stream.InstanceRays.end() );
+   }
+
+   for (size_t first = 0; first < stream.InstanceRays.size();) {
+      const int instance = stream.InstanceRays[first].first;
+      const auto& m = Instances[instance].WorldToObject;
+      stream.NodeRays.clear();
+      stream.NodeRayDistances.clear();
+      for (; first < stream.InstanceRays.size() && stream.InstanceRays[first].first == instance; ++first) {
+         const int j = stream.InstanceRays[first].second;
+         const glm::vec4 p(stream.Origins[j], 1.0f);
+         const glm::vec3& direction = stream.Directions[j];
+         stream.LocalOrigins[j] = glm::vec3(glm::dot( m[0], p ), glm::dot( m[1], p ), glm::dot( m[2], p ));
+         stream.LocalDirections[j] = glm::vec3(
+            glm::dot( glm::vec3(m[0]), direction ),
+            glm::dot( glm::vec3(m[1]), direction ),
+            glm::dot( glm::vec3(m[2]), direction )
+         );
+         stream.LocalInverses[j] = 1.0f / stream.LocalDirections[j];
+         stream.NodeRays.emplace_back( j );
+         stream.NodeRayDistances.emplace_back( StreamMinDistance );
+      }
+      hitWideBVH8Stream( stream, instance, Wide8Roots[instance] );
+   }
+
+   for (int j = 0; j < path_num; ++j) {
+      if (stream.HitInstances[j] < 0) stream.Hits[j].Material = -1;
+      else setWorldHit( stream.Hits[j], stream.Origins[j], stream.Directions[j], stream.Distances[j], stream.HitInstances[j] );
+   }
+}
+
+void CPUTracer::traceStream(Stream& stream, int first_pixel, int pixel_num, const glm::ivec2& image_size, int frame_index) const
+{
+   const auto size = static_cast<size_t>(pixel_num);
+   stream.Pixels.resize( size );
+   stream.Origins.resize( size );
+   stream.Directions.resize( size );
+   stream.Throughputs.resize( size );
+   stream.Distances.resize( size );
+   stream.HitInstances.resize( size );
+   stream.Hits.resize( size );
+   stream.Order.resize( size );
+   stream.MaterialOffsets.resize( Materials.size() + 2 );
+   stream.Seeds.resize( size );
+   stream.Colors.assign( size, glm::vec3(0.0f) );
+   stream.LocalOrigins.resize( size );
+   stream.LocalDirections.resize( size );
+   stream.LocalInverses.resize( size );
+   for (int p = 0; p < pixel_num; ++p) {
+      const int pixel = first_pixel + p;
+      stream.Seeds[p] = getSeed( { pixel % image_size.x, pixel / image_size.x }, frame_index );
+   }
+
+   for (int i = 0; i < SampleNum; ++i) {
+      int path_num = pixel_num;
+      for (int p = 0; p < pixel_num; ++p) {
+         const int pixel = first_pixel + p;
+         stream.Pixels[p] = p;
+         stream.Origins[p] = glm::vec3(0.0f);
+         stream.Directions[p] = getPrimaryRayDirection(
+            stream.Seeds[p], { pixel % image_size.x, pixel / image_size.x }, image_size
+         );
+         stream.Throughputs[p] = glm::vec3(1.0f);
+      }
+
+      for (int depth = 0; depth < MaxDepth && path_num > 0; ++depth) {
+         if (Lazy) {
+            for (int j = 0; j < path_num; ++j) {
+               Hit hit;
+               if (!traverseLazily( hit, stream.Origins[j], stream.Directions[j], StreamMinDistance, 1e+7f )) hit.Material = -1;
+               stream.Hits[j] = hit;
+            }
+         }
+         else intersectStream( stream, path_num );
+
+         // the misses come first, and then the paths of every material in the order of the materials.
+         std::fill( stream.MaterialOffsets.begin(), stream.MaterialOffsets.end(), 0 );
+         for (int j = 0; j < path_num; ++j) stream.MaterialOffsets[stream.Hits[j].Material + 2]++;
+         std::partial_sum( stream.MaterialOffsets.begin(), stream.MaterialOffsets.end(), stream.MaterialOffsets.begin() );
+         for (int j = 0; j < path_num; ++j) stream.Order[stream.MaterialOffsets[stream.Hits[j].Material + 1]++] = j;
+
+         for (int k = 0; k < path_num; ++k) {
+            const int j = stream.Order[k];
+            const int pixel = stream.Pixels[j];
+            const int material_index = stream.Hits[j].Material;
+            if (material_index < 0) {
+               stream.Colors[pixel] += stream.Throughputs[j] * getBackgroundColor( stream.Directions[j] );
+               stream.Pixels[j] = -1;
+               continue;
+            }
+
+            const Material& material = Materials[material_index];
+            if (scatter( stream.Origins[j], stream.Directions[j], stream.Seeds[pixel], material.Type, stream.Hits[j] )) {
+               stream.Throughputs[j] *= material.Albedo;
+            }
+            else stream.Pixels[j] = -1;
+         }
+
+         // the paths which go on are moved to the front in their order.
+         int alive_num = 0;
+         for (int j = 0; j < path_num; ++j) {
+            if (stream.Pixels[j] < 0) continue;
+
+            if (alive_num != j) {
+               stream.Pixels[alive_num] = stream.Pixels[j];
+               stream.Origins[alive_num] = stream.Origins[j];
+               stream.Directions[alive_num] = stream.Directions[j];
+               stream.Throughputs[alive_num] = stream.Throughputs[j];
+            }
+            alive_num++;
+         }
+         path_num = alive_num;
+      }
+   }
+}
+
+void CPUTracer::renderStreams(int width, int height, int frame_index)
+{
+   Image.resize( static_cast<size_t>(width) * height );
+   const int pixel_num = width * height;
+   std::atomic<int> next_batch( 0 );
+   const auto trace_batches = [&]() {
+      Stream stream;
+      for (int first = next_batch++ * StreamPixelNum; first < pixel_num; first = next_batch++ * StreamPixelNum) {
+         const int batch_size = std::min( StreamPixelNum, pixel_num - first );
+         traceStream( stream, first, batch_size, { width, height }, frame_index );
+         for (int p = 0; p < batch_size; ++p) {
+            const glm::vec3 color = glm::clamp( glm::sqrt( stream.Colors[p] / static_cast<float>(SampleNum) ), 0.0f, 1.0f );
+            Image[static_cast<size_t>(first + p)] = glm::u8vec4(glm::round( color * 255.0f ), 255.0f);
+         }
+      }
+   };
+
+   std::vector<std::thread> threads;
+   for (int i = 1; i < ThreadNum; ++i) threads.emplace_back( trace_batches );
+   trace_batches();
+   for (auto& thread : threads) thread.join();
+}
+
+void CPUTracer::render(int width, int height, int frame_index, bool streams)
+{
+   if (streams) renderStreams( width, height, frame_index );
+   else render( width, height, frame_index, nullptr, nullptr, 0 );
+}
+
+void CPUTracer::render(TraversalProfile& profile, int width, int height, int frame_index)
+{
+   Counters counters(Nodes.size());
+   const int ray_stride = std::max( width * height / MaxProfilePixelNum, 1 );
+   profile.Rays.clear();
+   render( width, height, frame_index, &counters, &profile.Rays, ray_stride );
+
+   profile.RayNum = counters.RayNum;
+   profile.NodeVisitNum = 0;
+   profile.LeafVisitNum = counters.LeafVisitNum;
+   profile.LeafHitNum = 0;
+   profile.NodeVisits.assign( static_cast<size_t>(BufferNodeNum), 0 );
+   profile.LeafHits.assign( static_cast<size_t>(BufferNodeNum), 0 );
+   for (size_t i = 0; i < Nodes.size(); ++i) {
+      const int index = BufferNodeIndices[i];
+      if (index < 0) continue;
+
+      profile.NodeVisits[index] = counters.NodeVisits[i];
+      profile.LeafHits[index] = counters.LeafHits[i];
+      profile.NodeVisitNum += profile.NodeVisits[index];
+      profile.LeafHitNum += profile.LeafHits[index];
+   }
+}
+
+void CPUTracer::render(
+   int width,
+   int height,
+   int frame_index,
+   Counters* counters,
+   std::vector<RaySegment>* rays,
+   int ray_stride
+)
+{
+   Image.resize( static_cast<size_t>(width) * height );
+   std::mutex ray_mutex;
+   std::atomic<int> next_row( 0 );
+   const auto trace_rows = [&]() {
+      std::vector<RaySegment> row_rays;
+      for (int y = next_row++; y < height; y = next_row++) {
+         for (int x = 0; x < width; ++x) {
+            const int pixel = y * width + x;
+            std::vector<RaySegment>* pixel_rays = rays != nullptr && pixel % ray_stride == 0 ? &row_rays : nullptr;
+            const glm::vec3 color = glm::clamp( tracePixel( { x, y }, { width, height }, frame_index, counters, pixel_rays ), 0.0f, 1.0f );
+            Image[static_cast<size_t>(pixel)] = glm::u8vec4(glm::round( color * 255.0f ), 255.0f);
+         }
+         if (!row_rays.empty()) {
+            std::lock_guard<std::mutex> lock(ray_mutex);
+            rays->insert( rays->end(), row_rays.begin(), row_rays.end() );
+            row_rays.clear();
+         }
+      }
+   };
+
+   std::vector<std::thread> threads;
+   for (int i = 1; i < ThreadNum; ++i) threads.emplace_back( trace_rows );
+   trace_rows();
+   for (auto& thread : threads) thread.join();
+}
\ No newline at end of file
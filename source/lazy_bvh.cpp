@@ -0,0 +1,65 @@
+#include "lazy_bvh.h"
+
+BVHNode LazyBVH::getRange(const BVH::Reference* references, int begin, int end)
+{
+   BVHNode node;
+   node.Min = glm::vec3(std::numeric_limits<float>::max());
+   node.Max = glm::vec3(std::numeric_limits<float>::lowest());
+   for (int i = begin; i < end; ++i) {
+      node.Min = glm::min( node.Min, references[i].Min );
+      node.Max = glm::max( node.Max, references[i].Max );
+   }
+   if (begin == end) node.Min = node.Max = glm::vec3(0.0f);
+   node.Offset = begin;
+   node.Count = end - begin;
+   return node;
+}
+
+void LazyBVH::reset(std::vector<BVH::Reference> references, int leaf_size)
+{
+   // a binary tree whose leaves are not empty has fewer than twice as many nodes as references.
+   LeafSize = leaf_size;
+   References = std::move( references );
+   const auto count = static_cast<int>(References.size());
+   Nodes.resize( static_cast<size_t>(std::max( 2 * count - 1, 1 )) );
+   States = std::vector<std::atomic<int>>(Nodes.size());
+   Depths.resize( Nodes.size() );
+   Nodes[0] = getRange( References.data(), 0, count );
+   Depths[0] = 1;
+   States[0].store( count == 0 ? BUILT : UNSPLIT, std::memory_order_relaxed );
+   NextNode.store( 1, std::memory_order_relaxed );
+}
+
+void LazyBVH::split(int index) const
+{
+   int expected = UNSPLIT;
+   if (!States[index].compare_exchange_strong( expected, SPLITTING, std::memory_order_acquire )) {
+      while (States[index].load( std::memory_order_acquire ) != BUILT) std::this_thread::yield();
+      return;
+   }
+
+   BVHNode& node = Nodes[index];
+   const int begin = node.Offset;
+   const int end = node.Offset + node.Count;
+   const int count = node.Count;
+   int axis = 0;
+   float position = 0.0f;
+   const bool divided = Depths[index] < BVH::MaxDepth && count > 1 &&
+      BVH::findSplit( axis, position, References.data() + begin, count, node, LeafSize );
+   if (divided) {
+      auto* middle = std::partition(
+         References.data() + begin, References.data() + end,
+         [axis, position](const BVH::Reference& reference) { return reference.Centroid[axis] < position; }
+      );
+      int mid = static_cast<int>(middle - References.data());
+      if (mid == begin || mid == end) mid = begin + count / 2;
+
+      const int left = NextNode.fetch_add( 2, std::memory_order_relaxed );
+      Nodes[left] = getRange( References.data(), begin, mid );
+      Nodes[left + 1] = getRange( References.data(), mid, end );
+      Depths[left] = Depths[left + 1] = Depths[index] + 1;
+      node.Offset = left;
+      node.Count = -(left + 1);
+   }
+   States[index].store( BUILT, std::memory_order_release );
+}
\ No newline at end of file
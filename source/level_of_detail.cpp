@@ -0,0 +1,38 @@
+#include "level_of_detail.h"
+
+void LevelOfDetailGL::setShaders(const std::string& shader_directory_path)
+{
+   ProxyShader = std::make_unique<ShaderGL>();
+   ProxyShader->setComputeShader( std::string(shader_directory_path + "/bvh_proxy.comp").c_str() );
+   ProxyShader->addUniformLocation( "NodeOffset" );
+   ProxyShader->addUniformLocation( "NodeNum" );
+   ProxyShader->addUniformLocation( "WideNodeNum" );
+   ProxyShader->addUniformLocation( "WideProxyOffset" );
+}
+
+void LevelOfDetailGL::build(int first_node, int node_num, int wide_node_num)
+{
+   // the proxies which are never built have no coverage, so the traversal does not take them.
+   const auto size = static_cast<GLsizeiptr>(sizeof( ProxyInfo ) * std::max( node_num + wide_node_num, 1 ));
+   if (ProxyBuffer.getSize() != size) ProxyBuffer.create( size );
+   ProxyBuffer.clear();
+   WideProxyOffset = node_num;
+   ProxyBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 19 );
+
+   const int bottom_level_node_num = node_num - first_node;
+   if (bottom_level_node_num + wide_node_num == 0) return;
+
+   glMemoryBarrier( GL_BUFFER_UPDATE_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT );
+   glUseProgram( ProxyShader->getShaderProgram() );
+   ProxyShader->uniform1i( "NodeOffset", first_node );
+   ProxyShader->uniform1i( "NodeNum", bottom_level_node_num );
+   ProxyShader->uniform1i( "WideNodeNum", wide_node_num );
+   ProxyShader->uniform1i( "WideProxyOffset", node_num );
+   glDispatchCompute( (bottom_level_node_num + wide_node_num + GroupSize - 1) / GroupSize, 1, 1 );
+   glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+}
+
+void LevelOfDetailGL::bindBuffers() const
+{
+   ProxyBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 19 );
+}
\ No newline at end of file
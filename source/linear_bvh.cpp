@@ -0,0 +1,77 @@
+#include "linear_bvh.h"
+
+void LinearBVHGL::setShaders(const std::string& shader_directory_path)
+{
+   MortonShader = std::make_unique<ShaderGL>();
+   MortonShader->setComputeShader( std::string(shader_directory_path + "/lbvh_morton.comp").c_str() );
+   MortonShader->addUniformLocation( "SphereOffset" );
+   MortonShader->addUniformLocation( "SphereNum" );
+   MortonShader->addUniformLocation( "TriangleOffset" );
+   MortonShader->addUniformLocation( "PrimitiveNum" );
+   MortonShader->addUniformLocation( "SceneMin" );
+   MortonShader->addUniformLocation( "SceneSize" );
+
+   HierarchyShader = std::make_unique<ShaderGL>();
+   HierarchyShader->setComputeShader( std::string(shader_directory_path + "/lbvh_hierarchy.comp").c_str() );
+   HierarchyShader->addUniformLocation( "SphereOffset" );
+   HierarchyShader->addUniformLocation( "SphereNum" );
+   HierarchyShader->addUniformLocation( "TriangleOffset" );
+   HierarchyShader->addUniformLocation( "PrimitiveNum" );
+   HierarchyShader->addUniformLocation( "PrimitiveOffset" );
+   HierarchyShader->addUniformLocation( "NodeOffset" );
+   HierarchyShader->addUniformLocation( "LeafOffset" );
+
+   Sorter.setShaders( shader_directory_path );
+}
+
+void LinearBVHGL::setBuffers(int max_primitive_num)
+{
+   Sorter.setBuffers( std::max( max_primitive_num, 1 ) );
+}
+
+void LinearBVHGL::build(
+   const BoundingBox& bounds,
+   int sphere_offset,
+   int sphere_num,
+   int triangle_offset,
+   int triangle_num,
+   int node_offset,
+   int primitive_offset,
+   int leaf_offset,
+   const BufferGL& parent_buffer,
+   const BufferGL& leaf_buffer
+)
+{
+   const int primitive_num = sphere_num + triangle_num;
+   if (primitive_num == 0) return;
+
+   const int group_num = (primitive_num + GroupSize - 1) / GroupSize;
+   glUseProgram( MortonShader->getShaderProgram() );
+   MortonShader->uniform1i( "SphereOffset", sphere_offset );
+   MortonShader->uniform1i( "SphereNum", sphere_num );
+   MortonShader->uniform1i( "TriangleOffset", triangle_offset );
+   MortonShader->uniform1i( "PrimitiveNum", primitive_num );
+   MortonShader->uniform3fv( "SceneMin", bounds.Min );
+   MortonShader->uniform3fv( "SceneSize", glm::max( bounds.Max - bounds.Min, glm::vec3(1e-4f) ) );
+   Sorter.getKeyBuffer().bindBase( GL_SHADER_STORAGE_BUFFER, 4 );
+   Sorter.getValueBuffer().bindBase( GL_SHADER_STORAGE_BUFFER, 5 );
+   glDispatchCompute( group_num, 1, 1 );
+
+   Sorter.setElementNum( primitive_num );
+   Sorter.sort( MortonBitNum );
+
+   glUseProgram( HierarchyShader->getShaderProgram() );
+   HierarchyShader->uniform1i( "SphereOffset", sphere_offset );
+   HierarchyShader->uniform1i( "SphereNum", sphere_num );
+   HierarchyShader->uniform1i( "TriangleOffset", triangle_offset );
+   HierarchyShader->uniform1i( "PrimitiveNum", primitive_num );
+   HierarchyShader->uniform1i( "PrimitiveOffset", primitive_offset );
+   HierarchyShader->uniform1i( "NodeOffset", node_offset );
+   HierarchyShader->uniform1i( "LeafOffset", leaf_offset );
+   parent_buffer.bindBase( GL_SHADER_STORAGE_BUFFER, 0 );
+   leaf_buffer.bindBase( GL_SHADER_STORAGE_BUFFER, 1 );
+   Sorter.getSortedKeyBuffer().bindBase( GL_SHADER_STORAGE_BUFFER, 4 );
+   Sorter.getSortedValueBuffer().bindBase( GL_SHADER_STORAGE_BUFFER, 5 );
+   glDispatchCompute( group_num, 1, 1 );
+   glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+}
\ No newline at end of file
@@ -0,0 +1,239 @@
+#include "particle_importer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool ParticleImporter::parse(Settings& settings, const std::vector<std::string>& arguments)
+{
+   for (const auto& argument : arguments) {
+      const size_t separator = argument.find( '=' );
+      const std::string key = argument.substr( 0, separator );
+      const std::string value = separator == std::string::npos ? std::string() : argument.substr( separator + 1 );
+      std::istringstream stream(value);
+      bool valid = true;
+      if (key == "radius") valid = static_cast<bool>(stream >> settings.Radius) && settings.Radius > 0.0f;
+      else if (key == "albedo") {
+         float albedo;
+         valid = static_cast<bool>(stream >> albedo) && albedo >= 0.0f && albedo <= 1.0f;
+         if (valid) settings.Albedo = glm::vec3(albedo);
+      }
+      else if (key == "builder") {
+         auto builder = AccelerationStructureGL::BUILDER::LINEAR;
+         valid = AccelerationStructureGL::getBuilder( builder, value );
+         if (valid) settings.Builder = static_cast<int>(builder);
+      }
+      else valid = false;
+      if (!valid) {
+         std::cerr << "Could not parse " << argument << "\n";
+         return false;
+      }
+   }
+   return true;
+}
+
+bool ParticleImporter::open(const std::string& file_path)
+{
+   close();
+   const int descriptor = ::open( file_path.c_str(), O_RDONLY );
+   if (descriptor < 0) {
+      std::cerr << "Could not open particle file " << file_path << "\n";
+      return false;
+   }
+
+   struct stat status{};
+   if (fstat( descriptor, &status ) != 0 || status.st_size == 0) {
+      std::cerr << "Invalid particle file " << file_path << "\n";
+      ::close( descriptor );
+      return false;
+   }
+   void* mapped = mmap( nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0 );
+   ::close( descriptor );
+   if (mapped == MAP_FAILED) {
+      std::cerr << "Could not map particle file " << file_path << "\n";
+      return false;
+   }
+
+   // the particles are read once from the front to the back.
+   Data = static_cast<const uchar*>(mapped);
+   Size = static_cast<size_t>(status.st_size);
+   madvise( mapped, Size, MADV_SEQUENTIAL );
+
+   const size_t extension = file_path.rfind( '.' );
+   const std::string type = extension == std::string::npos ? std::string() : file_path.substr( extension + 1 );
+   bool valid = true;
+   Properties = {};
+   if (type == "xyz" || type == "xyzr") {
+      Stride = sizeof( float ) * type.size();
+      for (size_t i = 0; i < type.size(); ++i) Properties[i].Offset = static_cast<int>(sizeof( float ) * i);
+      valid = Size % Stride == 0;
+      ParticleNum = Size / Stride;
+   }
+   else valid = readPlyHeader();
+
+   // the spheres are indexed by the primitives below the marker of a sphere.
+   valid = valid && ParticleNum > 0 && ParticleNum < BVH::SpherePrimitive && Stride * ParticleNum <= Size - DataOffset;
+   if (!valid) {
+      std::cerr << "Invalid particle file " << file_path << "\n";
+      close();
+      return false;
+   }
+   return true;
+}
+
+bool ParticleImporter::readPlyHeader()
+{
+   const std::string end_header = "end_header";
+   const uchar* end = std::search( Data, Data + Size, end_header.begin(), end_header.end() );
+   if (end == Data + Size) return false;
+
+   DataOffset = static_cast<size_t>(end - Data) + end_header.size();
+   if (DataOffset < Size && Data[DataOffset] == '\r') DataOffset++;
+   if (DataOffset >= Size || Data[DataOffset] != '\n') return false;
+   DataOffset++;
+
+   const std::map<std::string, size_t> type_sizes = {
+      { "char", 1 }, { "uchar", 1 }, { "int8", 1 }, { "uint8", 1 }, { "short", 2 }, { "ushort", 2 }, { "int16", 2 },
+      { "uint16", 2 }, { "int", 4 }, { "uint", 4 }, { "int32", 4 }, { "uint32", 4 }, { "float", 4 }, { "float32", 4 },
+      { "double", 8 }, { "float64", 8 }
+   };
+   const std::array<std::string, 4> names = { "x", "y", "z", "radius" };
+   std::istringstream header(std::string(reinterpret_cast<const char*>(Data), reinterpret_cast<const char*>(end)));
+   std::string line, word;
+   bool little_endian = false, in_vertices = false, found_vertices = false;
+   Stride = 0;
+   ParticleNum = 0;
+   while (std::getline( header, line )) {
+      std::istringstream words(line);
+      words >> word;
+      if (word == "format") {
+         words >> word;
+         little_endian = word == "binary_little_endian";
+      }
+      else if (word == "element") {
+         // the vertices have to be the first element, as the elements before them could hold lists of any size.
+         words >> word;
+         if (!found_vertices && (word != "vertex" || !(words >> ParticleNum))) return false;
+         in_vertices = !found_vertices;
+         found_vertices = true;
+      }
+      else if (word == "property" && in_vertices) {
+         std::string type, name;
+         words >> type >> name;
+         if (type_sizes.count( type ) == 0) return false;
+
+         const auto property = std::find( names.begin(), names.end(), name );
+         if (property != names.end()) {
+            if (type != "float" && type != "float32" && type != "double" && type != "float64") return false;
+
+            Property& p = Properties[static_cast<size_t>(property - names.begin())];
+            p.Offset = static_cast<int>(Stride);
+            p.Double = type_sizes.at( type ) == sizeof( double );
+         }
+         Stride += type_sizes.at( type );
+      }
+   }
+   if (!little_endian) std::cerr << "Only binary little-endian PLY files are imported\n";
+   return little_endian && Properties[0].Offset >= 0 && Properties[1].Offset >= 0 && Properties[2].Offset >= 0;
+}
+
+void ParticleImporter::close()
+{
+   if (Data != nullptr) munmap( const_cast<uchar*>(Data), Size );
+   Data = nullptr;
+   Size = 0;
+   DataOffset = 0;
+   Stride = 0;
+   ParticleNum = 0;
+}
+
+void ParticleImporter::release(const uchar* data, size_t begin, size_t end)
+{
+   const size_t page_begin = begin / SceneFile::PageSize * SceneFile::PageSize;
+   const size_t page_end = end / SceneFile::PageSize * SceneFile::PageSize;
+   if (page_begin < page_end) madvise( const_cast<uchar*>(data) + page_begin, page_end - page_begin, MADV_DONTNEED );
+}
+
+void ParticleImporter::convert(Sphere* spheres, size_t begin, size_t end, BoundingBox& bounds, const Settings& settings) const
+{
+   const int thread_num = std::max( static_cast<int>(std::thread::hardware_concurrency()), 1 );
+   const size_t range_size = (end - begin + thread_num - 1) / thread_num;
+   std::vector<BoundingBox> range_bounds(static_cast<size_t>(thread_num));
+   const auto convert_range = [&](int range) {
+      const size_t range_begin = begin + range_size * range;
+      const size_t range_end = std::min( range_begin + range_size, end );
+      BoundingBox& b = range_bounds[range];
+      for (size_t i = range_begin; i < range_end; ++i) {
+         const uchar* record = Data + DataOffset + Stride * i;
+         Sphere& sphere = spheres[i];
+         sphere = Sphere(
+            Properties[3].Offset >= 0 ? getValue( record, Properties[3] ) : settings.Radius,
+            glm::vec3(getValue( record, Properties[0] ), getValue( record, Properties[1] ), getValue( record, Properties[2] )),
+            0
+         );
+         b.Min = glm::min( b.Min, sphere.Center - sphere.Radius );
+         b.Max = glm::max( b.Max, sphere.Center + sphere.Radius );
+      }
+   };
+
+   std::vector<std::thread> threads;
+   for (int i = 1; i < thread_num && begin + range_size * i < end; ++i) threads.emplace_back( convert_range, i );
+   convert_range( 0 );
+   for (auto& thread : threads) thread.join();
+   for (const auto& b : range_bounds) {
+      bounds.Min = glm::min( bounds.Min, b.Min );
+      bounds.Max = glm::max( bounds.Max, b.Max );
+   }
+}
+
+bool ParticleImporter::write(const std::string& scene_file_path, const Settings& settings) const
+{
+   const auto start = std::chrono::steady_clock::now();
+   const std::vector<Material> materials = { { Material::TYPE::LAMBERTIAN, settings.Albedo } };
+
+   using SECTION = SceneFile::SECTION;
+   std::array<SceneFile::SectionData, static_cast<int>(SECTION::COUNT)> sections;
+   sections[static_cast<int>(SECTION::MATERIALS)] = ArrayView<Material>(materials);
+   sections[static_cast<int>(SECTION::SPHERES)] = SceneFile::SectionData::getReserved<Sphere>( ParticleNum );
+   sections[static_cast<int>(SECTION::VERTICES)] = ArrayView<Vertex>();
+   sections[static_cast<int>(SECTION::TRIANGLES)] = ArrayView<Triangle>();
+   sections[static_cast<int>(SECTION::GEOMETRIES)] = SceneFile::SectionData::getReserved<SceneFile::GeometryRecord>( 1 );
+   sections[static_cast<int>(SECTION::INSTANCES)] = SceneFile::SectionData::getReserved<SceneFile::InstanceRecord>( 1 );
+
+   // the sections are filled in their order, so the bounds of the spheres are known for the records.
+   BoundingBox bounds;
+   const auto fill = [&](SECTION section, uchar* data) {
+      if (section == SECTION::SPHERES) {
+         for (size_t begin = 0; begin < ParticleNum; begin += BatchSize) {
+            const size_t end = std::min( begin + BatchSize, ParticleNum );
+            convert( reinterpret_cast<Sphere*>(data), begin, end, bounds, settings );
+            release( data, sizeof( Sphere ) * begin, sizeof( Sphere ) * end );
+            release( Data, DataOffset + Stride * begin, DataOffset + Stride * end );
+         }
+      }
+      else if (section == SECTION::GEOMETRIES) {
+         SceneFile::GeometryRecord geometry{};
+         geometry.Bounds = bounds;
+         geometry.SphereNum = static_cast<int>(ParticleNum);
+         geometry.Builder = settings.Builder;
+         std::memcpy( data, &geometry, sizeof( geometry ) );
+      }
+      else if (section == SECTION::INSTANCES) {
+         // the particles are centered in front of the camera, which looks down the negative z-axis.
+         SceneFile::InstanceRecord instance{};
+         const glm::vec3 center = 0.5f * (bounds.Min + bounds.Max);
+         instance.ToWorld = glm::translate( glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -glm::length( bounds.Max - bounds.Min )) );
+         instance.ToWorld = glm::translate( instance.ToWorld, -center );
+         instance.MaterialIndex = -1;
+         std::memcpy( data, &instance, sizeof( instance ) );
+      }
+      return true;
+   };
+   if (!SceneFile::write( scene_file_path, sections, 0, fill )) return false;
+
+   const auto end = std::chrono::steady_clock::now();
+   std::cout << "Imported Particles: " << ParticleNum << " spheres, written to " << scene_file_path << " in "
+      << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+   return true;
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include "perf_counters.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+PerfCounters::PerfCounters() : Descriptors(), StartCounts(), Counts()
+{
+   const std::array<uint64_t, static_cast<int>(EVENT::COUNT)> configs = {
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+      PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+   };
+   for (size_t i = 0; i < configs.size(); ++i) {
+      perf_event_attr attributes{};
+      attributes.size = sizeof( perf_event_attr );
+      attributes.type = PERF_TYPE_HW_CACHE;
+      attributes.config = configs[i];
+      attributes.disabled = 1;
+      attributes.inherit = 1;
+      attributes.exclude_kernel = 1;
+      attributes.exclude_hv = 1;
+      Descriptors[i] = static_cast<int>(syscall( SYS_perf_event_open, &attributes, 0, -1, -1, 0 ));
+   }
+}
+
+PerfCounters::~PerfCounters()
+{
+   for (const int descriptor : Descriptors) {
+      if (descriptor >= 0) close( descriptor );
+   }
+}
+
+const char* PerfCounters::getName(EVENT event)
+{
+   switch (event) {
+      case EVENT::L1D_MISSES: return "L1D";
+      case EVENT::LLC_MISSES: return "LLC";
+      default: return "";
+   }
+}
+
+uint64_t PerfCounters::read(int index) const
+{
+   uint64_t count = 0;
+   if (::read( Descriptors[index], &count, sizeof( count ) ) != static_cast<ssize_t>(sizeof( count ))) return 0;
+   return count;
+}
+
+void PerfCounters::start()
+{
+   Counts.fill( 0 );
+   for (int i = 0; i < static_cast<int>(Descriptors.size()); ++i) {
+      if (Descriptors[i] < 0) continue;
+
+      StartCounts[i] = read( i );
+      ioctl( Descriptors[i], PERF_EVENT_IOC_ENABLE, 0 );
+   }
+}
+
+void PerfCounters::stop()
+{
+   for (int i = 0; i < static_cast<int>(Descriptors.size()); ++i) {
+      if (Descriptors[i] < 0) continue;
+
+      ioctl( Descriptors[i], PERF_EVENT_IOC_DISABLE, 0 );
+      const uint64_t count = read( i );
+      Counts[i] = count >= StartCounts[i] ? count - StartCounts[i] : 0;
+   }
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include "radix_sort.h"
+
+RadixSortGL::RadixSortGL() : ResultIndex( 0 )
+{
+}
+
+void RadixSortGL::setShaders(const std::string& shader_directory_path)
+{
+   HistogramShader = std::make_unique<ShaderGL>();
+   HistogramShader->setComputeShader( std::string(shader_directory_path + "/radix_sort_histogram.comp").c_str() );
+   HistogramShader->addUniformLocation( "Shift" );
+
+   ScanShader = std::make_unique<ShaderGL>();
+   ScanShader->setComputeShader( std::string(shader_directory_path + "/radix_sort_scan.comp").c_str() );
+
+   ScatterShader = std::make_unique<ShaderGL>();
+   ScatterShader->setComputeShader( std::string(shader_directory_path + "/radix_sort_scatter.comp").c_str() );
+   ScatterShader->addUniformLocation( "Shift" );
+}
+
+void RadixSortGL::setBuffers(int max_element_num)
+{
+   constexpr int radix_size = 256;
+   const auto size = static_cast<GLsizeiptr>(sizeof( GLuint ) * max_element_num);
+   InfoBuffer.create( sizeof( glm::uvec4 ) );
+   HistogramBuffer.create( static_cast<GLsizeiptr>(sizeof( GLuint ) * radix_size * getBlockNum( max_element_num )) );
+   for (int i = 0; i < 2; ++i) {
+      KeyBuffers[i].create( size );
+      ValueBuffers[i].create( size );
+   }
+}
+
+void RadixSortGL::setElementNum(int element_num) const
+{
+   const std::vector<glm::uvec4> info = {
+      glm::uvec4(getBlockNum( element_num ), 1, 1, static_cast<GLuint>(element_num))
+   };
+   InfoBuffer.update( info );
+}
+
+void RadixSortGL::sort(int key_bit_num)
+{
+   int source = 0;
+   InfoBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 0 );
+   HistogramBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 5 );
+   glBindBuffer( GL_DISPATCH_INDIRECT_BUFFER, InfoBuffer.getBufferID() );
+   glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT );
+   for (int shift = 0; shift < key_bit_num; shift += 8) {
+      KeyBuffers[source].bindBase( GL_SHADER_STORAGE_BUFFER, 1 );
+      ValueBuffers[source].bindBase( GL_SHADER_STORAGE_BUFFER, 2 );
+      KeyBuffers[source ^ 1].bindBase( GL_SHADER_STORAGE_BUFFER, 3 );
+      ValueBuffers[source ^ 1].bindBase( GL_SHADER_STORAGE_BUFFER, 4 );
+
+      glUseProgram( HistogramShader->getShaderProgram() );
+      HistogramShader->uniform1ui( "Shift", static_cast<GLuint>(shift) );
+      glDispatchComputeIndirect( 0 );
+      glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+
+      glUseProgram( ScanShader->getShaderProgram() );
+      glDispatchCompute( 1, 1, 1 );
+      glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+
+      glUseProgram( ScatterShader->getShaderProgram() );
+      ScatterShader->uniform1ui( "Shift", static_cast<GLuint>(shift) );
+      glDispatchComputeIndirect( 0 );
+      glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+
+      source ^= 1;
+   }
+   ResultIndex = source;
+}
\ No newline at end of file
@@ -1,8 +1,15 @@
 #include "renderer.h"
 
 RendererGL::RendererGL() : 
-   Window( nullptr ), FrameWidth( 2000 ), FrameHeight( 1000 ), FrameIndex( 0 ), ClickedPoint( -1, -1 ),
-   MainCamera( std::make_unique<CameraGL>() ), ScreenObject( std::make_unique<ObjectGL>() )
+   Window( nullptr ), FrameWidth( 2000 ), FrameHeight( 1000 ), FrameIndex( 0 ), AnimatedGeometry( -1 ), AnimationStep( 0 ),
+   LevelOfDetail( 0 ),
+   UseRasterizedPrimary( false ), UseTileCulling( true ), SubgroupSupported( false ), UseSubgroupTraversal( false ),
+   CollectStatistics( false ), UseWavefront( false ), UseCPUTracer( false ),
+   UseLazyBuild( false ), UseCacheLayout( true ), UseEightWideNodes( true ),
+   UseRayStreams( false ), Animate( false ),
+   DispatchTimer( 0 ), MemoryBudget( 0 ), ClickedPoint( -1, -1 ), MainCamera( std::make_unique<CameraGL>() ),
+   ScreenObject( std::make_unique<ObjectGL>() ), ImpostorObject( std::make_unique<ObjectGL>() ),
+   MeshObject( std::make_unique<ObjectGL>() )
 {
    Renderer = this;
 
@@ -17,9 +24,45 @@ void RendererGL::printOpenGLInformation()
    std::cout << " - OpenGL renderer: " << glGetString( GL_RENDERER ) << "\n";
    std::cout << " - OpenGL version supported: " << glGetString( GL_VERSION ) << "\n";
    std::cout << " - OpenGL shader version supported: " << glGetString( GL_SHADING_LANGUAGE_VERSION ) << "\n";
+   if (isSubgroupTraversalSupported()) {
+      GLint subgroup_size = 0;
+      glGetIntegerv( OPENGL_SUBGROUP_SIZE, &subgroup_size );
+      std::cout << " - Subgroup size: " << subgroup_size << "\n";
+   }
+   else if (isArbSubgroupTraversalSupported()) std::cout << " - Subgroup operations: ARB shader ballot and group vote\n";
+   else std::cout << " - Subgroup operations: not supported, primary rays fall back to per-lane traversal\n";
    std::cout << "================================================================================================\n";
 }
 
+bool RendererGL::hasExtension(const std::string& name)
+{
+   GLint extension_num = 0;
+   glGetIntegerv( GL_NUM_EXTENSIONS, &extension_num );
+   for (GLint i = 0; i < extension_num; ++i) {
+      if (reinterpret_cast<const char*>(glGetStringi( GL_EXTENSIONS, i )) == name) return true;
+   }
+   return false;
+}
+
+bool RendererGL::isSubgroupTraversalSupported()
+{
+   if (!hasExtension( "GL_KHR_shader_subgroup" )) return false;
+
+   GLint stages = 0, features = 0;
+   glGetIntegerv( OPENGL_SUBGROUP_SUPPORTED_STAGES, &stages );
+   glGetIntegerv( OPENGL_SUBGROUP_SUPPORTED_FEATURES, &features );
+   constexpr uint required_features =
+      OPENGL_SUBGROUP_FEATURE_BASIC_BIT | OPENGL_SUBGROUP_FEATURE_VOTE_BIT | OPENGL_SUBGROUP_FEATURE_BALLOT_BIT;
+   return (static_cast<uint>(stages) & GL_COMPUTE_SHADER_BIT) != 0 &&
+      (static_cast<uint>(features) & required_features) == required_features;
+}
+
+bool RendererGL::isArbSubgroupTraversalSupported()
+{
+   return hasExtension( "GL_ARB_shader_ballot" ) && hasExtension( "GL_ARB_shader_group_vote" ) &&
+      hasExtension( "GL_ARB_gpu_shader_int64" );
+}
+
 void RendererGL::initialize()
 {
    if (!glfwInit()) {
@@ -47,8 +90,14 @@ void RendererGL::initialize()
    MainCamera->updateWindowSize( FrameWidth, FrameHeight );
 
    const std::string shader_directory_path = std::string(CMAKE_SOURCE_DIR) + "/shaders";
+   // the subgroup traversal is compiled only where the driver supports it, and the shader falls back otherwise.
+   std::vector<std::string> subgroup_definitions;
+   if (isSubgroupTraversalSupported()) subgroup_definitions = { "USE_SUBGROUP" };
+   else if (isArbSubgroupTraversalSupported()) subgroup_definitions = { "USE_SUBGROUP", "USE_ARB_SUBGROUP" };
+   SubgroupSupported = !subgroup_definitions.empty();
+   UseSubgroupTraversal = SubgroupSupported;
    Shader = std::make_unique<ShaderGL>();
-   Shader->setComputeShader( std::string(shader_directory_path + "/raytracer.comp").c_str() );
+   Shader->setComputeShader( std::string(shader_directory_path + "/raytracer.comp").c_str(), subgroup_definitions );
    Shader->setRayUniformLocations();
 
    ScreenShader = std::make_unique<ShaderGL>();
@@ -58,8 +107,39 @@ void RendererGL::initialize()
    );
    ScreenShader->setScreenUniformLocations();
 
+   ImpostorShader = std::make_unique<ShaderGL>();
+   ImpostorShader->setShader(
+      std::string(shader_directory_path + "/sphere_impostor.vert").c_str(),
+      std::string(shader_directory_path + "/sphere_impostor.frag").c_str()
+   );
+   ImpostorShader->setImpostorUniformLocations();
+
+   MeshShader = std::make_unique<ShaderGL>();
+   MeshShader->setShader(
+      std::string(shader_directory_path + "/mesh.vert").c_str(),
+      std::string(shader_directory_path + "/mesh.frag").c_str()
+   );
+   MeshShader->setMeshUniformLocations();
+
    FinalCanvas = std::make_unique<CanvasGL>();
    FinalCanvas->setCanvas( FrameWidth, FrameHeight, GL_RGBA8 );
+
+   PrimaryCanvas = std::make_unique<CanvasGL>();
+   PrimaryCanvas->setMultipleRenderTargetCanvas( FrameWidth, FrameHeight, { GL_RGBA32F, GL_RGBA16F, GL_R32F } );
+
+   const int group_num = getGroupSize( FrameWidth ) * getGroupSize( FrameHeight );
+   MaterialBuffer = std::make_unique<BufferGL>();
+   Scene = std::make_unique<AccelerationStructureGL>();
+   Scene->setShaders( shader_directory_path );
+   StatisticsBuffer = std::make_unique<BufferGL>();
+   StatisticsBuffer->create( static_cast<GLsizeiptr>(sizeof( glm::uvec2 ) * group_num) );
+   glCreateQueries( GL_TIME_ELAPSED, 1, &DispatchTimer );
+
+   Wavefront = std::make_unique<WavefrontGL>();
+   Wavefront->setShaders( shader_directory_path );
+   Wavefront->setBuffers( FrameWidth, FrameHeight );
+   Tracer = std::make_unique<CPUTracer>();
+   TracerCounters = std::make_unique<PerfCounters>();
 }
 
 void RendererGL::cleanup(GLFWwindow* window)
@@ -74,6 +154,117 @@ void RendererGL::keyboard(GLFWwindow* window, int key, int scancode, int action,
    if (action != GLFW_PRESS) return;
 
    switch (key) {
+      case GLFW_KEY_R:
+         Renderer->UseRasterizedPrimary = !Renderer->UseRasterizedPrimary;
+         std::cout << "Primary Visibility: " << (Renderer->UseRasterizedPrimary ? "Rasterized" : "Ray Casted") << "\n";
+         break;
+      case GLFW_KEY_T:
+         Renderer->UseTileCulling = !Renderer->UseTileCulling;
+         std::cout << "Tile Culling: " << (Renderer->UseTileCulling ? "On" : "Off") << "\n";
+         break;
+      case GLFW_KEY_G:
+         if (Renderer->SubgroupSupported) {
+            Renderer->UseSubgroupTraversal = !Renderer->UseSubgroupTraversal;
+            std::cout << "Subgroup Traversal: " << (Renderer->UseSubgroupTraversal ? "On" : "Off") << "\n";
+         }
+         else std::cout << "Subgroup Traversal: Not Supported\n";
+         break;
+      case GLFW_KEY_S:
+         Renderer->CollectStatistics = !Renderer->CollectStatistics;
+         break;
+      case GLFW_KEY_W:
+         Renderer->UseWavefront = !Renderer->UseWavefront;
+         std::cout << "Execution: " << (Renderer->UseWavefront ? "Wavefront" : "Megakernel") << "\n";
+         break;
+      case GLFW_KEY_O: {
+         const auto sorting = static_cast<WavefrontGL::SORTING>((static_cast<int>(Renderer->Wavefront->getSorting()) + 1) % 3);
+         Renderer->Wavefront->setSorting( sorting );
+         std::cout << "Ray Sorting: "
+            << (sorting == WavefrontGL::SORTING::OFF ? "Off" : sorting == WavefrontGL::SORTING::AUTO ? "Auto" : "Always")
+            << "\n";
+      } break;
+      case GLFW_KEY_F: {
+         const auto format = static_cast<WavefrontGL::ACCUMULATION>(
+            (static_cast<int>(Renderer->Wavefront->getAccumulationFormat()) + 1) % 4
+         );
+         Renderer->Wavefront->setAccumulationFormat( format );
+         std::cout << "Accumulation Format: " << getAccumulationFormatName( format ) << "\n";
+      } break;
+      case GLFW_KEY_M:
+         Renderer->Wavefront->setMaterialSorting( !Renderer->Wavefront->getMaterialSorting() );
+         std::cout << "Material Sorting: " << (Renderer->Wavefront->getMaterialSorting() ? "On" : "Off") << "\n";
+         break;
+      case GLFW_KEY_A:
+         Renderer->Animate = !Renderer->Animate;
+         std::cout << "Animation: " << (Renderer->Animate ? "On" : "Off") << "\n";
+         break;
+      case GLFW_KEY_L: {
+         if (Renderer->AnimatedGeometry < 0) break;
+
+         const auto builder = static_cast<AccelerationStructureGL::BUILDER>(
+            (static_cast<int>(Renderer->Scene->getGeometry( Renderer->AnimatedGeometry ).Builder) + 1) % 4
+         );
+         Renderer->Scene->setBuilder( Renderer->AnimatedGeometry, builder );
+         Renderer->Scene->update();
+         std::cout << "Sphere Acceleration: " << getBuilderName( builder ) << "\n";
+      } break;
+      case GLFW_KEY_D: {
+         const int level = (Renderer->LevelOfDetail + 1) % static_cast<int>(LevelOfDetailBiases.size());
+         if (Renderer->Scene->hasProxies() != (level > 0)) {
+            Renderer->Scene->setProxies( level > 0 ? Renderer->MaterialBuffer.get() : nullptr );
+         }
+         if (level > 0 && !Renderer->Scene->hasProxies()) {
+            std::cout << "Level of Detail: Not Supported for Paged Scenes\n";
+            break;
+         }
+         Renderer->LevelOfDetail = level;
+         if (level == 0) std::cout << "Level of Detail: Off\n";
+         else std::cout << "Level of Detail: Bias " << LevelOfDetailBiases[level] << "\n";
+      } break;
+      case GLFW_KEY_K:
+         Renderer->benchmarkLevelOfDetail();
+         break;
+      case GLFW_KEY_V:
+         Renderer->optimizeScene();
+         break;
+      case GLFW_KEY_C:
+         Renderer->UseCPUTracer = !Renderer->UseCPUTracer;
+         std::cout << "Tracer: " << (Renderer->UseCPUTracer ? "CPU" : "GPU") << "\n";
+         break;
+      case GLFW_KEY_Z:
+         Renderer->UseLazyBuild = !Renderer->UseLazyBuild;
+         std::cout << "CPU Tracer Nodes: " << (Renderer->UseLazyBuild ? "Built Lazily" : "Read from the GPU") << "\n";
+         break;
+      case GLFW_KEY_N:
+         Renderer->UseCacheLayout = !Renderer->UseCacheLayout;
+         std::cout << "CPU Tracer Node Layout: " << (Renderer->UseCacheLayout ? "Cache Lines" : "As in the Buffers") << "\n";
+         break;
+      case GLFW_KEY_X:
+         if (!Renderer->Tracer->isSimdSupported()) {
+            std::cout << "CPU Tracer Bottom-level Nodes: 8-wide needs AVX2\n";
+            break;
+         }
+         Renderer->UseEightWideNodes = !Renderer->UseEightWideNodes;
+         std::cout << "CPU Tracer Bottom-level Nodes: " << (Renderer->UseEightWideNodes ? "8-wide" : "As on the GPU") << "\n";
+         break;
+      case GLFW_KEY_Y:
+         Renderer->UseRayStreams = !Renderer->UseRayStreams;
+         std::cout << "CPU Tracer Paths: " << (Renderer->UseRayStreams ? "Streamed in Batches" : "One at a Time") << "\n";
+         break;
+      case GLFW_KEY_B: {
+         if (Renderer->Scene->isStatic()) break;
+
+         const bool wide = Renderer->Scene->getNodeFormat() == AccelerationStructureGL::NODE_FORMAT::BINARY;
+         Renderer->Scene->setNodeFormat(
+            wide ? AccelerationStructureGL::NODE_FORMAT::WIDE : AccelerationStructureGL::NODE_FORMAT::BINARY
+         );
+         Renderer->Scene->update();
+         std::cout << "Bottom-level Nodes: " << (wide ? "Wide" : "Binary") << "\n";
+      } break;
+      case GLFW_KEY_E:
+         // the file is written with the buffers, so it is loaded back without building anything.
+         if (Renderer->Scene->save( "../scene.rtsc", Renderer->Materials )) std::cout << "Scene Saved: ../scene.rtsc\n";
+         break;
       case GLFW_KEY_Q:
       case GLFW_KEY_ESCAPE:
          cleanupWrapper( window );
@@ -97,24 +288,393 @@ void RendererGL::registerCallbacks() const
    glfwSetFramebufferSizeCallback( Window, reshapeWrapper );
 }
 
-void RendererGL::setSpheres()
+void RendererGL::getCubeMesh(std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals, std::vector<uint>& indices)
 {
-   Spheres = {
-      { Sphere::TYPE::LAMBERTIAN, 0.5f, glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.8f, 0.3f, 0.3f) },
-      { Sphere::TYPE::LAMBERTIAN, 100.0f, glm::vec3(0.0f, -100.5f, -1.0f), glm::vec3(0.8f, 0.8f, 0.0f) },
-      { Sphere::TYPE::METAL, 0.5f, glm::vec3(1.0f, 0.0f, -1.0f), glm::vec3(0.8f, 0.6f, 0.2f) },
-      { Sphere::TYPE::METAL, 0.5f, glm::vec3(-1.0f, 0.0f, -1.0f), glm::vec3(0.8f, 0.8f, 0.8f) }
+   // each face has its own four vertices, so that the normals stay flat across the edges.
+   const std::array<glm::vec3, 6> face_normals = {
+      glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+      glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+      glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
    };
+   vertices.clear();
+   normals.clear();
+   indices.clear();
+   for (const auto& n : face_normals) {
+      const glm::vec3 u(n.y, n.z, n.x);
+      const glm::vec3 v = glm::cross( n, u );
+      const auto base = static_cast<uint>(vertices.size());
+      vertices.emplace_back( n - u - v );
+      vertices.emplace_back( n + u - v );
+      vertices.emplace_back( n + u + v );
+      vertices.emplace_back( n - u + v );
+      normals.insert( normals.end(), 4, n );
+      indices.insert( indices.end(), { base, base + 1, base + 2, base, base + 2, base + 3 } );
+   }
+}
+
+int RendererGL::addMesh(
+   const std::vector<glm::vec3>& vertices,
+   const std::vector<glm::vec3>& normals,
+   const std::vector<uint>& indices,
+   int material_index
+) const
+{
+   std::vector<Vertex> mesh_vertices;
+   std::vector<Triangle> mesh_triangles;
+   for (size_t i = 0; i < vertices.size(); ++i) mesh_vertices.emplace_back( vertices[i], normals[i] );
+   for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+      mesh_triangles.emplace_back( indices[i], indices[i + 1], indices[i + 2], material_index );
+   }
+   return Scene->addGeometry(
+      {}, mesh_vertices, mesh_triangles, AccelerationStructureGL::chooseBuilder( {}, mesh_vertices, mesh_triangles )
+   );
+}
+
+void RendererGL::setScene()
+{
+   Materials = {
+      { Material::TYPE::LAMBERTIAN, glm::vec3(0.8f, 0.3f, 0.3f) },
+      { Material::TYPE::LAMBERTIAN, glm::vec3(0.8f, 0.8f, 0.0f) },
+      { Material::TYPE::METAL, glm::vec3(0.8f, 0.6f, 0.2f) },
+      { Material::TYPE::METAL, glm::vec3(0.8f, 0.8f, 0.8f) },
+      { Material::TYPE::LAMBERTIAN, glm::vec3(0.2f, 0.4f, 0.8f) }
+   };
+   const std::vector<Sphere> spheres = {
+      { 0.5f, glm::vec3(0.0f, 0.0f, -1.0f), 0 },
+      { 100.0f, glm::vec3(0.0f, -100.5f, -1.0f), 1 },
+      { 0.5f, glm::vec3(1.0f, 0.0f, -1.0f), 2 },
+      { 0.5f, glm::vec3(-1.0f, 0.0f, -1.0f), 3 }
+   };
+   Scene->clear();
+   AnimatedSpheres = spheres;
+   AnimatedGeometry = Scene->addGeometry( spheres, {}, {}, AccelerationStructureGL::chooseBuilder( spheres, {}, {} ) );
+   Scene->addInstance( AnimatedGeometry, glm::mat4(1.0f) );
+
+   // the cube is stored once and placed three times, and two of the copies replace its material.
+   std::vector<glm::vec3> vertices, normals;
+   std::vector<uint> indices;
+   getCubeMesh( vertices, normals, indices );
+   const int cube = addMesh( vertices, normals, indices, 4 );
+   const std::array<glm::vec4, 3> placements = {
+      glm::vec4(0.5f, -0.4f, -0.7f, 30.0f),
+      glm::vec4(-0.5f, -0.4f, -0.7f, -20.0f),
+      glm::vec4(0.0f, -0.43f, -0.45f, 45.0f)
+   };
+   const std::array<int, 3> materials = { -1, 0, 3 };
+   for (size_t i = 0; i < placements.size(); ++i) {
+      glm::mat4 to_world = glm::translate( glm::mat4(1.0f), glm::vec3(placements[i]) );
+      to_world = glm::rotate( to_world, glm::radians( placements[i].w ), glm::vec3(0.0f, 1.0f, 0.0f) );
+      to_world = glm::scale( to_world, glm::vec3(i == 2 ? 0.07f : 0.1f) );
+      Scene->addInstance( cube, to_world, materials[i] );
+   }
+
+   const auto start = std::chrono::steady_clock::now();
+   Scene->update();
+   const auto end = std::chrono::steady_clock::now();
+   std::cout << "Acceleration Structure: " << Scene->getInstanceNum() << " instances, "
+      << Scene->getGeometrySize() / 1024.0 << " KB of geometry, " << Scene->getInstanceSize() / 1024.0
+      << " KB of instances, built in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+   std::cout << "Bottom-level Nodes: "
+      << Scene->getBottomLevelNodeSize( AccelerationStructureGL::NODE_FORMAT::BINARY ) / 1024.0 << " KB binary, "
+      << Scene->getBottomLevelNodeSize( AccelerationStructureGL::NODE_FORMAT::WIDE ) / 1024.0 << " KB wide\n";
+   std::cout << "Sphere Acceleration: " << getBuilderName( Scene->getGeometry( AnimatedGeometry ).Builder ) << "\n";
+   MaterialBuffer->create( Materials );
+}
+
+bool RendererGL::loadScene(const std::string& scene_file_path)
+{
+   const auto start = std::chrono::steady_clock::now();
+   auto file = std::make_shared<SceneFile>();
+   if (!file->open( scene_file_path )) return false;
+
+   ArrayView<Material> materials;
+   const bool prebuilt = file->hasAccelerationStructure();
+   const size_t file_size = file->getSize();
+   // the acceleration structure is cached next to a scene which comes without it.
+   Scene->setMemoryBudget( MemoryBudget );
+   if (!file->get( materials, SceneFile::SECTION::MATERIALS ) || !Scene->load( file, scene_file_path + ".cache" )) {
+      std::cerr << "Invalid scene file " << scene_file_path << "\n";
+      return false;
+   }
+
+   // the materials are few, and the CPU tracer takes them from the renderer.
+   Materials.assign( materials.begin(), materials.end() );
+   MaterialBuffer->create( Materials );
+   AnimatedGeometry = -1;
+   Scene->update();
+   glFinish();
+   const auto end = std::chrono::steady_clock::now();
+   std::cout << "Scene File: " << Scene->getInstanceNum() << " instances, " << file_size / 1024.0 << " KB mapped, "
+      << (prebuilt ? "uploaded" : Scene->isStatic() ? "uploaded from the cache" : "built and cached") << " in "
+      << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+   if (const ResidencyGL* residency = Scene->getResidency()) {
+      std::cout << "Paging: " << residency->getResidentNum() << " of " << residency->getChunkNum() << " chunks resident in "
+         << residency->getPoolSize() / (1024.0 * 1024.0) << " MB\n";
+   }
+   return true;
+}
+
+void RendererGL::setImpostorObject()
+{
+   const std::vector<glm::vec3> corners = {
+      { -1.0f, -1.0f, 0.0f },
+      { 1.0f, -1.0f, 0.0f },
+      { -1.0f, 1.0f, 0.0f },
+      { 1.0f, 1.0f, 0.0f }
+   };
+   ImpostorObject->setObject( GL_TRIANGLE_STRIP, corners );
+}
+
+void RendererGL::setMeshObject()
+{
+   // the rasterizer draws the triangles unindexed, so the shared vertices are expanded in the order of the triangles.
+   // they stay in the object space of their geometry, and each instance is drawn with its own transform.
+   if (Scene->getTriangles().empty()) return;
+
+   const ArrayView<Vertex> scene_vertices = Scene->getVertices();
+
+   std::vector<glm::vec3> vertices, normals;
+   for (const auto& triangle : Scene->getTriangles()) {
+      for (const auto& index : triangle.Indices) {
+         vertices.emplace_back( scene_vertices[index].Position );
+         normals.emplace_back( scene_vertices[index].Normal );
+      }
+   }
+   MeshObject->setObject( GL_TRIANGLES, vertices, normals );
+}
+
+void RendererGL::drawPrimaryVisibility() const
+{
+   // this matches the pinhole camera of the ray tracer, whose image plane spans [-1, 1] vertically at z = -1.
+   const glm::mat4 projection = glm::perspective(
+      glm::half_pi<float>(),
+      static_cast<float>(FrameWidth) / static_cast<float>(FrameHeight),
+      0.01f, 1000.0f
+   );
+
+   glViewport( 0, 0, FrameWidth, FrameHeight );
+   glBindFramebuffer( GL_FRAMEBUFFER, PrimaryCanvas->getCanvasID() );
+   PrimaryCanvas->clearColor( 0 );
+   PrimaryCanvas->clearColor( 1 );
+   PrimaryCanvas->clearColor( 2 );
+   PrimaryCanvas->clearDepth();
+
+   glUseProgram( ImpostorShader->getShaderProgram() );
+   ImpostorShader->transferSphereUniformsToShader( Scene->getSpheres() );
+   ImpostorShader->uniformMat4fv( "ProjectionMatrix", projection );
+   ImpostorShader->uniform2iv( "FrameSize", glm::ivec2(FrameWidth, FrameHeight) );
+   glBindVertexArray( ImpostorObject->getVAO() );
+   for (int i = 0; i < Scene->getInstanceNum(); ++i) {
+      const auto& geometry = Scene->getGeometry( Scene->getInstanceGeometry( i ) );
+      if (geometry.SphereNum == 0) continue;
+
+      ImpostorShader->uniformMat4fv( "WorldMatrix", Scene->getInstanceTransform( i ) );
+      ImpostorShader->uniform1i( "SphereOffset", geometry.SphereOffset );
+      ImpostorShader->uniform1i( "MaterialIndex", Scene->getInstanceMaterial( i ) );
+      glDrawArraysInstanced( ImpostorObject->getDrawMode(), 0, ImpostorObject->getVertexNum(), geometry.SphereNum );
+   }
+
+   glUseProgram( MeshShader->getShaderProgram() );
+   MeshShader->uniformMat4fv( "ProjectionMatrix", projection );
+   glBindVertexArray( MeshObject->getVAO() );
+   for (int i = 0; i < Scene->getInstanceNum(); ++i) {
+      const auto& geometry = Scene->getGeometry( Scene->getInstanceGeometry( i ) );
+      if (geometry.TriangleNum == 0) continue;
+
+      MeshShader->uniformMat4fv( "WorldMatrix", Scene->getInstanceTransform( i ) );
+      MeshShader->uniform1i( "MaterialIndex", Scene->getInstanceMaterial( i ) );
+      glDrawArrays( MeshObject->getDrawMode(), geometry.TriangleOffset * 3, geometry.TriangleNum * 3 );
+   }
+   glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+}
+
+void RendererGL::drawSceneOnCPU() const
+{
+   const auto start = std::chrono::steady_clock::now();
+   if (UseLazyBuild) Tracer->setLazyScene( *Scene, Materials );
+   else Tracer->setScene( *Scene, Materials, UseCacheLayout, UseEightWideNodes );
+   if (CollectStatistics) TracerCounters->start();
+   Tracer->render( FrameWidth, FrameHeight, FrameIndex, UseRayStreams );
+   if (CollectStatistics) TracerCounters->stop();
+   glTextureSubImage2D(
+      FinalCanvas->getColor0TextureID(), 0, 0, 0, FrameWidth, FrameHeight,
+      GL_RGBA, GL_UNSIGNED_BYTE, Tracer->getImage().data()
+   );
+   const auto end = std::chrono::steady_clock::now();
+   if (CollectStatistics) {
+      std::cout << "CPU Tracer: " << std::chrono::duration<double, std::milli>(end - start).count() << " ms with "
+         << Tracer->getThreadNum() << " threads";
+      if (Tracer->isLazy()) std::cout << ", " << Tracer->getBuiltNodeNum() << " of " << Tracer->getMaxNodeNum() << " nodes built";
+      for (int i = 0; i < static_cast<int>(PerfCounters::EVENT::COUNT); ++i) {
+         const auto event = static_cast<PerfCounters::EVENT>(i);
+         if (!TracerCounters->isAvailable( event )) continue;
+
+         std::cout << ", " << std::fixed << std::setprecision( 2 )
+            << static_cast<double>(TracerCounters->get( event )) / static_cast<double>(FrameWidth * FrameHeight)
+            << " " << PerfCounters::getName( event ) << " misses per pixel";
+      }
+      std::cout << "\n";
+   }
 }
 
 void RendererGL::drawScene() const
 {
+   if (UseCPUTracer) {
+      drawSceneOnCPU();
+      return;
+   }
+
+   Scene->bindBuffers();
+   MaterialBuffer->bindBase( GL_SHADER_STORAGE_BUFFER, 9 );
+   if (UseWavefront) {
+      if (CollectStatistics) glBeginQuery( GL_TIME_ELAPSED, DispatchTimer );
+      Wavefront->render(
+         Scene->getSpheres(), Scene->getSceneBounds(), static_cast<int>(Materials.size()), FrameIndex, FinalCanvas.get()
+      );
+      if (CollectStatistics) {
+         glEndQuery( GL_TIME_ELAPSED );
+         printWavefrontStatistics();
+      }
+      return;
+   }
+
+   // the impostors read the spheres of the scene, which a paged scene has only in its pages.
+   const bool rasterized_primary = UseRasterizedPrimary && !Scene->isPaged();
+   if (rasterized_primary) drawPrimaryVisibility();
+
    glUseProgram( Shader->getShaderProgram() );
-   Shader->transferSphereUniformsToShader( Spheres );
+   Shader->transferSphereUniformsToShader( Scene->getSpheres() );
    Shader->uniform1i( "FrameIndex", FrameIndex );
+   Shader->uniform1i( "UseRasterizedPrimary", rasterized_primary ? 1 : 0 );
+   // the tiles only list the spheres of the world, so the other scenes trace their primary rays through the BVH.
+   Shader->uniform1i( "UseTileCulling", UseTileCulling && Scene->hasOnlyWorldSpheres() ? 1 : 0 );
+   Shader->uniform1i( "UseSubgroupTraversal", UseSubgroupTraversal ? 1 : 0 );
+   Shader->uniform1i( "CollectStatistics", CollectStatistics ? 1 : 0 );
+   Shader->uniform1i( "UseResidency", Scene->isPaged() ? 1 : 0 );
+   Shader->uniform1f( "LevelOfDetailBias", Scene->hasProxies() ? LevelOfDetailBiases[LevelOfDetail] : 0.0f );
+   Shader->uniform1i( "WideProxyOffset", Scene->getWideProxyOffset() );
    glBindImageTexture( 0, FinalCanvas->getColor0TextureID(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA8 );
+   if (rasterized_primary) {
+      glBindTextureUnit( 1, PrimaryCanvas->getColorTextureID( 0 ) );
+      glBindTextureUnit( 2, PrimaryCanvas->getColorTextureID( 1 ) );
+      glBindTextureUnit( 3, PrimaryCanvas->getColorTextureID( 2 ) );
+   }
+   StatisticsBuffer->bindBase( GL_SHADER_STORAGE_BUFFER, 1 );
+
+   if (CollectStatistics) glBeginQuery( GL_TIME_ELAPSED, DispatchTimer );
    glDispatchCompute( getGroupSize( FrameWidth ), getGroupSize( FrameHeight ), 1 );
-   glMemoryBarrier( GL_SHADER_IMAGE_ACCESS_BARRIER_BIT );
+   if (CollectStatistics) glEndQuery( GL_TIME_ELAPSED );
+   glMemoryBarrier( GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT );
+
+   if (CollectStatistics) printStatistics( getGroupSize( FrameWidth ) * getGroupSize( FrameHeight ) );
+}
+
+void RendererGL::benchmarkLevelOfDetail()
+{
+   if (UseWavefront || UseCPUTracer || LevelOfDetail == 0) {
+      std::cout << "Level of Detail Benchmark: needs the proxies and the megakernel on the GPU\n";
+      return;
+   }
+
+   // the same frames are traced with every node and with the proxies, so the pixels start from the same seeds,
+   // and the difference of the images is the error of the proxies along with the noise of the paths they change.
+   const int level = LevelOfDetail;
+   const int frame_index = FrameIndex;
+   const size_t size = static_cast<size_t>(FrameWidth) * static_cast<size_t>(FrameHeight) * 4;
+   std::array<double, 2> times{};
+   std::array<std::vector<uint8_t>, 2> images;
+   for (int i = 0; i < 2; ++i) {
+      LevelOfDetail = i == 0 ? 0 : level;
+      glFinish();
+      const auto start = std::chrono::steady_clock::now();
+      for (int frame = 0; frame < BenchmarkFrameNum; ++frame) {
+         FrameIndex = frame_index + frame;
+         drawScene();
+      }
+      glFinish();
+      const auto end = std::chrono::steady_clock::now();
+      times[i] = std::chrono::duration<double, std::milli>(end - start).count() / BenchmarkFrameNum;
+      images[i].resize( size );
+      glGetTextureImage(
+         FinalCanvas->getColor0TextureID(), 0, GL_RGBA, GL_UNSIGNED_BYTE, static_cast<GLsizei>(size), images[i].data()
+      );
+   }
+   LevelOfDetail = level;
+   FrameIndex = frame_index;
+
+   uint64_t difference = 0;
+   for (size_t i = 0; i < size; ++i) {
+      if (i % 4 != 3) difference += static_cast<uint64_t>(std::abs( images[0][i] - images[1][i] ));
+   }
+   std::cout << "Level of Detail Benchmark: " << std::fixed << std::setprecision( 2 )
+      << "every node " << times[0] << " ms, bias " << LevelOfDetailBiases[level] << " " << times[1] << " ms per frame ("
+      << times[0] / std::max( times[1], 1e-3 ) << "x), mean difference "
+      << static_cast<double>(difference) / static_cast<double>(size / 4 * 3) << " of 255\n";
+}
+
+void RendererGL::optimizeScene()
+{
+   if (!Scene->isStatic()) {
+      std::cout << "Scene Optimization: needs a static scene\n";
+      return;
+   }
+
+   // the frame is profiled again after the optimization, so that the visits are measured rather than estimated.
+   const auto print_profile = [](const char* name, const TraversalProfile& profile) {
+      const auto ray_num = static_cast<double>(std::max<uint64_t>( profile.RayNum, 1 ));
+      std::cout << "Scene Optimization: " << name << " " << std::fixed << std::setprecision( 2 )
+         << static_cast<double>(profile.NodeVisitNum) / ray_num << " nodes and "
+         << static_cast<double>(profile.LeafVisitNum) / ray_num << " leaves per ray, "
+         << 100.0 * static_cast<double>(profile.LeafHitNum) / static_cast<double>(std::max<uint64_t>( profile.LeafVisitNum, 1 ))
+         << "% of the leaves hit over " << profile.RayNum << " rays\n";
+   };
+   TraversalProfile profile;
+   Tracer->setScene( *Scene, Materials );
+   Tracer->render( profile, FrameWidth, FrameHeight, FrameIndex );
+   print_profile( "before", profile );
+
+   BVHOptimizer::Statistics statistics;
+   const bool optimized = Scene->optimize( statistics, profile );
+   if (Scene->isStatic() && LevelOfDetail > 0) Scene->setProxies( MaterialBuffer.get() );
+   if (!optimized) return;
+
+   std::cout << "Scene Optimization: " << statistics.RotationNum << " rotations in " << statistics.TreeNum << " trees for "
+      << statistics.RayNum << " rays, estimated cost " << std::fixed << std::setprecision( 2 )
+      << statistics.CostAfter / std::max( statistics.CostBefore, 1.0 ) * 100.0 << "% of before\n";
+   Tracer->setScene( *Scene, Materials );
+   Tracer->render( profile, FrameWidth, FrameHeight, FrameIndex );
+   print_profile( "after", profile );
+}
+
+void RendererGL::printStatistics(int group_num) const
+{
+   GLuint64 elapsed_time = 0;
+   glGetQueryObjectui64v( DispatchTimer, GL_QUERY_RESULT, &elapsed_time );
+
+   std::vector<glm::uvec2> lane_utilization(group_num);
+   StatisticsBuffer->read( lane_utilization );
+   uint64_t traced = 0, occupied = 0;
+   for (const auto& group : lane_utilization) {
+      traced += group.x;
+      occupied += group.y;
+   }
+   std::cout << (UseSubgroupTraversal ? "[Subgroup Primary] " : "")
+      << "dispatch: " << std::fixed << std::setprecision( 2 ) << static_cast<double>(elapsed_time) * 1e-6 << " ms, "
+      << "lane utilization: " << 100.0 * static_cast<double>(traced) / static_cast<double>(std::max<uint64_t>( occupied, 1 ))
+      << "%\n";
+}
+
+void RendererGL::printWavefrontStatistics() const
+{
+   GLuint64 elapsed_time = 0;
+   glGetQueryObjectui64v( DispatchTimer, GL_QUERY_RESULT, &elapsed_time );
+
+   // the traffic is estimated from the sizes, since GL has no counters for the memory transactions.
+   const WavefrontGL::ACCUMULATION format = Wavefront->getAccumulationFormat();
+   std::cout << "[Wavefront] frame: " << std::fixed << std::setprecision( 2 ) << static_cast<double>(elapsed_time) * 1e-6
+      << " ms, accumulation: " << getAccumulationFormatName( format ) << " (" << WavefrontGL::getRadianceSize( format )
+      << " B/pixel, " << Wavefront->getAccumulationTrafficPerFrame() / (1024.0 * 1024.0) << " MB/frame), "
+      << "path state: " << WavefrontGL::RaySize << " B/ray\n";
 }
 
 void RendererGL::drawScreen() const
@@ -145,14 +705,39 @@ void RendererGL::render() const
 
 void RendererGL::update()
 {
-   // if animation is needed, update here ...
+   // a paged scene streams in the chunks which the last frames requested.
+   if (Scene->isPaged()) {
+      Scene->update();
+      if (CollectStatistics) {
+         const ResidencyGL* residency = Scene->getResidency();
+         std::cout << "Paging: " << residency->getResidentNum() << " of " << residency->getChunkNum() << " chunks resident, "
+            << residency->getLoadNum() << " loads, " << residency->getEvictionNum() << " evictions\n";
+      }
+   }
+   if (!Animate || AnimatedGeometry < 0) return;
+
+   // the small spheres bounce out of phase, and the ground stays where it is.
+   AnimationStep++;
+   std::vector<Sphere> spheres = AnimatedSpheres;
+   for (size_t i = 0; i < spheres.size(); ++i) {
+      if (spheres[i].Radius > 1.0f) continue;
+      const float phase = 0.3f * static_cast<float>(AnimationStep) + 2.0f * static_cast<float>(i);
+      spheres[i].Center.y += 0.3f * std::abs( std::sin( phase ) );
+   }
+   Scene->moveSpheres( AnimatedGeometry, spheres );
+   Scene->update();
+   if (CollectStatistics) {
+      std::cout << "Refits: " << Scene->getRefitNum() << ", Rebuilds: " << Scene->getRebuildNum() << "\n";
+   }
 }
 
-void RendererGL::play()
+void RendererGL::play(const std::string& scene_file_path)
 {
    if (glfwWindowShouldClose( Window )) initialize();
 
-   setSpheres();
+   if (scene_file_path.empty() || !loadScene( scene_file_path )) setScene();
+   setImpostorObject();
+   setMeshObject();
    ScreenObject->setSquareObject( GL_TRIANGLES, true );
 
    const double update_time = 0.1;
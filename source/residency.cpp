@@ -0,0 +1,416 @@
+#include "residency.h"
+
+ResidencyGL::ResidencyGL(const Buffers& buffers) :
+   UpdateIndex( 0 ), TopLevelNodeNum( 0 ), NodeBase( 0 ), LoadNum( 0 ), EvictionNum( 0 ), Targets( buffers )
+{
+}
+
+void ResidencyGL::Allocator::reset(int size)
+{
+   Free.clear();
+   if (size > 0) Free.emplace( 0, size );
+}
+
+int ResidencyGL::Allocator::allocate(int num)
+{
+   for (auto it = Free.begin(); it != Free.end(); ++it) {
+      if (it->second < num) continue;
+
+      const int offset = it->first;
+      const int rest = it->second - num;
+      Free.erase( it );
+      if (rest > 0) Free.emplace( offset + num, rest );
+      return offset;
+   }
+   return -1;
+}
+
+void ResidencyGL::Allocator::free(int offset, int num)
+{
+   auto next = Free.lower_bound( offset );
+   if (next != Free.end() && offset + num == next->first) {
+      num += next->second;
+      next = Free.erase( next );
+   }
+   if (next != Free.begin()) {
+      const auto previous = std::prev( next );
+      if (previous->first + previous->second == offset) {
+         previous->second += num;
+         return;
+      }
+   }
+   Free.emplace( offset, num );
+}
+
+int ResidencyGL::getResidentNum() const
+{
+   return static_cast<int>(std::count_if(
+      Chunks.begin(), Chunks.end(), [](const Chunk& chunk) { return chunk.Resident; }
+   ));
+}
+
+GLsizeiptr ResidencyGL::getPoolSize() const
+{
+   GLsizeiptr size = 0;
+   for (const auto* pool : Targets.Pools) size += pool->getSize();
+   return size;
+}
+
+int ResidencyGL::getTopLevelNodeNum() const
+{
+   // the top level is stored first, so its nodes are the ones reachable from the root before any instance.
+   int last = 0;
+   std::vector<int> stack = { 0 };
+   while (!stack.empty()) {
+      const int index = stack.back();
+      stack.pop_back();
+      last = std::max( last, index );
+      const BVHNode& node = Scene.Nodes[index];
+      if (node.isLeaf()) continue;
+
+      stack.emplace_back( node.Offset );
+      stack.emplace_back( -node.Count );
+   }
+   return last + 1;
+}
+
+ResidencyGL::Chunk ResidencyGL::getChunk(int root, int wide_root) const
+{
+   // the buffers of a bottom level are contiguous, so its ranges span from the first to the last element it refers to.
+   Chunk chunk;
+   chunk.Target.fill( -1 );
+   chunk.Root = root;
+   chunk.WideRoot = wide_root;
+   chunk.LastUsed = 0;
+   chunk.LoadedAt = 0;
+   chunk.RequestedAt = -1;
+   chunk.Feedback = 0;
+   chunk.Resident = false;
+   const auto extend = [&chunk](POOL pool, int first, int last)
+   {
+      Range& range = chunk.Source[static_cast<int>(pool)];
+      const int end = range.Num > 0 ? std::max( range.Offset + range.Num, last + 1 ) : last + 1;
+      range.Offset = range.Num > 0 ? std::min( range.Offset, first ) : first;
+      range.Num = end - range.Offset;
+   };
+
+   std::vector<int> stack = { root };
+   while (!stack.empty()) {
+      const int index = stack.back();
+      stack.pop_back();
+      extend( POOL::NODES, index, index );
+      const BVHNode& node = Scene.Nodes[index];
+      if (!node.isLeaf()) {
+         stack.emplace_back( node.Offset );
+         stack.emplace_back( -node.Count );
+      }
+      else if (node.Count > 0) extend( POOL::PRIMITIVES, node.Offset, node.Offset + node.Count - 1 );
+   }
+   if (wide_root >= 0) {
+      stack = { wide_root };
+      while (!stack.empty()) {
+         const int index = stack.back();
+         stack.pop_back();
+         extend( POOL::WIDE_NODES, index, index );
+         const WideBVHNode& node = Scene.WideNodes[index];
+         for (int i = 0; i < WideBVH::ChildNum; ++i) {
+            const uint count = (node.Counts >> (8 * i)) & 0xFFu;
+            if (count == WideBVH::InnerChild) stack.emplace_back( node.Child[i] );
+            else if (count != WideBVH::EmptyChild) {
+               extend( POOL::PRIMITIVES, node.Child[i], node.Child[i] + static_cast<int>(count) - 1 );
+            }
+         }
+      }
+   }
+
+   const Range& primitives = chunk.Source[static_cast<int>(POOL::PRIMITIVES)];
+   for (int i = primitives.Offset; i < primitives.Offset + primitives.Num; ++i) {
+      const uint primitive = Scene.Primitives[i];
+      if ((primitive & BVH::SpherePrimitive) != 0) {
+         const auto sphere = static_cast<int>(primitive & ~BVH::SpherePrimitive);
+         extend( POOL::SPHERES, sphere, sphere );
+      }
+      else {
+         const auto triangle = static_cast<int>(primitive);
+         extend( POOL::TRIANGLES, triangle, triangle );
+         for (const auto vertex : Scene.Triangles[triangle].Indices) {
+            extend( POOL::VERTICES, static_cast<int>(vertex), static_cast<int>(vertex) );
+         }
+      }
+   }
+   return chunk;
+}
+
+ResidencyGL::ChunkData ResidencyGL::relocate(const Chunk& chunk) const
+{
+   // the indices of the chunk are moved by the distance between its ranges in the scene and in the pools.
+   std::array<int, static_cast<int>(POOL::COUNT)> shifts{};
+   for (int p = 0; p < static_cast<int>(POOL::COUNT); ++p) shifts[p] = chunk.Target[p] - chunk.Source[p].Offset;
+   shifts[static_cast<int>(POOL::NODES)] += NodeBase;
+   const auto get_range = [&chunk](const auto& view, POOL pool)
+   {
+      const Range& range = chunk.Source[static_cast<int>(pool)];
+      return std::vector<typename std::decay_t<decltype(view[0])>>(
+         view.begin() + range.Offset, view.begin() + range.Offset + range.Num
+      );
+   };
+
+   ChunkData data;
+   data.Spheres = get_range( Scene.Spheres, POOL::SPHERES );
+   data.Vertices = get_range( Scene.Vertices, POOL::VERTICES );
+   data.Triangles = get_range( Scene.Triangles, POOL::TRIANGLES );
+   for (auto& triangle : data.Triangles) {
+      for (auto& index : triangle.Indices) index += static_cast<uint>(shifts[static_cast<int>(POOL::VERTICES)]);
+   }
+   data.Primitives = get_range( Scene.Primitives, POOL::PRIMITIVES );
+   for (auto& primitive : data.Primitives) {
+      if ((primitive & BVH::SpherePrimitive) != 0) {
+         primitive = ((primitive & ~BVH::SpherePrimitive) + static_cast<uint>(shifts[static_cast<int>(POOL::SPHERES)])) |
+            BVH::SpherePrimitive;
+      }
+      else primitive += static_cast<uint>(shifts[static_cast<int>(POOL::TRIANGLES)]);
+   }
+   data.Nodes = get_range( Scene.Nodes, POOL::NODES );
+   for (auto& node : data.Nodes) {
+      if (node.isLeaf()) node.Offset += shifts[static_cast<int>(POOL::PRIMITIVES)];
+      else {
+         node.Offset += shifts[static_cast<int>(POOL::NODES)];
+         node.Count -= shifts[static_cast<int>(POOL::NODES)];
+      }
+   }
+   data.WideNodes = get_range( Scene.WideNodes, POOL::WIDE_NODES );
+   for (auto& node : data.WideNodes) {
+      for (int i = 0; i < WideBVH::ChildNum; ++i) {
+         const uint count = (node.Counts >> (8 * i)) & 0xFFu;
+         if (count == WideBVH::InnerChild) node.Child[i] += shifts[static_cast<int>(POOL::WIDE_NODES)];
+         else if (count != WideBVH::EmptyChild) node.Child[i] += shifts[static_cast<int>(POOL::PRIMITIVES)];
+      }
+   }
+   return data;
+}
+
+bool ResidencyGL::allocate(Chunk& chunk)
+{
+   for (int p = 0; p < static_cast<int>(POOL::COUNT); ++p) {
+      chunk.Target[p] = chunk.Source[p].Num > 0 ? Allocators[p].allocate( chunk.Source[p].Num ) : 0;
+      if (chunk.Target[p] >= 0) continue;
+
+      for (int q = 0; q < p; ++q) {
+         if (chunk.Source[q].Num > 0) Allocators[q].free( chunk.Target[q], chunk.Source[q].Num );
+      }
+      chunk.Target.fill( -1 );
+      return false;
+   }
+   return true;
+}
+
+void ResidencyGL::free(Chunk& chunk)
+{
+   for (int p = 0; p < static_cast<int>(POOL::COUNT); ++p) {
+      if (chunk.Source[p].Num > 0) Allocators[p].free( chunk.Target[p], chunk.Source[p].Num );
+   }
+   chunk.Target.fill( -1 );
+   chunk.Resident = false;
+}
+
+bool ResidencyGL::evict(uint feedback, bool cycle)
+{
+   // the chunks which the last frame did not use go first, and then those which only the bounces used, since a pixel
+   // is deferred only for its primary rays. when the primary rays need more chunks than the budget holds, the chunk
+   // resident for the longest time goes as well, so the chunks cycle through the pools, and a deferred pixel keeps
+   // its color until all of its chunks are resident at once.
+   Chunk* victim = nullptr;
+   std::pair<int, int> victim_order;
+   for (auto& chunk : Chunks) {
+      if (!chunk.Resident) continue;
+
+      int rank;
+      if (chunk.LastUsed < UpdateIndex) rank = 0;
+      else if (feedback == FeedbackPrimaryMissed && chunk.Feedback == FeedbackBounceUsed) rank = 1;
+      else if (feedback == FeedbackPrimaryMissed && cycle) rank = 2;
+      else continue;
+
+      const std::pair<int, int> order = { rank, rank == 0 ? chunk.LastUsed : chunk.LoadedAt };
+      if (victim == nullptr || order < victim_order) {
+         victim = &chunk;
+         victim_order = order;
+      }
+   }
+   if (victim == nullptr) return false;
+
+   free( *victim );
+   EvictionNum++;
+   return true;
+}
+
+void ResidencyGL::upload(Chunk& chunk, const ChunkData& data) const
+{
+   const auto upload_range = [&](const auto& elements, POOL pool)
+   {
+      const int p = static_cast<int>(pool);
+      const int offset = chunk.Target[p] + (pool == POOL::NODES ? NodeBase : 0);
+      if (!elements.empty()) Targets.Pools[p]->update( elements, static_cast<GLintptr>(ElementSizes[p] * offset) );
+   };
+   upload_range( data.Spheres, POOL::SPHERES );
+   upload_range( data.Vertices, POOL::VERTICES );
+   upload_range( data.Triangles, POOL::TRIANGLES );
+   upload_range( data.Nodes, POOL::NODES );
+   upload_range( data.Primitives, POOL::PRIMITIVES );
+   upload_range( data.WideNodes, POOL::WIDE_NODES );
+   chunk.Resident = true;
+   chunk.LoadedAt = UpdateIndex;
+   chunk.RequestedAt = -1;
+}
+
+void ResidencyGL::uploadInstances() const
+{
+   std::vector<Instance> instances(Scene.Instances.begin(), Scene.Instances.end());
+   for (size_t i = 0; i < instances.size(); ++i) {
+      const Chunk& chunk = Chunks[InstanceChunks[i]];
+      if (chunk.Resident) {
+         instances[i].Root += NodeBase + chunk.Target[static_cast<int>(POOL::NODES)] -
+            chunk.Source[static_cast<int>(POOL::NODES)].Offset;
+         if (instances[i].WideRoot >= 0) {
+            instances[i].WideRoot += chunk.Target[static_cast<int>(POOL::WIDE_NODES)] -
+               chunk.Source[static_cast<int>(POOL::WIDE_NODES)].Offset;
+         }
+      }
+      else {
+         instances[i].Root = -1;
+         instances[i].WideRoot = TopLevelNodeNum + InstanceChunks[i];
+      }
+   }
+   Targets.Instances->update( instances );
+}
+
+bool ResidencyGL::initialize(const Source& source, GLsizeiptr budget)
+{
+   Scene = source;
+   if (Scene.Instances.empty()) return false;
+   if (std::any_of( Scene.Instances.begin(), Scene.Instances.end(), [](const Instance& instance) { return instance.Grid >= 0; } )) {
+      std::cerr << "Could not page a scene with grids, whose cells are not relocated\n";
+      return false;
+   }
+
+   // the instances which share a root share the chunk.
+   TopLevelNodeNum = getTopLevelNodeNum();
+   std::map<int, int> root_chunks;
+   Chunks.clear();
+   InstanceChunks.clear();
+   for (const auto& instance : Scene.Instances) {
+      auto it = root_chunks.find( instance.Root );
+      if (it == root_chunks.end()) {
+         it = root_chunks.emplace( instance.Root, static_cast<int>(Chunks.size()) ).first;
+         Chunks.emplace_back( getChunk( instance.Root, instance.WideRoot ) );
+      }
+      InstanceChunks.emplace_back( it->second );
+   }
+
+   NodeBase = TopLevelNodeNum + static_cast<int>(Chunks.size());
+
+   // the pools share the budget in proportion to the sizes of the buffers, and every pool holds the largest chunk.
+   std::array<double, static_cast<int>(POOL::COUNT)> sizes{};
+   std::array<int, static_cast<int>(POOL::COUNT)> max_nums{};
+   for (const auto& chunk : Chunks) {
+      for (int p = 0; p < static_cast<int>(POOL::COUNT); ++p) {
+         sizes[p] += static_cast<double>(ElementSizes[p] * chunk.Source[p].Num);
+         max_nums[p] = std::max( max_nums[p], chunk.Source[p].Num );
+      }
+   }
+   const double total_size = std::accumulate( sizes.begin(), sizes.end(), 0.0 );
+   if (total_size <= static_cast<double>(budget)) return false;
+
+   for (int p = 0; p < static_cast<int>(POOL::COUNT); ++p) {
+      const auto num = std::max(
+         static_cast<int>(sizes[p] / total_size * static_cast<double>(budget) / static_cast<double>(ElementSizes[p])),
+         max_nums[p]
+      );
+      Allocators[p].reset( num );
+      const int buffer_num = std::max( num + (p == static_cast<int>(POOL::NODES) ? NodeBase : 0), 1 );
+      Targets.Pools[p]->create( static_cast<GLsizeiptr>(ElementSizes[p] * buffer_num) );
+   }
+   std::vector<BVHNode> nodes(Scene.Nodes.begin(), Scene.Nodes.begin() + TopLevelNodeNum);
+   for (const auto& chunk : Chunks) {
+      BVHNode placeholder;
+      placeholder.Min = Scene.Nodes[chunk.Root].Min;
+      placeholder.Max = Scene.Nodes[chunk.Root].Max;
+      nodes.emplace_back( placeholder );
+   }
+   Targets.Pools[static_cast<int>(POOL::NODES)]->update( nodes );
+   Targets.Instances->create( static_cast<GLsizeiptr>(sizeof( Instance ) * Scene.Instances.size()) );
+   Targets.Feedback->create( static_cast<GLsizeiptr>(sizeof( GLuint ) * Scene.Instances.size()) );
+   Targets.Feedback->clear();
+
+   // as many chunks as fit are resident from the start, so that the first frame is not deferred as a whole.
+   for (auto& chunk : Chunks) {
+      if (!allocate( chunk )) break;
+      upload( chunk, relocate( chunk ) );
+   }
+   uploadInstances();
+   return true;
+}
+
+void ResidencyGL::update()
+{
+   UpdateIndex++;
+   std::vector<GLuint> feedback(InstanceChunks.size());
+   Targets.Feedback->read( feedback );
+   Targets.Feedback->clear();
+   for (auto& chunk : Chunks) chunk.Feedback = 0;
+   for (size_t i = 0; i < feedback.size(); ++i) {
+      if (feedback[i] == 0) continue;
+
+      Chunk& chunk = Chunks[InstanceChunks[i]];
+      chunk.LastUsed = UpdateIndex;
+      chunk.Feedback = std::max( chunk.Feedback, feedback[i] );
+   }
+   // the chunks which the primary rays missed are loaded first, and the chunks which were requested first among them,
+   // so that no chunk starves while the others cycle through the pools.
+   std::vector<int> requests;
+   for (int i = 0; i < static_cast<int>(Chunks.size()); ++i) {
+      Chunk& chunk = Chunks[i];
+      if (chunk.Feedback < FeedbackBounceMissed || chunk.Resident || chunk.Load.valid()) continue;
+
+      if (chunk.RequestedAt < 0) chunk.RequestedAt = UpdateIndex;
+      requests.emplace_back( i );
+   }
+   std::stable_sort(
+      requests.begin(), requests.end(), [this](int a, int b)
+      {
+         return std::make_pair( Chunks[b].Feedback, Chunks[a].RequestedAt ) < std::make_pair( Chunks[a].Feedback, Chunks[b].RequestedAt );
+      }
+   );
+
+   // the chunks which finished loading since the last update are uploaded between frames.
+   bool changed = false;
+   int load_num = 0;
+   for (auto& chunk : Chunks) {
+      if (!chunk.Load.valid()) continue;
+      if (chunk.Load.wait_for( std::chrono::seconds(0) ) != std::future_status::ready) {
+         load_num++;
+         continue;
+      }
+
+      upload( chunk, chunk.Load.get() );
+      changed = true;
+      LoadNum++;
+   }
+
+   // the ranges of a chunk are allocated before it is loaded, since its indices are relocated to them on the way.
+   // an evicted chunk leaves the instances in this update, before a later one overwrites its ranges.
+   for (const int index : requests) {
+      if (load_num >= MaxLoadNum) break;
+
+      Chunk& chunk = Chunks[index];
+      bool allocated = allocate( chunk );
+      while (!allocated && evict( chunk.Feedback, load_num == 0 )) {
+         changed = true;
+         allocated = allocate( chunk );
+      }
+      if (!allocated) break;
+
+      chunk.Load = std::async( std::launch::async, [this, &chunk]() { return relocate( chunk ); } );
+      load_num++;
+   }
+   if (changed) uploadInstances();
+}
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include "scene_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool SceneFile::open(const std::string& file_path)
+{
+   close();
+   const int descriptor = ::open( file_path.c_str(), O_RDONLY );
+   if (descriptor < 0) {
+      std::cerr << "Could not open scene file " << file_path << "\n";
+      return false;
+   }
+
+   struct stat status{};
+   if (fstat( descriptor, &status ) != 0 || static_cast<size_t>(status.st_size) < sizeof( FileHeader )) {
+      std::cerr << "Invalid scene file " << file_path << "\n";
+      ::close( descriptor );
+      return false;
+   }
+   void* mapped = mmap( nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0 );
+   ::close( descriptor );
+   if (mapped == MAP_FAILED) {
+      std::cerr << "Could not map scene file " << file_path << "\n";
+      return false;
+   }
+
+   // the buffers read the sections once from the front to the back, so the pages are read ahead.
+   Data = static_cast<const uchar*>(mapped);
+   Size = static_cast<size_t>(status.st_size);
+   Header = reinterpret_cast<const FileHeader*>(Data);
+   madvise( mapped, Size, MADV_SEQUENTIAL );
+   madvise( mapped, Size, MADV_WILLNEED );
+
+   bool valid = Header->Magic == Magic && Header->Version == Version &&
+      Header->SectionNum == static_cast<uint>(SECTION::COUNT);
+   for (const auto& section : Header->Sections) {
+      valid = valid && section.Stride > 0 && section.Size % section.Stride == 0 && section.Offset % PageSize == 0 &&
+         section.Offset <= Size && section.Size <= Size - section.Offset;
+   }
+   if (!valid) {
+      std::cerr << "Invalid scene file " << file_path << "\n";
+      close();
+      return false;
+   }
+   return true;
+}
+
+void SceneFile::close()
+{
+   if (Data != nullptr) munmap( const_cast<uchar*>(Data), Size );
+   Data = nullptr;
+   Size = 0;
+   Header = nullptr;
+}
+
+uint64_t SceneFile::getHash(const void* data, size_t size, uint64_t seed)
+{
+   constexpr uint64_t prime = 0x100000001B3ull;
+   const auto* bytes = static_cast<const uchar*>(data);
+   uint64_t hash = seed ^ 0xCBF29CE484222325ull;
+   size_t i = 0;
+   for (; i + sizeof( uint64_t ) <= size; i += sizeof( uint64_t )) {
+      uint64_t word;
+      std::memcpy( &word, bytes + i, sizeof( uint64_t ) );
+      hash = (hash ^ word) * prime;
+   }
+   for (; i < size; ++i) hash = (hash ^ bytes[i]) * prime;
+   return (hash ^ (hash >> 32)) * prime;
+}
+
+bool SceneFile::write(
+   const std::string& file_path,
+   const std::array<SectionData, static_cast<int>(SECTION::COUNT)>& sections,
+   uint64_t key,
+   const SectionFiller& fill
+)
+{
+   FileHeader header{};
+   header.Magic = Magic;
+   header.Version = Version;
+   header.SectionNum = static_cast<uint>(SECTION::COUNT);
+   header.Key = key;
+   size_t offset = alignToPage( sizeof( FileHeader ) );
+   for (size_t i = 0; i < sections.size(); ++i) {
+      header.Sections[i] = { offset, sections[i].Size, sections[i].Stride };
+      offset = alignToPage( offset + sections[i].Size );
+   }
+
+   // the temporary file is unique to the process, so the processes writing the same file do not mix their writes.
+   const std::string temporary_path = file_path + "." + std::to_string( getpid() ) + ".tmp";
+   std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+   if (!file.is_open()) {
+      std::cerr << "Could not write scene file " << file_path << "\n";
+      return false;
+   }
+   const std::vector<char> padding(PageSize, 0);
+   file.write( reinterpret_cast<const char*>(&header), sizeof( FileHeader ) );
+   size_t position = sizeof( FileHeader );
+   bool reserved = false;
+   for (size_t i = 0; i < sections.size(); ++i) {
+      file.write( padding.data(), static_cast<std::streamsize>(header.Sections[i].Offset - position) );
+      if (sections[i].Data != nullptr) {
+         file.write( static_cast<const char*>(sections[i].Data), static_cast<std::streamsize>(sections[i].Size) );
+      }
+      else {
+         file.seekp( static_cast<std::streamoff>(sections[i].Size), std::ios::cur );
+         reserved = reserved || sections[i].Size > 0;
+      }
+      position = header.Sections[i].Offset + sections[i].Size;
+   }
+   file.close();
+   bool filled = file.good();
+   if (filled && reserved) filled = fill != nullptr && fillSections( temporary_path, position, sections, header, fill );
+   if (!filled || std::rename( temporary_path.c_str(), file_path.c_str() ) != 0) {
+      std::cerr << "Could not write scene file " << file_path << "\n";
+      std::remove( temporary_path.c_str() );
+      return false;
+   }
+   return true;
+}
+
+bool SceneFile::fillSections(
+   const std::string& file_path,
+   size_t size,
+   const std::array<SectionData, static_cast<int>(SECTION::COUNT)>& sections,
+   const FileHeader& header,
+   const SectionFiller& fill
+)
+{
+   // a reserved section at the end is a hole which the file has to be extended over.
+   const int descriptor = ::open( file_path.c_str(), O_RDWR );
+   if (descriptor < 0) return false;
+   if (ftruncate( descriptor, static_cast<off_t>(size) ) != 0) {
+      ::close( descriptor );
+      return false;
+   }
+   void* mapped = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0 );
+   ::close( descriptor );
+   if (mapped == MAP_FAILED) return false;
+
+   bool filled = true;
+   for (size_t i = 0; i < sections.size() && filled; ++i) {
+      if (sections[i].Data == nullptr && sections[i].Size > 0) {
+         filled = fill( static_cast<SECTION>(i), static_cast<uchar*>(mapped) + header.Sections[i].Offset );
+      }
+   }
+   munmap( mapped, size );
+   return filled;
+}
\ No newline at end of file
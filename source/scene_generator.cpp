@@ -0,0 +1,202 @@
+#include "scene_generator.h"
+
+glm::vec3 SceneGenerator::Random::getNormal()
+{
+   // Box-Muller, with the numbers of the logarithm kept away from zero.
+   const float length = std::sqrt( -2.0f * std::log( 1.0f - get() ) );
+   const float angle = glm::two_pi<float>() * get();
+   const float z = std::sqrt( -2.0f * std::log( 1.0f - get() ) ) * std::cos( glm::two_pi<float>() * get() );
+   return { length * std::cos( angle ), length * std::sin( angle ), z };
+}
+
+bool SceneGenerator::parse(Settings& settings, const std::vector<std::string>& arguments)
+{
+   const std::map<std::string, LAYOUT> layouts = {
+      { "cover", LAYOUT::COVER }, { "uniform", LAYOUT::UNIFORM }, { "clustered", LAYOUT::CLUSTERED }
+   };
+   const std::map<std::string, RADIUS> radii = {
+      { "constant", RADIUS::CONSTANT }, { "uniform", RADIUS::UNIFORM }, { "log_uniform", RADIUS::LOG_UNIFORM }
+   };
+   for (const auto& argument : arguments) {
+      const size_t separator = argument.find( '=' );
+      if (separator == std::string::npos) {
+         std::cerr << "Could not parse " << argument << "\n";
+         return false;
+      }
+
+      const std::string key = argument.substr( 0, separator );
+      const std::string value = argument.substr( separator + 1 );
+      std::istringstream stream(value);
+      bool valid = true;
+      if (key == "layout") {
+         valid = layouts.count( value ) > 0;
+         if (valid) settings.Layout = layouts.at( value );
+      }
+      else if (key == "radius") {
+         valid = radii.count( value ) > 0;
+         if (valid) settings.Radius = radii.at( value );
+      }
+      else if (key == "builder") {
+         auto builder = AccelerationStructureGL::BUILDER::SAH;
+         valid = value == "auto" || AccelerationStructureGL::getBuilder( builder, value );
+         if (valid) settings.Builder = value == "auto" ? -1 : static_cast<int>(builder);
+      }
+      else if (key == "spheres") valid = static_cast<bool>(stream >> settings.SphereNum) && settings.SphereNum > 0;
+      else if (key == "clusters") valid = static_cast<bool>(stream >> settings.ClusterNum) && settings.ClusterNum > 0;
+      else if (key == "materials") valid = static_cast<bool>(stream >> settings.MaterialNum) && settings.MaterialNum > 0;
+      else if (key == "min_radius") valid = static_cast<bool>(stream >> settings.MinRadius) && settings.MinRadius > 0.0f;
+      else if (key == "max_radius") valid = static_cast<bool>(stream >> settings.MaxRadius) && settings.MaxRadius > 0.0f;
+      else if (key == "metal") {
+         valid = static_cast<bool>(stream >> settings.MetalFraction) &&
+            settings.MetalFraction >= 0.0f && settings.MetalFraction <= 1.0f;
+      }
+      else if (key == "seed") valid = static_cast<bool>(stream >> settings.Seed);
+      else valid = false;
+      if (!valid) {
+         std::cerr << "Could not parse " << argument << "\n";
+         return false;
+      }
+   }
+   if (settings.MaxRadius < settings.MinRadius) settings.MaxRadius = settings.MinRadius;
+   return true;
+}
+
+float SceneGenerator::getRadius(Random& random, const Settings& settings)
+{
+   switch (settings.Radius) {
+      case RADIUS::CONSTANT: return settings.MinRadius;
+      case RADIUS::UNIFORM: return glm::mix( settings.MinRadius, settings.MaxRadius, random.get() );
+      // many small spheres and a few large ones, as many at every scale.
+      case RADIUS::LOG_UNIFORM: return settings.MinRadius * std::pow( settings.MaxRadius / settings.MinRadius, random.get() );
+   }
+   return settings.MinRadius;
+}
+
+void SceneGenerator::addMaterials(std::vector<Material>& materials, const Settings& settings)
+{
+   // the metals stand in for the glass of the cover scene, which the renderer does not have.
+   Random random(settings.Seed, SceneStream);
+   for (int i = 0; i < settings.MaterialNum; ++i) {
+      if (random.get() < settings.MetalFraction) {
+         materials.emplace_back( Material::TYPE::METAL, 0.5f * (glm::vec3(1.0f) + random.getVector()) );
+      }
+      else materials.emplace_back( Material::TYPE::LAMBERTIAN, random.getVector() * random.getVector() );
+   }
+}
+
+void SceneGenerator::generate(
+   std::vector<Sphere>& spheres,
+   std::vector<Material>& materials,
+   glm::mat4& to_world,
+   const Settings& settings
+)
+{
+   spheres.clear();
+   materials.clear();
+   int random_offset = 0;
+   const int random_num = settings.Layout == LAYOUT::COVER ? std::max( settings.SphereNum - 4, 0 ) : settings.SphereNum;
+   const int grid_size = std::max( static_cast<int>(std::ceil( std::sqrt( static_cast<double>(random_num) ) )), 1 );
+   // the ground grows with the grid, so that the spheres at its corners still rest on it.
+   const float ground_radius = std::max( 1000.0f, static_cast<float>(grid_size) );
+   if (settings.Layout == LAYOUT::COVER) {
+      materials = {
+         { Material::TYPE::LAMBERTIAN, glm::vec3(0.5f, 0.5f, 0.5f) },
+         { Material::TYPE::METAL, glm::vec3(0.95f, 0.95f, 0.95f) },
+         { Material::TYPE::LAMBERTIAN, glm::vec3(0.4f, 0.2f, 0.1f) },
+         { Material::TYPE::METAL, glm::vec3(0.7f, 0.6f, 0.5f) }
+      };
+      spheres = {
+         { ground_radius, glm::vec3(0.0f, -ground_radius, 0.0f), 0 },
+         { 1.0f, glm::vec3(0.0f, 1.0f, 0.0f), 1 },
+         { 1.0f, glm::vec3(-4.0f, 1.0f, 0.0f), 2 },
+         { 1.0f, glm::vec3(4.0f, 1.0f, 0.0f), 3 }
+      };
+      spheres.resize( std::min( spheres.size(), static_cast<size_t>(settings.SphereNum) ) );
+      random_offset = static_cast<int>(spheres.size());
+      // the camera of the book, which looks at the origin from the front right.
+      to_world = glm::lookAt( glm::vec3(13.0f, 2.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f) );
+   }
+   const auto material_offset = static_cast<int>(materials.size());
+   addMaterials( materials, settings );
+
+   const float cube_size = Spacing * std::cbrt( static_cast<float>(random_num) );
+   const float cluster_size = cube_size / (4.0f * std::cbrt( static_cast<float>(settings.ClusterNum) ));
+   std::vector<glm::vec3> clusters;
+   if (settings.Layout == LAYOUT::CLUSTERED) {
+      Random random(settings.Seed ^ 0x5851F42D4C957F2Dull, SceneStream);
+      for (int i = 0; i < settings.ClusterNum; ++i) clusters.emplace_back( (random.getVector() - 0.5f) * cube_size );
+   }
+   if (settings.Layout != LAYOUT::COVER) {
+      // the cube is centered in front of the camera, which looks down the negative z-axis.
+      to_world = glm::translate( glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -cube_size) );
+   }
+
+   spheres.resize( static_cast<size_t>(settings.SphereNum) );
+   const auto generate_range = [&](int begin, int end) {
+      for (int i = begin; i < end; ++i) {
+         Random random(settings.Seed, static_cast<uint64_t>(i));
+         Sphere& sphere = spheres[random_offset + i];
+         sphere.Radius = getRadius( random, settings );
+         sphere.MaterialIndex =
+            material_offset + std::min( static_cast<int>(random.get() * settings.MaterialNum), settings.MaterialNum - 1 );
+         if (settings.Layout == LAYOUT::COVER) {
+            const glm::vec2 cell(
+               static_cast<float>(i % grid_size - grid_size / 2), static_cast<float>(i / grid_size - grid_size / 2)
+            );
+            sphere.Center = glm::vec3(cell.x + 0.9f * random.get(), 0.0f, cell.y + 0.9f * random.get());
+            sphere.Center.y = std::sqrt( ground_radius * ground_radius - sphere.Center.x * sphere.Center.x -
+               sphere.Center.z * sphere.Center.z ) - ground_radius + sphere.Radius;
+         }
+         else if (settings.Layout == LAYOUT::UNIFORM) sphere.Center = (random.getVector() - 0.5f) * cube_size;
+         else {
+            const auto cluster = std::min( static_cast<int>(random.get() * settings.ClusterNum), settings.ClusterNum - 1 );
+            sphere.Center = clusters[cluster] + random.getNormal() * cluster_size;
+         }
+      }
+   };
+
+   // the spheres are split into as many ranges as there are threads.
+   const int thread_num = std::max( static_cast<int>(std::thread::hardware_concurrency()), 1 );
+   const int range_size = (random_num + thread_num - 1) / thread_num;
+   std::vector<std::thread> threads;
+   for (int begin = range_size; begin < random_num; begin += range_size) {
+      threads.emplace_back( generate_range, begin, std::min( begin + range_size, random_num ) );
+   }
+   generate_range( 0, std::min( range_size, random_num ) );
+   for (auto& thread : threads) thread.join();
+}
+
+bool SceneGenerator::write(const std::string& file_path, const Settings& settings)
+{
+   const auto start = std::chrono::steady_clock::now();
+   std::vector<Sphere> spheres;
+   std::vector<Material> materials;
+   SceneFile::InstanceRecord instance{};
+   generate( spheres, materials, instance.ToWorld, settings );
+   instance.MaterialIndex = -1;
+
+   // the bounds are written for completeness, as the builders compute their own.
+   SceneFile::GeometryRecord geometry{};
+   for (const auto& sphere : spheres) {
+      geometry.Bounds.Min = glm::min( geometry.Bounds.Min, sphere.Center - sphere.Radius );
+      geometry.Bounds.Max = glm::max( geometry.Bounds.Max, sphere.Center + sphere.Radius );
+   }
+   geometry.SphereNum = static_cast<int>(spheres.size());
+   geometry.Builder = settings.Builder >= 0 ?
+      settings.Builder : static_cast<int>(AccelerationStructureGL::chooseBuilder( spheres, {}, {} ));
+
+   using SECTION = SceneFile::SECTION;
+   std::array<SceneFile::SectionData, static_cast<int>(SECTION::COUNT)> sections;
+   sections[static_cast<int>(SECTION::MATERIALS)] = ArrayView<Material>(materials);
+   sections[static_cast<int>(SECTION::SPHERES)] = ArrayView<Sphere>(spheres);
+   sections[static_cast<int>(SECTION::VERTICES)] = ArrayView<Vertex>();
+   sections[static_cast<int>(SECTION::TRIANGLES)] = ArrayView<Triangle>();
+   sections[static_cast<int>(SECTION::GEOMETRIES)] = ArrayView<SceneFile::GeometryRecord>(&geometry, 1);
+   sections[static_cast<int>(SECTION::INSTANCES)] = ArrayView<SceneFile::InstanceRecord>(&instance, 1);
+   if (!SceneFile::write( file_path, sections )) return false;
+
+   const auto end = std::chrono::steady_clock::now();
+   std::cout << "Generated Scene: " << spheres.size() << " spheres, " << materials.size() << " materials, written to "
+      << file_path << " in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+   return true;
+}
\ No newline at end of file
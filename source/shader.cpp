@@ -20,7 +20,15 @@ void ShaderGL::readShaderFile(std::string& shader_contents, const char* shader_p
    std::string line;
    while (!file.eof()) {
       getline( file, line );
-      shader_contents.append( line + "\n" );
+      if (line.rfind( "#include", 0 ) == 0) {
+         // GLSL has no include directive, so the shared file is spliced in place relative to this shader.
+         const std::string path(shader_path);
+         const std::string directory = path.substr( 0, path.find_last_of( "/\\" ) + 1 );
+         const size_t begin = line.find( '"' ) + 1;
+         const size_t end = line.find( '"', begin );
+         readShaderFile( shader_contents, std::string(directory + line.substr( begin, end - begin )).c_str() );
+      }
+      else shader_contents.append( line + "\n" );
    }
    file.close();
 }
@@ -57,12 +65,17 @@ bool ShaderGL::checkCompileError(GLenum shader_type, const GLuint& shader)
    return compiled == GL_TRUE;
 }
 
-GLuint ShaderGL::getCompiledShader(GLenum shader_type, const char* shader_path)
+GLuint ShaderGL::getCompiledShader(GLenum shader_type, const char* shader_path, const std::vector<std::string>& definitions)
 {
    if (shader_path == nullptr) return 0;
 
    std::string shader_contents;
    readShaderFile( shader_contents, shader_path );
+   if (!definitions.empty()) {
+      std::string lines;
+      for (const auto& definition : definitions) lines += "#define " + definition + "\n";
+      shader_contents.insert( shader_contents.find( '\n' ) + 1, lines );
+   }
 
    const GLuint shader = glCreateShader( shader_type );
    const char* shader_source = shader_contents.c_str();
@@ -102,28 +115,48 @@ void ShaderGL::setShader(
    if (tessellation_evaluation_shader != 0) glDeleteShader( tessellation_evaluation_shader );
 }
 
-void ShaderGL::setComputeShader(const char* compute_shader_path)
+void ShaderGL::setComputeShader(const char* compute_shader_path, const std::vector<std::string>& definitions)
 {
-   const GLuint compute_shader = getCompiledShader( GL_COMPUTE_SHADER, compute_shader_path );
+   const GLuint compute_shader = getCompiledShader( GL_COMPUTE_SHADER, compute_shader_path, definitions );
    ShaderProgram = glCreateProgram();
    glAttachShader( ShaderProgram, compute_shader );
    glLinkProgram( ShaderProgram );
    glDeleteShader( compute_shader );
 }
 
+void ShaderGL::setSphereUniformLocations()
+{
+   Location.SphereNum = glGetUniformLocation( ShaderProgram, "SphereNum" );
+}
+
 void ShaderGL::setRayUniformLocations()
 {
    addUniformLocation( "FrameIndex" );
+   addUniformLocation( "UseRasterizedPrimary" );
+   addUniformLocation( "UseTileCulling" );
+   addUniformLocation( "UseSubgroupTraversal" );
+   addUniformLocation( "CollectStatistics" );
+   addUniformLocation( "UseResidency" );
+   addUniformLocation( "LevelOfDetailBias" );
+   addUniformLocation( "WideProxyOffset" );
+   setSphereUniformLocations();
+}
 
-   Location.SphereNum = glGetUniformLocation( ShaderProgram, "SphereNum" );
+void ShaderGL::setImpostorUniformLocations()
+{
+   addUniformLocation( "ProjectionMatrix" );
+   addUniformLocation( "WorldMatrix" );
+   addUniformLocation( "SphereOffset" );
+   addUniformLocation( "MaterialIndex" );
+   addUniformLocation( "FrameSize" );
+   setSphereUniformLocations();
+}
 
-   Location.Spheres.resize( 32 );
-   for (int i = 0; i < static_cast<int>(Location.Spheres.size()); ++i) {
-      Location.Spheres[i].Type = glGetUniformLocation( ShaderProgram, std::string("Sphere[" + std::to_string( i ) + "].Type").c_str() );
-      Location.Spheres[i].Center = glGetUniformLocation( ShaderProgram, std::string("Sphere[" + std::to_string( i ) + "].Center").c_str() );
-      Location.Spheres[i].Radius = glGetUniformLocation( ShaderProgram, std::string("Sphere[" + std::to_string( i ) + "].Radius").c_str() );
-      Location.Spheres[i].Albedo = glGetUniformLocation( ShaderProgram, std::string("Sphere[" + std::to_string( i ) + "].Albedo").c_str() );
-   }
+void ShaderGL::setMeshUniformLocations()
+{
+   addUniformLocation( "ProjectionMatrix" );
+   addUniformLocation( "WorldMatrix" );
+   addUniformLocation( "MaterialIndex" );
 }
 
 void ShaderGL::setScreenUniformLocations()
@@ -143,15 +176,8 @@ void ShaderGL::transferBasicTransformationUniforms(const glm::mat4& to_world, co
    }
 }
 
-void ShaderGL::transferSphereUniformsToShader(const std::vector<Sphere>& spheres)
+void ShaderGL::transferSphereUniformsToShader(ArrayView<Sphere> spheres)
 {
-   const auto size = static_cast<int>(spheres.size());
-   glProgramUniform1i( ShaderProgram, Location.SphereNum, size );
-
-   for (int i = 0; i < size; ++i) {
-      glProgramUniform1i( ShaderProgram, Location.Spheres[i].Type, static_cast<int>(spheres[i].Type) );
-      glProgramUniform1f( ShaderProgram, Location.Spheres[i].Radius, spheres[i].Radius );
-      glProgramUniform3fv( ShaderProgram, Location.Spheres[i].Center, 1, &spheres[i].Center[0] );
-      glProgramUniform3fv( ShaderProgram, Location.Spheres[i].Albedo, 1, &spheres[i].Albedo[0] );
-   }
+   // the sphere data itself lives in the scene buffers, so only the number of spheres is a uniform.
+   glProgramUniform1i( ShaderProgram, Location.SphereNum, static_cast<int>(spheres.size()) );
 }
\ No newline at end of file
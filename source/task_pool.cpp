@@ -0,0 +1,89 @@
+#include "task_pool.h"
+
+TaskPool::TaskPool(int worker_num) : Stopping( false ), QueuedNum( 0 )
+{
+   for (int i = 0; i <= worker_num; ++i) Queues.emplace_back( std::make_unique<Queue>() );
+   for (int i = 0; i < worker_num; ++i) Workers.emplace_back( &TaskPool::work, this, i );
+}
+
+TaskPool::~TaskPool()
+{
+   {
+      std::lock_guard<std::mutex> lock(SleepMutex);
+      Stopping = true;
+   }
+   Wake.notify_all();
+   for (auto& worker : Workers) worker.join();
+}
+
+TaskPool& TaskPool::get()
+{
+   static TaskPool pool(std::max( static_cast<int>(std::thread::hardware_concurrency()) - 1, 0 ));
+   return pool;
+}
+
+void TaskPool::fork(std::function<void()> task, std::atomic<int>& pending)
+{
+   pending++;
+   Queue& queue = *Queues[getQueueIndex()];
+   {
+      std::lock_guard<std::mutex> lock(queue.Mutex);
+      queue.Tasks.emplace_back(
+         [task = std::move( task ), &pending]() {
+            task();
+            pending--;
+         }
+      );
+   }
+   QueuedNum++;
+
+   // the sleeping workers check the queued tasks under the lock, so taking it first keeps the wake from being lost.
+   { std::lock_guard<std::mutex> lock(SleepMutex); }
+   Wake.notify_one();
+}
+
+void TaskPool::wait(const std::atomic<int>& pending)
+{
+   while (pending > 0) {
+      if (!runQueuedTask()) std::this_thread::yield();
+   }
+}
+
+bool TaskPool::runQueuedTask()
+{
+   // the own queue is taken from the back, where the latest and smallest tasks are, and the others from the front.
+   const int own = getQueueIndex();
+   const auto queue_num = static_cast<int>(Queues.size());
+   std::function<void()> task;
+   for (int i = 0; i < queue_num && task == nullptr; ++i) {
+      Queue& queue = *Queues[(own + i) % queue_num];
+      std::lock_guard<std::mutex> lock(queue.Mutex);
+      if (queue.Tasks.empty()) continue;
+
+      if (i == 0) {
+         task = std::move( queue.Tasks.back() );
+         queue.Tasks.pop_back();
+      }
+      else {
+         task = std::move( queue.Tasks.front() );
+         queue.Tasks.pop_front();
+      }
+   }
+   if (task == nullptr) return false;
+
+   QueuedNum--;
+   task();
+   return true;
+}
+
+void TaskPool::work(int worker_index)
+{
+   WorkerIndex = worker_index;
+   while (true) {
+      if (runQueuedTask()) continue;
+
+      std::unique_lock<std::mutex> lock(SleepMutex);
+      Wake.wait( lock, [this]() { return Stopping || QueuedNum > 0; } );
+      if (Stopping) return;
+   }
+}
\ No newline at end of file
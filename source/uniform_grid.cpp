@@ -0,0 +1,126 @@
+#include "uniform_grid.h"
+
+glm::ivec3 UniformGridGL::getResolution(const BoundingBox& bounds, int primitive_num)
+{
+   // a flat geometry still gets a thin layer of cells rather than none.
+   glm::vec3 extent = glm::max( bounds.Max - bounds.Min, glm::vec3(0.0f) );
+   const float max_extent = std::max( std::max( extent.x, extent.y ), std::max( extent.z, std::numeric_limits<float>::min() ) );
+   extent = glm::max( extent, glm::vec3(1e-3f * max_extent) );
+   const float density = std::cbrt( CellsPerPrimitive * static_cast<float>(primitive_num) / (extent.x * extent.y * extent.z) );
+   return glm::clamp( glm::ivec3(glm::ceil( extent * density )), glm::ivec3(1), glm::ivec3(MaxResolution) );
+}
+
+void UniformGridGL::setShaders(const std::string& shader_directory_path)
+{
+   CountShader = std::make_unique<ShaderGL>();
+   CountShader->setComputeShader( std::string(shader_directory_path + "/grid_count.comp").c_str() );
+   FillShader = std::make_unique<ShaderGL>();
+   FillShader->setComputeShader( std::string(shader_directory_path + "/grid_fill.comp").c_str() );
+   for (auto* shader : { CountShader.get(), FillShader.get() }) {
+      shader->addUniformLocation( "SphereOffset" );
+      shader->addUniformLocation( "SphereNum" );
+      shader->addUniformLocation( "TriangleOffset" );
+      shader->addUniformLocation( "PrimitiveNum" );
+      shader->addUniformLocation( "GridIndex" );
+   }
+
+   ScanShader = std::make_unique<ShaderGL>();
+   ScanShader->setComputeShader( std::string(shader_directory_path + "/grid_scan.comp").c_str() );
+   ScanShader->addUniformLocation( "ElementNum" );
+   ScanShader->addUniformLocation( "Base" );
+}
+
+void UniformGridGL::clear()
+{
+   Grids.clear();
+   Sources.clear();
+}
+
+int UniformGridGL::addGrid(const BoundingBox& bounds, int sphere_offset, int sphere_num, int triangle_offset, int triangle_num)
+{
+   GridInfo grid;
+   grid.Min = bounds.Min;
+   grid.Resolution = getResolution( bounds, sphere_num + triangle_num );
+   grid.CellSize = glm::max( bounds.Max - bounds.Min, glm::vec3(0.0f) ) / glm::vec3(grid.Resolution);
+   grid.CellSize = glm::max( grid.CellSize, glm::vec3(std::numeric_limits<float>::min()) );
+   Grids.emplace_back( grid );
+   Sources.push_back( { sphere_offset, sphere_num, triangle_offset, triangle_num } );
+   return static_cast<int>(Grids.size()) - 1;
+}
+
+void UniformGridGL::dispatch(const ShaderGL& shader, int grid_index) const
+{
+   const Source& source = Sources[grid_index];
+   const int primitive_num = source.SphereNum + source.TriangleNum;
+   if (primitive_num == 0) return;
+
+   glUseProgram( shader.getShaderProgram() );
+   shader.uniform1i( "SphereOffset", source.SphereOffset );
+   shader.uniform1i( "SphereNum", source.SphereNum );
+   shader.uniform1i( "TriangleOffset", source.TriangleOffset );
+   shader.uniform1i( "PrimitiveNum", primitive_num );
+   shader.uniform1i( "GridIndex", grid_index );
+   glDispatchCompute( (primitive_num + GroupSize - 1) / GroupSize, 1, 1 );
+}
+
+void UniformGridGL::build()
+{
+   // the counts are indexed like the cell buffer, so they leave room for the grids in front of the cells.
+   const int header_size = GridInfoSize * static_cast<int>(Grids.size());
+   CellNum = 0;
+   for (auto& grid : Grids) {
+      grid.CellOffset = header_size + CellNum;
+      CellNum += grid.Resolution.x * grid.Resolution.y * grid.Resolution.z;
+   }
+   if (Grids.empty()) GridBuffer.create( sizeof( GridInfo ) );
+   else GridBuffer.create( Grids );
+   const int start_num = header_size + CellNum + 1;
+   const auto start_size = static_cast<GLsizeiptr>(sizeof( GLuint ) * start_num);
+   CountBuffer.create( start_size );
+   CountBuffer.clear();
+   GridBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 16 );
+   CountBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 0 );
+   glMemoryBarrier( GL_BUFFER_UPDATE_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT );
+   for (int i = 0; i < static_cast<int>(Grids.size()); ++i) dispatch( *CountShader, i );
+   glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+
+   // the lists follow the starts in the same buffer, so the scan begins the first list right after them.
+   glUseProgram( ScanShader->getShaderProgram() );
+   ScanShader->uniform1ui( "ElementNum", static_cast<GLuint>(start_num) );
+   ScanShader->uniform1ui( "Base", static_cast<GLuint>(start_num) );
+   glDispatchCompute( 1, 1, 1 );
+   glMemoryBarrier( GL_BUFFER_UPDATE_BARRIER_BIT );
+
+   std::vector<GLuint> end(1);
+   CountBuffer.read( end, static_cast<GLintptr>(sizeof( GLuint ) * (start_num - 1)) );
+   ReferenceNum = static_cast<int>(end[0]) - start_num;
+   const auto size = static_cast<GLsizeiptr>(sizeof( GLuint ) * end[0]);
+   if (CellBuffer.getSize() < size) CellBuffer.create( size );
+   glCopyNamedBufferSubData( CountBuffer.getBufferID(), CellBuffer.getBufferID(), 0, 0, start_size );
+   if (header_size > 0) {
+      glCopyNamedBufferSubData(
+         GridBuffer.getBufferID(), CellBuffer.getBufferID(), 0, 0, static_cast<GLsizeiptr>(sizeof( GLuint ) * header_size)
+      );
+   }
+
+   // the counts are cleared again to be the cursors of the lists while they are written.
+   CountBuffer.clear();
+   CellBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 17 );
+   glMemoryBarrier( GL_BUFFER_UPDATE_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT );
+   for (int i = 0; i < static_cast<int>(Grids.size()); ++i) dispatch( *FillShader, i );
+   glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+}
+
+void UniformGridGL::setCells(ArrayView<uint> cells)
+{
+   Grids.clear();
+   Sources.clear();
+   CellNum = 0;
+   ReferenceNum = 0;
+   CellBuffer.create( static_cast<GLsizeiptr>(sizeof( uint ) * std::max<size_t>( cells.size(), 1 )), cells.data(), 0 );
+}
+
+void UniformGridGL::bindBuffers() const
+{
+   CellBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 17 );
+}
\ No newline at end of file
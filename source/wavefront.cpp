@@ -0,0 +1,215 @@
+#include "wavefront.h"
+
+WavefrontGL::WavefrontGL() : Width( 0 ), Height( 0 ), CurrentQueueIndex( 0 ), Sorting( SORTING::AUTO ), SortByMaterial( false ),
+   AccumulationFormat( ACCUMULATION::RGBA16F )
+{
+}
+
+void WavefrontGL::setShaders(const std::string& shader_directory_path)
+{
+   GenerateShader = std::make_unique<ShaderGL>();
+   GenerateShader->setComputeShader( std::string(shader_directory_path + "/wavefront_generate.comp").c_str() );
+   GenerateShader->addUniformLocation( "FrameIndex" );
+   GenerateShader->addUniformLocation( "SampleIndex" );
+   GenerateShader->addUniformLocation( "FrameSize" );
+
+   ExtendShader = std::make_unique<ShaderGL>();
+   ExtendShader->setComputeShader( std::string(shader_directory_path + "/wavefront_extend.comp").c_str() );
+   ExtendShader->setSphereUniformLocations();
+   ExtendShader->addUniformLocation( "Depth" );
+   ExtendShader->addUniformLocation( "SampleIndex" );
+   ExtendShader->addUniformLocation( "AccumulationFormat" );
+
+   IntersectShader = std::make_unique<ShaderGL>();
+   IntersectShader->setComputeShader( std::string(shader_directory_path + "/wavefront_intersect.comp").c_str() );
+   IntersectShader->setSphereUniformLocations();
+
+   ShadeShader = std::make_unique<ShaderGL>();
+   ShadeShader->setComputeShader( std::string(shader_directory_path + "/wavefront_shade.comp").c_str() );
+   ShadeShader->addUniformLocation( "Depth" );
+   ShadeShader->addUniformLocation( "SampleIndex" );
+   ShadeShader->addUniformLocation( "AccumulationFormat" );
+
+   SetupShader = std::make_unique<ShaderGL>();
+   SetupShader->setComputeShader( std::string(shader_directory_path + "/wavefront_setup.comp").c_str() );
+
+   SortKeyShader = std::make_unique<ShaderGL>();
+   SortKeyShader->setComputeShader( std::string(shader_directory_path + "/ray_sort_key.comp").c_str() );
+   SortKeyShader->addUniformLocation( "SceneMin" );
+   SortKeyShader->addUniformLocation( "SceneSize" );
+
+   ReorderShader = std::make_unique<ShaderGL>();
+   ReorderShader->setComputeShader( std::string(shader_directory_path + "/ray_reorder.comp").c_str() );
+
+   ResolveShader = std::make_unique<ShaderGL>();
+   ResolveShader->setComputeShader( std::string(shader_directory_path + "/wavefront_resolve.comp").c_str() );
+   ResolveShader->addUniformLocation( "AccumulationFormat" );
+
+   Sorter.setShaders( shader_directory_path );
+}
+
+void WavefrontGL::setBuffers(int width, int height)
+{
+   // a ray takes 32 bytes, so the two queues take 64 bytes per pixel, and a hit takes another 32 bytes.
+   Width = width;
+   Height = height;
+   const int pixel_num = Width * Height;
+   StateBuffer.create( sizeof( glm::uvec4 ) * 2 );
+   HitBuffer.create( static_cast<GLsizeiptr>(sizeof( glm::vec4 ) * 2 * pixel_num) );
+   for (auto& queue : RayQueues) queue.create( static_cast<GLsizeiptr>(RaySize * pixel_num) );
+   Sorter.setBuffers( pixel_num );
+   setAccumulationBuffers();
+}
+
+void WavefrontGL::setAccumulationBuffers()
+{
+   AccumulationBuffer.create( static_cast<GLsizeiptr>(getRadianceSize( AccumulationFormat ) * Width * Height) );
+}
+
+void WavefrontGL::setAccumulationFormat(ACCUMULATION format)
+{
+   AccumulationFormat = format;
+   if (Width > 0 && Height > 0) setAccumulationBuffers();
+}
+
+double WavefrontGL::getAccumulationTrafficPerFrame() const
+{
+   // the path of every pixel reads and writes the mean once per sample, and the resolve reads it at the end of the frame.
+   const double pixel_num = static_cast<double>(Width) * static_cast<double>(Height);
+   return pixel_num * getRadianceSize( AccumulationFormat ) * (2.0 * SampleNum + 1.0);
+}
+
+bool WavefrontGL::needToSort(int sphere_num) const
+{
+   switch (Sorting) {
+      case SORTING::OFF: return false;
+      case SORTING::AUTO: return sphere_num >= MinSphereNumToSort;
+      case SORTING::ALWAYS: return true;
+      default: return false;
+   }
+}
+
+void WavefrontGL::bindQueues() const
+{
+   StateBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 0 );
+   RayQueues[CurrentQueueIndex].bindBase( GL_SHADER_STORAGE_BUFFER, 1 );
+   RayQueues[CurrentQueueIndex ^ 1].bindBase( GL_SHADER_STORAGE_BUFFER, 2 );
+   AccumulationBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 3 );
+}
+
+void WavefrontGL::sortRays(const BoundingBox& scene_bounds)
+{
+   glUseProgram( SortKeyShader->getShaderProgram() );
+   SortKeyShader->uniform3fv( "SceneMin", scene_bounds.Min );
+   SortKeyShader->uniform3fv( "SceneSize", glm::max( scene_bounds.Max - scene_bounds.Min, glm::vec3(1e-4f) ) );
+   bindQueues();
+   Sorter.getKeyBuffer().bindBase( GL_SHADER_STORAGE_BUFFER, 4 );
+   Sorter.getValueBuffer().bindBase( GL_SHADER_STORAGE_BUFFER, 5 );
+   glBindBuffer( GL_DISPATCH_INDIRECT_BUFFER, StateBuffer.getBufferID() );
+   glDispatchComputeIndirect( 0 );
+
+   Sorter.sort( 24 );
+
+   // the sorted rays are gathered into the other queue, which then becomes the current one.
+   glUseProgram( ReorderShader->getShaderProgram() );
+   bindQueues();
+   Sorter.getSortedValueBuffer().bindBase( GL_SHADER_STORAGE_BUFFER, 5 );
+   glBindBuffer( GL_DISPATCH_INDIRECT_BUFFER, StateBuffer.getBufferID() );
+   glDispatchComputeIndirect( 0 );
+   glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+   CurrentQueueIndex ^= 1;
+}
+
+void WavefrontGL::intersectAndShadeByMaterial(int depth, int material_num)
+{
+   glUseProgram( IntersectShader->getShaderProgram() );
+   bindQueues();
+   Sorter.getKeyBuffer().bindBase( GL_SHADER_STORAGE_BUFFER, 4 );
+   Sorter.getValueBuffer().bindBase( GL_SHADER_STORAGE_BUFFER, 5 );
+   HitBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 7 );
+   glBindBuffer( GL_DISPATCH_INDIRECT_BUFFER, StateBuffer.getBufferID() );
+   glDispatchComputeIndirect( 0 );
+
+   // the keys are the material indices plus one for the missed rays, which takes a single pass for up to 255 materials.
+   int key_bit_num = 1;
+   while ((1 << key_bit_num) <= material_num) key_bit_num++;
+   Sorter.sort( key_bit_num );
+
+   glUseProgram( ShadeShader->getShaderProgram() );
+   ShadeShader->uniform1i( "Depth", depth );
+   bindQueues();
+   Sorter.getSortedValueBuffer().bindBase( GL_SHADER_STORAGE_BUFFER, 5 );
+   HitBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 7 );
+   glBindBuffer( GL_DISPATCH_INDIRECT_BUFFER, StateBuffer.getBufferID() );
+   glDispatchComputeIndirect( 0 );
+}
+
+void WavefrontGL::extendRays(int depth, int material_num)
+{
+   if (SortByMaterial) intersectAndShadeByMaterial( depth, material_num );
+   else {
+      glUseProgram( ExtendShader->getShaderProgram() );
+      ExtendShader->uniform1i( "Depth", depth );
+      bindQueues();
+      glBindBuffer( GL_DISPATCH_INDIRECT_BUFFER, StateBuffer.getBufferID() );
+      glDispatchComputeIndirect( 0 );
+   }
+   glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+
+   glUseProgram( SetupShader->getShaderProgram() );
+   Sorter.getInfoBuffer().bindBase( GL_SHADER_STORAGE_BUFFER, 6 );
+   glDispatchCompute( 1, 1, 1 );
+   glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT );
+   CurrentQueueIndex ^= 1;
+}
+
+void WavefrontGL::render(
+   ArrayView<Sphere> spheres,
+   const BoundingBox& scene_bounds,
+   int material_num,
+   int frame_index,
+   const CanvasGL* canvas
+)
+{
+   const int pixel_num = Width * Height;
+   const auto group_num = static_cast<GLuint>((pixel_num + GroupSize - 1) / GroupSize);
+   const bool to_sort = needToSort( static_cast<int>(spheres.size()) );
+   ExtendShader->transferSphereUniformsToShader( spheres );
+   IntersectShader->transferSphereUniformsToShader( spheres );
+   GenerateShader->uniform1i( "FrameIndex", frame_index );
+   GenerateShader->uniform2iv( "FrameSize", glm::ivec2(Width, Height) );
+   const auto format = static_cast<int>(AccumulationFormat);
+   ExtendShader->uniform1i( "AccumulationFormat", format );
+   ShadeShader->uniform1i( "AccumulationFormat", format );
+   ResolveShader->uniform1i( "AccumulationFormat", format );
+
+   for (int sample = 0; sample < SampleNum; ++sample) {
+      const std::vector<glm::uvec4> state = {
+         glm::uvec4(group_num, 1, 1, static_cast<GLuint>(pixel_num)),
+         glm::uvec4(0)
+      };
+      StateBuffer.update( state );
+      if (SortByMaterial) Sorter.setElementNum( pixel_num );
+      CurrentQueueIndex = 0;
+
+      glUseProgram( GenerateShader->getShaderProgram() );
+      GenerateShader->uniform1i( "SampleIndex", sample );
+      ExtendShader->uniform1i( "SampleIndex", sample );
+      ShadeShader->uniform1i( "SampleIndex", sample );
+      bindQueues();
+      glDispatchCompute( group_num, 1, 1 );
+      glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+
+      // the primary rays are already coherent, so only the secondary rays are sorted.
+      for (int depth = 0; depth < MaxDepth; ++depth) {
+         if (to_sort && depth > 0) sortRays( scene_bounds );
+         extendRays( depth, material_num );
+      }
+   }
+
+   glUseProgram( ResolveShader->getShaderProgram() );
+   AccumulationBuffer.bindBase( GL_SHADER_STORAGE_BUFFER, 3 );
+   glBindImageTexture( 0, canvas->getColor0TextureID(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8 );
+   glDispatchCompute( group_num, 1, 1 );
+   glMemoryBarrier( GL_SHADER_IMAGE_ACCESS_BARRIER_BIT );
+}
\ No newline at end of file
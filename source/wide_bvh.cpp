@@ -0,0 +1,113 @@
+#include "wide_bvh.h"
+
+void WideBVH::convert(const BVH& binary)
+{
+   convert( binary.getNodes() );
+}
+
+void WideBVH::convert(const std::vector<BVHNode>& binary_nodes)
+{
+   // a leaf count has to fit in a byte below InnerChild, which only the leaves at the depth limit can exceed.
+   Nodes.clear();
+   const bool convertible = std::none_of(
+      binary_nodes.begin(), binary_nodes.end(),
+      [](const BVHNode& node) { return node.isLeaf() && node.Count >= static_cast<int>(InnerChild); }
+   );
+   if (!convertible) return;
+
+   Nodes.emplace_back();
+   if (!binary_nodes.empty()) convertNode( 0, binary_nodes, 0 );
+}
+
+BoundingBox WideBVH::getChildBounds(const WideBVHNode& node, int child)
+{
+   BoundingBox bounds;
+   for (int axis = 0; axis < 3; ++axis) {
+      const float scale = getScale( node.Exponents, axis );
+      const auto min = static_cast<float>((node.Planes[axis] >> (8 * child)) & 0xFFu);
+      const auto max = static_cast<float>((node.Planes[axis + 3] >> (8 * child)) & 0xFFu);
+      bounds.Min[axis] = node.Origin[axis] + min * scale;
+      bounds.Max[axis] = node.Origin[axis] + max * scale;
+   }
+   return bounds;
+}
+
+void WideBVH::convertNode(int wide_index, const std::vector<BVHNode>& binary_nodes, int binary_index)
+{
+   // the grandchildren take the place of the inner children, and a leaf child stays where it is.
+   std::vector<int> children;
+   const BVHNode& root = binary_nodes[binary_index];
+   if (root.isLeaf()) children.emplace_back( binary_index );
+   else {
+      for (const int child : { root.Offset, -root.Count }) {
+         const BVHNode& node = binary_nodes[child];
+         if (node.isLeaf()) children.emplace_back( child );
+         else {
+            children.emplace_back( node.Offset );
+            children.emplace_back( -node.Count );
+         }
+      }
+   }
+
+   WideBVHNode node;
+   node.Origin = root.Min;
+   node.Exponents = getExponents( root );
+
+   std::vector<std::pair<int, int>> inner_children;
+   for (size_t i = 0; i < children.size(); ++i) {
+      const BVHNode& child = binary_nodes[children[i]];
+      quantize( node, static_cast<int>(i), child );
+      if (child.isLeaf()) {
+         node.Child[i] = child.Offset;
+         node.Counts |= static_cast<uint>(child.Count) << (8 * i);
+      }
+      else {
+         node.Child[i] = static_cast<int>(Nodes.size());
+         node.Counts |= InnerChild << (8 * i);
+         inner_children.emplace_back( node.Child[i], children[i] );
+         Nodes.emplace_back();
+      }
+   }
+   Nodes[wide_index] = node;
+   for (const auto& child : inner_children) convertNode( child.first, binary_nodes, child.second );
+}
+
+uint WideBVH::getExponents(const BVHNode& box)
+{
+   uint exponents = 0;
+   const glm::vec3 extent = box.Max - box.Min;
+   for (int axis = 0; axis < 3; ++axis) {
+      // the smallest power of two whose 255 steps still reach the far side of the box, in the same float math as the decoding.
+      int exponent = extent[axis] > 0.0f ? static_cast<int>(std::ceil( std::log2( extent[axis] / 255.0f ) )) : -126;
+      exponent = std::clamp( exponent, -126, 127 );
+      while (exponent < 127 && box.Min[axis] + 255.0f * std::ldexp( 1.0f, exponent ) < box.Max[axis]) exponent++;
+      exponents |= static_cast<uint>(exponent + 127) << (8 * axis);
+   }
+   return exponents;
+}
+
+void WideBVH::quantize(glm::uvec3& min, glm::uvec3& max, const glm::vec3& origin, uint exponents, const BVHNode& box)
+{
+   // the planes are rounded outward, and checked with the decoding so that the float rounding cannot cut the box.
+   for (int axis = 0; axis < 3; ++axis) {
+      const float scale = getScale( exponents, axis );
+      auto min_step = static_cast<int>(std::floor( (box.Min[axis] - origin[axis]) / scale ));
+      auto max_step = static_cast<int>(std::ceil( (box.Max[axis] - origin[axis]) / scale ));
+      min_step = std::clamp( min_step, 0, 255 );
+      max_step = std::clamp( max_step, 0, 255 );
+      while (min_step > 0 && origin[axis] + static_cast<float>(min_step) * scale > box.Min[axis]) min_step--;
+      while (max_step < 255 && origin[axis] + static_cast<float>(max_step) * scale < box.Max[axis]) max_step++;
+      min[axis] = static_cast<uint>(min_step);
+      max[axis] = static_cast<uint>(max_step);
+   }
+}
+
+void WideBVH::quantize(WideBVHNode& node, int child, const BVHNode& bounds)
+{
+   glm::uvec3 min, max;
+   quantize( min, max, node.Origin, node.Exponents, bounds );
+   for (int axis = 0; axis < 3; ++axis) {
+      node.Planes[axis] |= min[axis] << (8 * child);
+      node.Planes[axis + 3] |= max[axis] << (8 * child);
+   }
+}
\ No newline at end of file
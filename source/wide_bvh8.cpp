@@ -0,0 +1,85 @@
+#include "wide_bvh8.h"
+
+void WideBVH8::convert(const std::vector<BVHNode>& binary_nodes, int binary_root)
+{
+   Nodes.clear();
+   if (!isConvertible( binary_nodes, binary_root )) return;
+
+   Nodes.emplace_back();
+   convertNode( 0, binary_nodes, binary_root );
+}
+
+bool WideBVH8::isConvertible(const std::vector<BVHNode>& binary_nodes, int binary_index)
+{
+   // a leaf count has to fit in a byte below InnerChild, which only the leaves at the depth limit can exceed.
+   std::vector<int> stack = { binary_index };
+   while (!stack.empty()) {
+      const BVHNode& node = binary_nodes[stack.back()];
+      stack.pop_back();
+      if (node.isLeaf()) {
+         if (node.Count >= static_cast<int>(WideBVH::InnerChild)) return false;
+      }
+      else {
+         stack.emplace_back( node.Offset );
+         stack.emplace_back( -node.Count );
+      }
+   }
+   return true;
+}
+
+void WideBVH8::convertNode(int wide_index, const std::vector<BVHNode>& binary_nodes, int binary_index)
+{
+   const auto get_area = [&binary_nodes](int index) {
+      return BVH::getSurfaceArea( binary_nodes[index].Min, binary_nodes[index].Max );
+   };
+   const BVHNode& root = binary_nodes[binary_index];
+   std::vector<int> children;
+   if (root.isLeaf()) children.emplace_back( binary_index );
+   else children = { root.Offset, -root.Count };
+   while (static_cast<int>(children.size()) < ChildNum) {
+      int largest = -1;
+      for (int i = 0; i < static_cast<int>(children.size()); ++i) {
+         if (binary_nodes[children[i]].isLeaf()) continue;
+         if (largest < 0 || get_area( children[i] ) > get_area( children[largest] )) largest = i;
+      }
+      if (largest < 0) break;
+
+      const BVHNode& opened = binary_nodes[children[largest]];
+      children[largest] = opened.Offset;
+      children.emplace_back( -opened.Count );
+   }
+
+   WideBVH8Node node;
+   node.Origin = root.Min;
+   node.Exponents = WideBVH::getExponents( root );
+   std::vector<std::pair<int, int>> inner_children;
+   for (size_t i = 0; i < children.size(); ++i) {
+      const BVHNode& child = binary_nodes[children[i]];
+      glm::uvec3 min, max;
+      WideBVH::quantize( min, max, node.Origin, node.Exponents, child );
+      for (int axis = 0; axis < 3; ++axis) {
+         node.Planes[axis][i] = static_cast<uchar>(min[axis]);
+         node.Planes[axis + 3][i] = static_cast<uchar>(max[axis]);
+      }
+      if (child.isLeaf()) {
+         node.Child[i] = child.Offset;
+         node.Counts[i] = static_cast<uchar>(child.Count);
+      }
+      else {
+         node.Counts[i] = static_cast<uchar>(WideBVH::InnerChild);
+         inner_children.emplace_back( static_cast<int>(i), children[i] );
+      }
+   }
+
+   // the inner children are placed next to each other from the largest down, and then converted in the same order.
+   std::sort(
+      inner_children.begin(), inner_children.end(),
+      [&](const std::pair<int, int>& a, const std::pair<int, int>& b) { return get_area( a.second ) > get_area( b.second ); }
+   );
+   for (const auto& child : inner_children) {
+      node.Child[child.first] = static_cast<int>(Nodes.size());
+      Nodes.emplace_back();
+   }
+   Nodes[wide_index] = node;
+   for (const auto& child : inner_children) convertNode( node.Child[child.first], binary_nodes, child.second );
+}
\ No newline at end of file